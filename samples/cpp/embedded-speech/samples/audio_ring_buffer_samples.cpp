@@ -0,0 +1,456 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See https://aka.ms/csspeech/license for the full license information.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <speechapi_cxx.h>
+
+using namespace std;
+using namespace Microsoft::CognitiveServices::Speech;
+using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+extern shared_ptr<EmbeddedSpeechConfig> CreateEmbeddedSpeechConfig();
+
+extern uint32_t GetEmbeddedSpeechSamplesPerSecond();
+extern uint8_t GetEmbeddedSpeechBitsPerSample();
+extern uint8_t GetEmbeddedSpeechChannels();
+
+extern const string GetSpeechWavAudioFileName();
+
+extern vector<uint8_t> ReadWavFileAudio(const string& fileName);
+extern string Prompt(const string& question, const string& defaultValue);
+
+
+// What AudioRingBuffer::Write() does when the buffer is full.
+enum class RingBufferOverflow
+{
+    // Discards the oldest buffered frame to make room. Write() never waits.
+    DropOldest,
+    // Waits for room up to a timeout, then discards the rest of the new audio.
+    BlockWithTimeout
+};
+
+
+// A single-producer, single-consumer ring buffer of audio frames.
+// An audio capture thread (the producer) must not wait, but PushAudioInputStream::Write()
+// can wait while the recognizer is busy. With this buffer in between, only the thread
+// that forwards frames into the push stream (the consumer) waits.
+// The producer writes audio in any size and the consumer reads it in frames of a fixed size.
+// Neither side takes a lock, so the producer is never held up by the consumer being descheduled.
+class AudioRingBuffer final
+{
+private:
+    static constexpr uint64_t noFrame = UINT64_MAX;
+
+    const size_t m_frameSize;
+    // One slot more than the capacity, so that the producer never writes into the slot
+    // that the consumer has just claimed for reading.
+    const uint64_t m_slotCount;
+    const RingBufferOverflow m_overflow;
+    const chrono::microseconds m_timeout;
+    vector<uint8_t> m_data;
+    vector<size_t> m_sizes;
+
+    // Frames [m_tail, m_head) are buffered. The producer advances m_head, the consumer
+    // advances m_tail, and with DropOldest the producer advances m_tail as well.
+    atomic<uint64_t> m_head{ 0 };
+    atomic<uint64_t> m_tail{ 0 };
+    // The frame that the consumer is copying, or noFrame.
+    atomic<uint64_t> m_reading{ noFrame };
+    atomic<bool> m_closed{ false };
+    atomic<uint64_t> m_overruns{ 0 };
+    atomic<uint64_t> m_droppedBytes{ 0 };
+
+    size_t m_fill = 0; // bytes in the frame being filled at m_head; used by the producer only
+
+    // Makes the slot at m_head available for writing. Returns false if there is no room.
+    bool AcquireSlot()
+    {
+        auto head = m_head.load(memory_order_relaxed);
+        auto deadline = chrono::steady_clock::now() + m_timeout;
+        while (true)
+        {
+            auto tail = m_tail.load(memory_order_acquire);
+            if (head - tail < m_slotCount - 1)
+            {
+                // Also makes sure that the consumer is not still copying an older frame from this slot.
+                auto reading = m_reading.load(memory_order_acquire);
+                if (reading == noFrame || head - reading < m_slotCount)
+                {
+                    return true;
+                }
+            }
+            else if (m_overflow == RingBufferOverflow::DropOldest)
+            {
+                if (m_tail.compare_exchange_weak(tail, tail + 1, memory_order_acq_rel))
+                {
+                    m_overruns++;
+                    m_droppedBytes += m_sizes[tail % m_slotCount];
+                }
+                continue;
+            }
+
+            if (m_overflow == RingBufferOverflow::DropOldest || chrono::steady_clock::now() >= deadline)
+            {
+                return false;
+            }
+            this_thread::yield();
+        }
+    }
+
+    void PublishSlot()
+    {
+        auto head = m_head.load(memory_order_relaxed);
+        m_sizes[head % m_slotCount] = m_fill;
+        m_head.store(head + 1, memory_order_release);
+        m_fill = 0;
+    }
+
+public:
+    // 'frameCount' frames of 'frameSize' bytes each can be buffered.
+    // 'timeout' is only used with RingBufferOverflow::BlockWithTimeout.
+    AudioRingBuffer(size_t frameSize, size_t frameCount, RingBufferOverflow overflow, chrono::microseconds timeout = chrono::microseconds(0))
+        : m_frameSize(frameSize), m_slotCount(frameCount + 1), m_overflow(overflow), m_timeout(timeout),
+          m_data(frameSize * (frameCount + 1)), m_sizes(frameCount + 1)
+    {
+        if (frameSize == 0 || frameCount == 0)
+        {
+            throw invalid_argument("Ring buffer frame size and count must not be 0.");
+        }
+    }
+
+    AudioRingBuffer(const AudioRingBuffer&) = delete;
+    AudioRingBuffer& operator=(const AudioRingBuffer&) = delete;
+
+    // Producer: Adds audio. Audio that does not fit is discarded and counted as an overrun.
+    void Write(const uint8_t* data, size_t size)
+    {
+        while (size > 0)
+        {
+            if (m_fill == 0 && !AcquireSlot())
+            {
+                m_overruns++;
+                m_droppedBytes += size;
+                return;
+            }
+            auto count = min(size, m_frameSize - m_fill);
+            memcpy(m_data.data() + (m_head.load(memory_order_relaxed) % m_slotCount) * m_frameSize + m_fill, data, count);
+            m_fill += count;
+            data += count;
+            size -= count;
+            if (m_fill == m_frameSize)
+            {
+                PublishSlot();
+            }
+        }
+    }
+
+    // Producer: Makes the last, partial frame available and marks the end of the audio.
+    void Close()
+    {
+        if (m_fill > 0)
+        {
+            PublishSlot();
+        }
+        m_closed.store(true, memory_order_release);
+    }
+
+    // Consumer: Copies the oldest frame into 'frame', which must hold a full frame.
+    // Returns the size of the frame, or 0 if no frame is buffered.
+    size_t Read(uint8_t* frame)
+    {
+        while (true)
+        {
+            auto tail = m_tail.load(memory_order_acquire);
+            if (tail == m_head.load(memory_order_acquire))
+            {
+                return 0;
+            }
+            // Tells the producer which slot is in use before claiming it. If the producer
+            // drops the frame in the meantime, the claim fails and the next frame is tried.
+            m_reading.store(tail);
+            if (m_tail.compare_exchange_strong(tail, tail + 1))
+            {
+                auto slot = tail % m_slotCount;
+                auto size = m_sizes[slot];
+                memcpy(frame, m_data.data() + slot * m_frameSize, size);
+                m_reading.store(noFrame, memory_order_release);
+                return size;
+            }
+            m_reading.store(noFrame, memory_order_release);
+        }
+    }
+
+    // Consumer: Whether the producer has closed the buffer. Check this before Read(),
+    // so that when Read() then returns 0, all audio has been read.
+    bool IsClosed() const
+    {
+        return m_closed.load(memory_order_acquire);
+    }
+
+    size_t FrameSize() const
+    {
+        return m_frameSize;
+    }
+
+    // The number of times that audio was discarded because the buffer was full.
+    uint64_t Overruns() const
+    {
+        return m_overruns;
+    }
+
+    // The amount of audio discarded because the buffer was full, in bytes.
+    uint64_t DroppedBytes() const
+    {
+        return m_droppedBytes;
+    }
+};
+
+
+// Forwards the frames of an AudioRingBuffer into a push stream on a thread of its own,
+// and closes the push stream when the ring buffer is closed and empty, or when the drain
+// is destroyed and the ring buffer is empty.
+class AudioRingBufferDrain final
+{
+private:
+    AudioRingBuffer& m_buffer;
+    shared_ptr<PushAudioInputStream> m_pushStream;
+    const chrono::microseconds m_frameDuration;
+    atomic<uint64_t> m_frames{ 0 };
+    atomic<uint64_t> m_underruns{ 0 };
+    atomic<bool> m_stopping{ false };
+    thread m_thread;
+
+    void Run()
+    {
+        vector<uint8_t> frame(m_buffer.FrameSize());
+        // Polls often enough to add little latency. A capture thread cannot signal without risking a wait.
+        auto pollInterval = max(chrono::microseconds(500), m_frameDuration / 8);
+        auto lastFrameTime = chrono::steady_clock::now();
+        auto underrun = false;
+        while (true)
+        {
+            auto closed = m_buffer.IsClosed();
+            auto size = m_buffer.Read(frame.data());
+            if (size > 0)
+            {
+                m_pushStream->Write(frame.data(), (uint32_t)size);
+                m_frames++;
+                lastFrameTime = chrono::steady_clock::now();
+                underrun = false;
+                continue;
+            }
+            if (closed || m_stopping)
+            {
+                break;
+            }
+            // The source is late if the next frame has not arrived within twice its duration.
+            if (!underrun && m_frames > 0 && chrono::steady_clock::now() - lastFrameTime > 2 * m_frameDuration)
+            {
+                underrun = true;
+                m_underruns++;
+            }
+            this_thread::sleep_for(pollInterval);
+        }
+        m_pushStream->Close();
+    }
+
+public:
+    // 'frameDuration' is the duration of the audio in a full frame.
+    AudioRingBufferDrain(AudioRingBuffer& buffer, shared_ptr<PushAudioInputStream> pushStream, chrono::microseconds frameDuration)
+        : m_buffer(buffer), m_pushStream(pushStream), m_frameDuration(frameDuration)
+    {
+        m_thread = thread(&AudioRingBufferDrain::Run, this);
+    }
+
+    AudioRingBufferDrain(const AudioRingBufferDrain&) = delete;
+    AudioRingBufferDrain& operator=(const AudioRingBufferDrain&) = delete;
+
+    // Waits until all buffered frames have been forwarded. If the ring buffer was not closed,
+    // e.g. because the capture never started, does not wait for more audio.
+    ~AudioRingBufferDrain()
+    {
+        m_stopping = true;
+        m_thread.join();
+    }
+
+    // The number of frames forwarded into the push stream.
+    uint64_t Frames() const
+    {
+        return m_frames;
+    }
+
+    // The number of times that the next frame was late, i.e. the source did not keep up.
+    uint64_t Underruns() const
+    {
+        return m_underruns;
+    }
+};
+
+
+// One simulated capture channel: a ring buffer, its drain, and the recognizer reading the push stream.
+// Members are destroyed in reverse order. The drain goes first and closes the push stream, then the
+// recognizer, whose event handlers use the other members, e.g. when setting up another channel failed.
+struct CaptureChannel
+{
+    unique_ptr<AudioRingBuffer> ringBuffer;
+    promise<void> sessionStopped;
+    atomic<int> results{ 0 };
+    double maxWriteMicroseconds = 0.0;
+    shared_ptr<SpeechRecognizer> recognizer;
+    unique_ptr<AudioRingBufferDrain> drain;
+};
+
+
+// Simulates audio capture on many channels at once, each channel with a capture thread
+// that writes 10ms periods in real time into a ring buffer, which is drained into the
+// push stream of a recognizer. Reports how long the capture threads spent writing,
+// and the overruns and underruns of each channel.
+void EmbeddedSpeechRecognitionRingBufferStressTest()
+{
+    int channelCount = 0;
+    int seconds = 0;
+    int capacityMilliseconds = 0;
+    istringstream(Prompt("Channels", "8")) >> channelCount;
+    istringstream(Prompt("Duration in seconds", "10")) >> seconds;
+    istringstream(Prompt("Ring buffer capacity in milliseconds", "1000")) >> capacityMilliseconds;
+    auto policy = Prompt("Overflow policy, drop or block", "drop");
+    if (channelCount < 1 || seconds < 1 || capacityMilliseconds < 100 || (policy != "drop" && policy != "block"))
+    {
+        throw invalid_argument("Invalid number of channels, duration, capacity or overflow policy.");
+    }
+    auto overflow = policy == "drop" ? RingBufferOverflow::DropOldest : RingBufferOverflow::BlockWithTimeout;
+    // Half of a capture period, so that a capture thread that times out can still keep up.
+    auto blockTimeout = chrono::microseconds(5000);
+
+    const auto bytesPerMillisecond = GetEmbeddedSpeechSamplesPerSecond() / 1000 * GetEmbeddedSpeechBitsPerSample() / 8 * GetEmbeddedSpeechChannels();
+    const size_t periodMilliseconds = 10;  // a typical ALSA period
+    const size_t frameMilliseconds = 100;  // written into the push stream at a time
+    const size_t periodSize = periodMilliseconds * bytesPerMillisecond;
+    const size_t frameSize = frameMilliseconds * bytesPerMillisecond;
+
+    auto audio = ReadWavFileAudio(GetSpeechWavAudioFileName());
+    if (audio.size() < periodSize)
+    {
+        throw invalid_argument("Audio file is too short.");
+    }
+    auto speechConfig = CreateEmbeddedSpeechConfig();
+    auto audioFormat = AudioStreamFormat::GetWaveFormatPCM(GetEmbeddedSpeechSamplesPerSecond(), GetEmbeddedSpeechBitsPerSample(), GetEmbeddedSpeechChannels());
+
+    vector<unique_ptr<CaptureChannel>> channels;
+    for (int i = 0; i < channelCount; i++)
+    {
+        auto channel = make_unique<CaptureChannel>();
+        auto channelPtr = channel.get();
+        auto pushStream = AudioInputStream::CreatePushStream(audioFormat);
+        channel->ringBuffer = make_unique<AudioRingBuffer>(frameSize, capacityMilliseconds / frameMilliseconds, overflow, blockTimeout);
+        channel->recognizer = SpeechRecognizer::FromConfig(speechConfig, AudioConfig::FromStreamInput(pushStream));
+
+        channel->recognizer->Recognized += [channelPtr](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                channelPtr->results++;
+            }
+        };
+        channel->recognizer->Canceled += [i](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            if (e.Reason == CancellationReason::Error)
+            {
+                cerr << "Channel " << i << " CANCELED: ErrorCode=" << int(e.ErrorCode) << " ErrorDetails=" << e.ErrorDetails << endl;
+            }
+        };
+        channel->recognizer->SessionStopped += [channelPtr](const SessionEventArgs&)
+        {
+            channelPtr->sessionStopped.set_value();
+        };
+
+        channel->recognizer->StartContinuousRecognitionAsync().get();
+        channel->drain = make_unique<AudioRingBufferDrain>(*channel->ringBuffer, pushStream, chrono::milliseconds(frameMilliseconds));
+        channels.push_back(move(channel));
+    }
+
+    cout << "Capturing " << channelCount << " channels for " << seconds << " seconds...\n";
+    auto periodCount = seconds * 1000 / periodMilliseconds;
+    auto startTime = chrono::steady_clock::now();
+    vector<thread> captureThreads;
+    try
+    {
+        for (auto& channel : channels)
+        {
+            auto channelPtr = channel.get();
+            captureThreads.emplace_back([channelPtr, &audio, periodCount, periodSize, periodMilliseconds, startTime]
+                {
+                    size_t offset = 0;
+                    for (size_t period = 0; period < periodCount; period++)
+                    {
+                        // A capture API delivers each period when it has been recorded.
+                        this_thread::sleep_until(startTime + chrono::milliseconds((period + 1) * periodMilliseconds));
+                        if (offset + periodSize > audio.size())
+                        {
+                            offset = 0;
+                        }
+                        auto writeStart = chrono::steady_clock::now();
+                        channelPtr->ringBuffer->Write(audio.data() + offset, periodSize);
+                        auto writeMicroseconds = chrono::duration<double, micro>(chrono::steady_clock::now() - writeStart).count();
+                        channelPtr->maxWriteMicroseconds = max(channelPtr->maxWriteMicroseconds, writeMicroseconds);
+                        offset += periodSize;
+                    }
+                    channelPtr->ringBuffer->Close();
+                });
+        }
+    }
+    catch (...)
+    {
+        // The threads that were started capture for the given duration and exit, so they can be joined.
+        for (auto& captureThread : captureThreads)
+        {
+            captureThread.join();
+        }
+        throw;
+    }
+    for (auto& captureThread : captureThreads)
+    {
+        captureThread.join();
+    }
+    auto captureSeconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+
+    cout << "Capture done in " << fixed << setprecision(1) << captureSeconds << " s, waiting for recognition to finish...\n";
+    // A session stops after the drain has closed the push stream, so the drain counters are final then.
+    for (auto& channel : channels)
+    {
+        channel->sessionStopped.get_future().get();
+        channel->recognizer->StopContinuousRecognitionAsync().get();
+    }
+
+    cout << "\n" << setw(8) << "Channel" << setw(10) << "Frames" << setw(11) << "Overruns" << setw(11) << "Underruns"
+         << setw(12) << "Dropped ms" << setw(16) << "Max write us" << setw(9) << "Results\n";
+    uint64_t totalOverruns = 0;
+    double maxWriteMicroseconds = 0.0;
+    for (size_t i = 0; i < channels.size(); i++)
+    {
+        auto& channel = *channels[i];
+        auto overruns = channel.ringBuffer->Overruns();
+        totalOverruns += overruns;
+        maxWriteMicroseconds = max(maxWriteMicroseconds, channel.maxWriteMicroseconds);
+        cout << setw(8) << i << setw(10) << channel.drain->Frames()
+             << setw(11) << overruns << setw(11) << channel.drain->Underruns()
+             << setw(12) << channel.ringBuffer->DroppedBytes() / bytesPerMillisecond
+             << setw(16) << setprecision(0) << channel.maxWriteMicroseconds << setw(8) << channel.results << endl;
+    }
+    cout << "\nLongest write by a capture thread: " << setprecision(0) << maxWriteMicroseconds << " us\n";
+    if (totalOverruns > 0)
+    {
+        cout << "Audio was discarded because recognition did not keep up with capture. "
+             << "Use fewer channels or a larger ring buffer if recognition falls behind only temporarily.\n";
+    }
+}
@@ -0,0 +1,482 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See https://aka.ms/csspeech/license for the full license information.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <speechapi_cxx.h>
+#include <nlohmann/json.hpp>
+#include "push_stream_times.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+using namespace Microsoft::CognitiveServices::Speech;
+using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+extern shared_ptr<EmbeddedSpeechConfig> CreateEmbeddedSpeechConfig();
+
+extern uint32_t GetEmbeddedSpeechSamplesPerSecond();
+extern uint8_t GetEmbeddedSpeechBitsPerSample();
+extern uint8_t GetEmbeddedSpeechChannels();
+
+extern const string GetPerfTestAudioFileName();
+
+extern string SpeechRecognitionModelName;
+
+extern vector<uint8_t> ReadWavFileAudio(const string& fileName);
+extern double GetProcessCpuSeconds();
+extern void PushStreamInputFromAudio(shared_ptr<PushAudioInputStream> pushStream, const vector<uint8_t>& audio, function<void(uint64_t)> onWrite);
+
+
+// Gets the peak resident memory (working set) of this process so far, in megabytes.
+double GetPeakResidentMegabytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0.0;
+    }
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0.0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    return usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+#endif
+}
+
+
+// Count, mean, and percentiles of a set of measurements.
+struct Distribution
+{
+    size_t count = 0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+static Distribution Summarize(vector<double> values)
+{
+    Distribution distribution;
+    if (values.empty())
+    {
+        return distribution;
+    }
+    sort(values.begin(), values.end());
+    // Nearest-rank percentile.
+    auto percentile = [&values](double p)
+    {
+        auto rank = (size_t)ceil(p / 100.0 * values.size());
+        return values[rank > 0 ? rank - 1 : 0];
+    };
+    distribution.count = values.size();
+    for (auto value : values)
+    {
+        distribution.mean += value / values.size();
+    }
+    distribution.p50 = percentile(50);
+    distribution.p90 = percentile(90);
+    distribution.p99 = percentile(99);
+    distribution.max = values.back();
+    return distribution;
+}
+
+static nlohmann::json ToJson(const Distribution& distribution)
+{
+    return nlohmann::json {
+        { "count", distribution.count },
+        { "mean", distribution.mean },
+        { "p50", distribution.p50 },
+        { "p90", distribution.p90 },
+        { "p99", distribution.p99 },
+        { "max", distribution.max }
+    };
+}
+
+
+// Adds the numeric values of a PerformanceCounters JSON element to 'counters', by name.
+// Counters given as a list of {"Name": ..., "Value": ...} objects are added under their names, other values
+// under their JSON path (e.g. "Decoder.LatencyMs"), so the benchmark does not depend on a specific set of counters.
+static void CollectPerformanceCounters(const nlohmann::json& element, const string& path, map<string, vector<double>>& counters)
+{
+    if (element.is_number())
+    {
+        counters[path].push_back(element.get<double>());
+    }
+    else if (element.is_object())
+    {
+        if (element.contains("Name") && element["Name"].is_string() && element.contains("Value"))
+        {
+            auto name = element["Name"].get<string>();
+            CollectPerformanceCounters(element["Value"], path.empty() ? name : path + "." + name, counters);
+            return;
+        }
+        for (auto item = element.begin(); item != element.end(); ++item)
+        {
+            CollectPerformanceCounters(item.value(), path.empty() ? item.key() : path + "." + item.key(), counters);
+        }
+    }
+    else if (element.is_array())
+    {
+        for (const auto& item : element)
+        {
+            CollectPerformanceCounters(item, path, counters);
+        }
+    }
+}
+
+
+// Measurements of one recognition of one file.
+struct BenchmarkRun
+{
+    string fileName;
+    int iteration = 0;
+    double audioSeconds = 0.0;
+    double constructionMs = 0.0;
+    double wallSeconds = 0.0;
+    double cpuSeconds = 0.0;
+    double firstPartialMs = -1.0; // -1 if there was no intermediate result
+    vector<double> finalLatenciesMs;
+    map<string, vector<double>> performanceCounters;
+    int results = 0;
+    bool failed = false;
+};
+
+
+// Recognizes the audio of one file from a push stream and measures it.
+// The audio is pushed as fast as the recognizer accepts it, and the time each chunk was pushed is recorded.
+// The latency of a final result is the time from pushing the end of its audio until the result arrived.
+// The first partial latency is the time from the start of recognition until the first intermediate result.
+static BenchmarkRun RunBenchmarkOnce(shared_ptr<EmbeddedSpeechConfig> speechConfig, const string& fileName, const vector<uint8_t>& audio)
+{
+    const double bytesPerSecond = GetEmbeddedSpeechSamplesPerSecond() * GetEmbeddedSpeechBitsPerSample() / 8.0 * GetEmbeddedSpeechChannels();
+
+    BenchmarkRun run;
+    run.fileName = fileName;
+    run.audioSeconds = audio.size() / bytesPerSecond;
+
+    auto audioFormat = AudioStreamFormat::GetWaveFormatPCM(GetEmbeddedSpeechSamplesPerSecond(), GetEmbeddedSpeechBitsPerSample(), GetEmbeddedSpeechChannels());
+    auto pushStream = AudioInputStream::CreatePushStream(audioFormat);
+
+    auto constructionStart = chrono::steady_clock::now();
+    auto recognizer = SpeechRecognizer::FromConfig(speechConfig, AudioConfig::FromStreamInput(pushStream));
+    run.constructionMs = chrono::duration<double, milli>(chrono::steady_clock::now() - constructionStart).count();
+
+    mutex runMutex; // guards run, which is updated from SDK threads
+    PushStreamTimes pushTimes;
+    promise<void> recognitionEnd;
+    chrono::steady_clock::time_point startTime;
+
+    recognizer->Recognizing += [&](const SpeechRecognitionEventArgs& e)
+    {
+        auto now = chrono::steady_clock::now();
+        lock_guard<mutex> lock(runMutex);
+        if (e.Result->Reason == ResultReason::RecognizingSpeech && run.firstPartialMs < 0)
+        {
+            run.firstPartialMs = chrono::duration<double, milli>(now - startTime).count();
+        }
+    };
+
+    recognizer->Recognized += [&](const SpeechRecognitionEventArgs& e)
+    {
+        auto now = chrono::steady_clock::now();
+        if (e.Result->Reason != ResultReason::RecognizedSpeech)
+        {
+            return;
+        }
+        string jsonResult = e.Result->Properties.GetProperty(PropertyId::SpeechServiceResponse_JsonResult);
+        auto json = nlohmann::json::parse(jsonResult, nullptr, false);
+
+        lock_guard<mutex> lock(runMutex);
+        run.results++;
+        // Offset and duration are in ticks of 100 nanoseconds.
+        auto endOffset = (uint64_t)((e.Result->Offset() + e.Result->Duration()) / 1e7 * bytesPerSecond);
+        chrono::steady_clock::time_point pushTime;
+        if (pushTimes.Find(endOffset, pushTime))
+        {
+            run.finalLatenciesMs.push_back(chrono::duration<double, milli>(now - pushTime).count());
+        }
+        if (!json.is_discarded() && json.contains("PerformanceCounters"))
+        {
+            CollectPerformanceCounters(json["PerformanceCounters"], "", run.performanceCounters);
+        }
+    };
+
+    recognizer->Canceled += [&](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        if (e.Reason == CancellationReason::Error)
+        {
+            lock_guard<mutex> lock(runMutex);
+            run.failed = true;
+            cerr << "CANCELED: ErrorCode=" << int(e.ErrorCode) << " ErrorDetails=" << e.ErrorDetails << endl;
+        }
+    };
+
+    recognizer->SessionStopped += [&recognitionEnd](const SessionEventArgs&)
+    {
+        recognitionEnd.set_value();
+    };
+
+    auto cpuStart = GetProcessCpuSeconds();
+    startTime = chrono::steady_clock::now();
+    recognizer->StartContinuousRecognitionAsync().get();
+
+    thread pushThread([&]
+        {
+            PushStreamInputFromAudio(pushStream, audio, [&](uint64_t endOffset)
+                {
+                    pushTimes.Add(endOffset, chrono::steady_clock::now());
+                });
+        });
+
+    recognitionEnd.get_future().get();
+    run.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    run.cpuSeconds = GetProcessCpuSeconds() - cpuStart;
+
+    pushThread.join();
+    recognizer->StopContinuousRecognitionAsync().get();
+    return run;
+}
+
+
+// Asks a question on the console and returns the answer, or 'defaultValue' if the answer is empty.
+string Prompt(const string& question, const string& defaultValue)
+{
+    cout << question << " (default " << defaultValue << "): ";
+    cout.flush();
+    string input;
+    getline(cin, input);
+    return input.empty() ? defaultValue : input;
+}
+
+static string CsvField(const string& value)
+{
+    if (value.find_first_of(",\"\n") == string::npos)
+    {
+        return value;
+    }
+    string quoted = "\"";
+    for (auto c : value)
+    {
+        quoted += c;
+        if (c == '"')
+        {
+            quoted += '"';
+        }
+    }
+    return quoted + "\"";
+}
+
+
+// Benchmarks embedded speech recognition with a corpus of WAV files.
+// Each file is recognized in a number of warm-up iterations, which are not measured, and then in a number of
+// measured iterations. The performance counters of each result (see EmbeddedSpeechRecognitionPerformanceTest),
+// real-time factor, latencies, CPU time and peak memory are aggregated and written to
+//   <report>.json - summary with percentiles, and all runs
+//   <report>.csv  - one row per measured run
+// so that results can be compared between Speech SDK versions, models and devices.
+void EmbeddedSpeechRecognitionBenchmark()
+{
+    auto corpus = Prompt("WAV file, or text file with one WAV file path per line", GetPerfTestAudioFileName());
+    int warmupIterations = 0;
+    int measuredIterations = 0;
+    istringstream(Prompt("Warm-up iterations per file", "1")) >> warmupIterations;
+    istringstream(Prompt("Measured iterations per file", "3")) >> measuredIterations;
+    auto reportName = Prompt("Report file name without extension", "benchmark");
+    if (warmupIterations < 0 || measuredIterations < 1)
+    {
+        cerr << "## ERROR: Invalid number of iterations.\n";
+        return;
+    }
+
+    vector<string> fileNames;
+    if (corpus.size() > 4 && (corpus.compare(corpus.size() - 4, 4, ".wav") == 0 || corpus.compare(corpus.size() - 4, 4, ".WAV") == 0))
+    {
+        fileNames.push_back(corpus);
+    }
+    else
+    {
+        ifstream list(corpus);
+        if (!list.good())
+        {
+            cerr << "## ERROR: Failed to open " << corpus << endl;
+            return;
+        }
+        string line;
+        while (getline(list, line))
+        {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty() && line[0] != '#')
+            {
+                fileNames.push_back(line);
+            }
+        }
+    }
+
+    auto speechConfig = CreateEmbeddedSpeechConfig();
+    if (!speechConfig)
+    {
+        return;
+    }
+    // Enables performance metrics to be included with recognition results.
+    speechConfig->SetProperty(PropertyId::EmbeddedSpeech_EnablePerformanceMetrics, "true");
+
+    // Loads all audio first, so that reading files does not affect the measurements.
+    vector<vector<uint8_t>> audio;
+    for (const auto& fileName : fileNames)
+    {
+        audio.push_back(ReadWavFileAudio(fileName));
+    }
+
+    vector<BenchmarkRun> runs;
+    for (size_t i = 0; i < fileNames.size(); i++)
+    {
+        for (int iteration = -warmupIterations; iteration < measuredIterations; iteration++)
+        {
+            cout << (iteration < 0 ? "Warming up with " : "Measuring ") << fileNames[i];
+            if (iteration >= 0)
+            {
+                cout << " (" << iteration + 1 << "/" << measuredIterations << ")";
+            }
+            cout << "..." << endl;
+
+            auto run = RunBenchmarkOnce(speechConfig, fileNames[i], audio[i]);
+            if (iteration >= 0)
+            {
+                run.iteration = iteration;
+                runs.push_back(move(run));
+            }
+        }
+    }
+
+    // Aggregates the measured runs.
+    double audioSeconds = 0.0, wallSeconds = 0.0, cpuSeconds = 0.0;
+    int failedRuns = 0;
+    vector<double> realTimeFactors, constructionMs, firstPartialMs, finalLatenciesMs;
+    map<string, vector<double>> performanceCounters;
+    for (const auto& run : runs)
+    {
+        audioSeconds += run.audioSeconds;
+        wallSeconds += run.wallSeconds;
+        cpuSeconds += run.cpuSeconds;
+        failedRuns += run.failed ? 1 : 0;
+        realTimeFactors.push_back(run.wallSeconds / run.audioSeconds);
+        constructionMs.push_back(run.constructionMs);
+        if (run.firstPartialMs >= 0)
+        {
+            firstPartialMs.push_back(run.firstPartialMs);
+        }
+        finalLatenciesMs.insert(finalLatenciesMs.end(), run.finalLatenciesMs.begin(), run.finalLatenciesMs.end());
+        for (const auto& counter : run.performanceCounters)
+        {
+            auto& values = performanceCounters[counter.first];
+            values.insert(values.end(), counter.second.begin(), counter.second.end());
+        }
+    }
+
+    nlohmann::json report;
+    auto now = time(nullptr);
+    char timestamp[32];
+#pragma warning(suppress : 4996) // gmtime
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    report["timestamp"] = timestamp;
+#if defined(_WIN32)
+    report["device"]["os"] = "Windows";
+#elif defined(__APPLE__)
+    report["device"]["os"] = "macOS";
+#else
+    report["device"]["os"] = "Linux";
+#endif
+    report["device"]["cpuCores"] = thread::hardware_concurrency();
+    report["model"] = SpeechRecognitionModelName;
+    report["corpus"] = fileNames;
+    report["warmupIterations"] = warmupIterations;
+    report["measuredIterations"] = measuredIterations;
+
+    auto& summary = report["summary"];
+    summary["runs"] = runs.size();
+    summary["failedRuns"] = failedRuns;
+    summary["audioSeconds"] = audioSeconds;
+    summary["wallSeconds"] = wallSeconds;
+    summary["cpuSeconds"] = cpuSeconds;
+    auto realTimeFactor = Summarize(realTimeFactors);
+    auto firstPartialLatency = Summarize(firstPartialMs);
+    auto finalResultLatency = Summarize(finalLatenciesMs);
+    auto peakResidentMegabytes = GetPeakResidentMegabytes();
+    summary["realTimeFactor"] = ToJson(realTimeFactor);
+    summary["recognizerConstructionMs"] = ToJson(Summarize(constructionMs));
+    summary["firstPartialLatencyMs"] = ToJson(firstPartialLatency);
+    summary["finalResultLatencyMs"] = ToJson(finalResultLatency);
+    summary["peakResidentMegabytes"] = peakResidentMegabytes;
+    summary["performanceCounters"] = nlohmann::json::object();
+    for (const auto& counter : performanceCounters)
+    {
+        summary["performanceCounters"][counter.first] = ToJson(Summarize(counter.second));
+    }
+
+    report["runs"] = nlohmann::json::array();
+    ofstream csv(reportName + ".csv");
+    csv << "file,iteration,audio_s,wall_s,cpu_s,rtf,construction_ms,first_partial_ms,final_latency_p50_ms,final_latency_p90_ms,results,failed\n";
+    for (const auto& run : runs)
+    {
+        auto finalLatency = Summarize(run.finalLatenciesMs);
+        report["runs"].push_back({
+            { "file", run.fileName },
+            { "iteration", run.iteration },
+            { "audioSeconds", run.audioSeconds },
+            { "wallSeconds", run.wallSeconds },
+            { "cpuSeconds", run.cpuSeconds },
+            { "realTimeFactor", run.wallSeconds / run.audioSeconds },
+            { "recognizerConstructionMs", run.constructionMs },
+            { "firstPartialLatencyMs", run.firstPartialMs },
+            { "finalResultLatencyMs", ToJson(finalLatency) },
+            { "results", run.results },
+            { "failed", run.failed }
+        });
+        csv << CsvField(run.fileName) << "," << run.iteration << "," << run.audioSeconds << "," << run.wallSeconds << ","
+            << run.cpuSeconds << "," << run.wallSeconds / run.audioSeconds << "," << run.constructionMs << ","
+            << run.firstPartialMs << "," << finalLatency.p50 << "," << finalLatency.p90 << "," << run.results << ","
+            << (run.failed ? 1 : 0) << "\n";
+    }
+    ofstream json(reportName + ".json");
+    json << report.dump(2) << endl;
+
+    ostringstream text;
+    text << fixed << setprecision(3);
+    text << "\nRuns:                    " << runs.size() << " (" << failedRuns << " failed)\n";
+    text << "Real-time factor:        p50 " << realTimeFactor.p50 << ", p90 " << realTimeFactor.p90 << "\n";
+    text << setprecision(1);
+    text << "First partial latency:   p50 " << firstPartialLatency.p50 << " ms, p90 " << firstPartialLatency.p90 << " ms\n";
+    text << "Final result latency:    p50 " << finalResultLatency.p50 << " ms, p90 " << finalResultLatency.p90 << " ms, p99 " << finalResultLatency.p99 << " ms\n";
+    text << "CPU time:                " << cpuSeconds << " s for " << audioSeconds << " s of audio\n";
+    text << "Peak resident memory:    " << peakResidentMegabytes << " MB\n";
+    text << "Reports written to " << reportName << ".json and " << reportName << ".csv\n";
+    cout << text.str();
+}
@@ -32,12 +32,23 @@ extern void ListEmbeddedSpeechTranslationModels();
 extern void EmbeddedSpeechTranslationFromMicrophone();
 
 extern void EmbeddedSpeechRecognitionPerformanceTest();
+extern void EmbeddedSpeechRecognitionMultiStreamTest();
+extern void EmbeddedSpeechRecognitionBenchmark();
+extern void EmbeddedSpeechRecognitionStartupTest();
+extern void EmbeddedSpeechRecognitionWithRecognizerPool();
+extern void EmbeddedSpeechRecognitionPushStreamLatencyTest();
+extern void EmbeddedSpeechRecognitionRingBufferStressTest();
+
+extern void StartEmbeddedSpeechModelPrefetch();
 
 
 int main()
 {
     try
     {
+        // Optionally reads model files into the file cache while the application initializes.
+        StartEmbeddedSpeechModelPrefetch();
+
         if (VerifySettings() != true)
         {
             return 1;
@@ -67,6 +78,12 @@ int main()
             cout << "14. Embedded speech translation with microphone input.\n";
             cout << "\nDevice performance measurement\n";
             cout << "15. Embedded speech recognition.\n";
+            cout << "16. Embedded speech recognition with multiple concurrent streams.\n";
+            cout << "17. Embedded speech recognition benchmark with a set of WAV files.\n";
+            cout << "18. Embedded speech recognition startup time, cold and warm.\n";
+            cout << "19. Embedded speech recognition latency with a pre-warmed recognizer pool.\n";
+            cout << "20. Embedded speech recognition latency with real-time and maximum speed push stream input.\n";
+            cout << "21. Embedded speech recognition with ring-buffered audio capture on multiple channels.\n";
             cout << "\nChoose a number (or none for exit) and press Enter: ";
             cout.flush();
 
@@ -125,6 +142,24 @@ int main()
             case 15:
                 if (HasSpeechRecognitionModel()) EmbeddedSpeechRecognitionPerformanceTest();
                 break;
+            case 16:
+                if (HasSpeechRecognitionModel()) EmbeddedSpeechRecognitionMultiStreamTest();
+                break;
+            case 17:
+                if (HasSpeechRecognitionModel()) EmbeddedSpeechRecognitionBenchmark();
+                break;
+            case 18:
+                if (HasSpeechRecognitionModel()) EmbeddedSpeechRecognitionStartupTest();
+                break;
+            case 19:
+                if (HasSpeechRecognitionModel()) EmbeddedSpeechRecognitionWithRecognizerPool();
+                break;
+            case 20:
+                if (HasSpeechRecognitionModel()) EmbeddedSpeechRecognitionPushStreamLatencyTest();
+                break;
+            case 21:
+                if (HasSpeechRecognitionModel()) EmbeddedSpeechRecognitionRingBufferStressTest();
+                break;
             default:
                 break;
             }
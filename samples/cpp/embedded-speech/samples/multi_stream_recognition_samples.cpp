@@ -0,0 +1,457 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See https://aka.ms/csspeech/license for the full license information.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <speechapi_cxx.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+using namespace Microsoft::CognitiveServices::Speech;
+using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+extern shared_ptr<EmbeddedSpeechConfig> CreateEmbeddedSpeechConfig();
+
+extern uint32_t GetEmbeddedSpeechSamplesPerSecond();
+extern uint8_t GetEmbeddedSpeechBitsPerSample();
+extern uint8_t GetEmbeddedSpeechChannels();
+
+extern const string GetPerfTestAudioFileName();
+
+extern void PushStreamInputFromAudio(shared_ptr<PushAudioInputStream> pushStream, const vector<uint8_t>& audio, function<void(uint64_t)> onWrite);
+
+
+// Reads the audio samples of a WAV file, without headers, for writing into a push stream.
+// The file must be in the embedded speech input format (see settings.cpp).
+vector<uint8_t> ReadWavFileAudio(const string& fileName)
+{
+    ifstream input(fileName, ios::in | ios::binary);
+    if (!input.good())
+    {
+        throw invalid_argument("Failed to open input file " + fileName);
+    }
+
+    char riffHeader[12];
+    input.read(riffHeader, sizeof(riffHeader));
+    if (!input || memcmp(riffHeader, "RIFF", 4) != 0 || memcmp(riffHeader + 8, "WAVE", 4) != 0)
+    {
+        throw invalid_argument("Not a WAV file: " + fileName);
+    }
+
+    // A WAV file is a sequence of chunks. Check the format in the "fmt " chunk and return the samples in the "data" chunk.
+    bool hasFormat = false;
+    while (true)
+    {
+        char chunkHeader[8];
+        input.read(chunkHeader, sizeof(chunkHeader));
+        if (!input)
+        {
+            throw invalid_argument("No audio data found in " + fileName);
+        }
+        uint32_t chunkSize = uint8_t(chunkHeader[4]) | uint8_t(chunkHeader[5]) << 8 | uint8_t(chunkHeader[6]) << 16 | uint32_t(uint8_t(chunkHeader[7])) << 24;
+
+        if (memcmp(chunkHeader, "fmt ", 4) == 0)
+        {
+            vector<uint8_t> format(chunkSize);
+            input.read((char*)format.data(), chunkSize);
+            if (!input || chunkSize < 16)
+            {
+                throw invalid_argument("Invalid WAV format in " + fileName);
+            }
+            uint16_t formatTag = format[0] | format[1] << 8;
+            uint16_t channels = format[2] | format[3] << 8;
+            uint32_t samplesPerSecond = format[4] | format[5] << 8 | format[6] << 16 | uint32_t(format[7]) << 24;
+            uint16_t bitsPerSample = format[14] | format[15] << 8;
+            if (formatTag != 1 || channels != GetEmbeddedSpeechChannels() || samplesPerSecond != GetEmbeddedSpeechSamplesPerSecond() || bitsPerSample != GetEmbeddedSpeechBitsPerSample())
+            {
+                throw invalid_argument("Unsupported audio format in " + fileName + " (must be " + to_string(GetEmbeddedSpeechSamplesPerSecond()) + " Hz, 16-bit, mono PCM)");
+            }
+            hasFormat = true;
+        }
+        else if (memcmp(chunkHeader, "data", 4) == 0)
+        {
+            if (!hasFormat)
+            {
+                throw invalid_argument("Invalid WAV format in " + fileName);
+            }
+            vector<uint8_t> audio(chunkSize);
+            input.read((char*)audio.data(), chunkSize);
+            audio.resize((size_t)input.gcount());
+            return audio;
+        }
+        else
+        {
+            // Chunks are padded to an even size.
+            input.seekg(chunkSize + (chunkSize & 1), ios::cur);
+        }
+    }
+}
+
+
+// Gets the CPU time used by this process so far (all threads, user and kernel), in seconds.
+double GetProcessCpuSeconds()
+{
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+    {
+        return 0.0;
+    }
+    auto toSeconds = [](const FILETIME& time)
+    {
+        // FILETIME is in 100-nanosecond units.
+        return (double(time.dwHighDateTime) * 4294967296.0 + time.dwLowDateTime) / 1e7;
+    };
+    return toSeconds(kernelTime) + toSeconds(userTime);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0.0;
+    }
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+
+// Runs tasks on a fixed number of worker threads.
+// Event handlers of a recognizer are called on a Speech SDK thread, and while a handler runs, that recognizer
+// cannot deliver further events. Posting the handling of results to a pool keeps the handlers short.
+// At most 'capacity' tasks can wait in the queue. When it is full, Post() waits, so a burst of results slows
+// down the recognizers that produce them instead of using more and more memory.
+class BoundedThreadPool final
+{
+private:
+    mutex m_mutex;
+    condition_variable m_taskAdded;
+    condition_variable m_taskRemoved;
+    deque<function<void()>> m_tasks;
+    const size_t m_capacity;
+    bool m_stopping = false;
+    uint64_t m_waitedPosts = 0;
+    vector<thread> m_workers;
+
+    void Work()
+    {
+        while (true)
+        {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_taskAdded.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+                if (m_tasks.empty())
+                {
+                    return; // stopping, and all tasks are done
+                }
+                task = move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            m_taskRemoved.notify_one();
+
+            try
+            {
+                task();
+            }
+            catch (const exception& e)
+            {
+                cerr << "BoundedThreadPool: " << e.what() << endl;
+            }
+        }
+    }
+
+public:
+    BoundedThreadPool(size_t threadCount, size_t capacity) : m_capacity(capacity)
+    {
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            m_workers.emplace_back(&BoundedThreadPool::Work, this);
+        }
+    }
+
+    // Runs the tasks still in the queue, then stops the worker threads.
+    ~BoundedThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_taskAdded.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    void Post(function<void()> task)
+    {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            if (m_tasks.size() >= m_capacity)
+            {
+                m_waitedPosts++;
+                m_taskRemoved.wait(lock, [this] { return m_tasks.size() < m_capacity; });
+            }
+            m_tasks.push_back(move(task));
+        }
+        m_taskAdded.notify_one();
+    }
+
+    // Returns how many times Post() had to wait for room in the queue.
+    uint64_t WaitedPosts()
+    {
+        lock_guard<mutex> lock(m_mutex);
+        return m_waitedPosts;
+    }
+};
+
+
+// One audio stream of a multi-stream run: a push stream, the recognizer that reads it, and statistics.
+struct RecognitionStream
+{
+    shared_ptr<PushAudioInputStream> pushStream;
+    shared_ptr<SpeechRecognizer> recognizer;
+    promise<void> sessionStopped;
+    chrono::steady_clock::time_point startTime; // when the first audio was pushed
+    chrono::steady_clock::time_point stopTime;
+    atomic<int> results { 0 };
+    atomic<bool> failed { false };
+};
+
+
+// Summary of a multi-stream run.
+struct MultiStreamRunSummary
+{
+    vector<double> realTimeFactors; // per stream, processing time / audio duration
+    double wallSeconds = 0.0;
+    double cpuSeconds = 0.0;
+    int results = 0;
+    int failedStreams = 0;
+    uint64_t waitedPosts = 0;
+};
+
+
+// Recognizes 'streamCount' copies of 'audio' at the same time, each with its own recognizer and push stream.
+// All recognizers are created from the same speech config, so they share the loaded model.
+MultiStreamRunSummary RunConcurrentStreams(shared_ptr<EmbeddedSpeechConfig> speechConfig, const vector<uint8_t>& audio, size_t streamCount)
+{
+    // Few threads suffice for handling results, since the recognizers do the heavy work.
+    const size_t resultThreadCount = 2;
+    const size_t resultQueueCapacity = 256;
+    auto resultPool = make_unique<BoundedThreadPool>(resultThreadCount, resultQueueCapacity);
+    auto resultPoolPtr = resultPool.get();
+
+    auto audioFormat = AudioStreamFormat::GetWaveFormatPCM(GetEmbeddedSpeechSamplesPerSecond(), GetEmbeddedSpeechBitsPerSample(), GetEmbeddedSpeechChannels());
+
+    // Creates all recognizers first, so that construction time is not included in the measurement.
+    vector<unique_ptr<RecognitionStream>> streams;
+    for (size_t i = 0; i < streamCount; i++)
+    {
+        auto stream = make_unique<RecognitionStream>();
+        auto streamPtr = stream.get();
+        stream->pushStream = AudioInputStream::CreatePushStream(audioFormat);
+        stream->recognizer = SpeechRecognizer::FromConfig(speechConfig, AudioConfig::FromStreamInput(stream->pushStream));
+
+        stream->recognizer->Recognized += [streamPtr, resultPoolPtr](const SpeechRecognitionEventArgs& e)
+        {
+            if (e.Result->Reason == ResultReason::RecognizedSpeech)
+            {
+                auto result = e.Result;
+                resultPoolPtr->Post([streamPtr, result]
+                    {
+                        // An application would forward the result here, e.g. to storage or a message queue.
+                        streamPtr->results++;
+                    });
+            }
+        };
+
+        stream->recognizer->Canceled += [streamPtr, i](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            if (e.Reason == CancellationReason::Error)
+            {
+                streamPtr->failed = true;
+                cerr << "Stream " << i << " CANCELED: ErrorCode=" << int(e.ErrorCode) << " ErrorDetails=" << e.ErrorDetails << endl;
+            }
+        };
+
+        stream->recognizer->SessionStopped += [streamPtr](const SessionEventArgs&)
+        {
+            streamPtr->stopTime = chrono::steady_clock::now();
+            streamPtr->sessionStopped.set_value();
+        };
+
+        streams.push_back(move(stream));
+    }
+
+    // Starts all recognizers before pushing any audio, so that a stream does not wait for the others to start
+    // and its real-time factor is measured from its own start time.
+    for (auto& stream : streams)
+    {
+        stream->recognizer->StartContinuousRecognitionAsync().get();
+    }
+
+    auto cpuStart = GetProcessCpuSeconds();
+    auto startTime = chrono::steady_clock::now();
+
+    vector<thread> pushThreads;
+    try
+    {
+        for (auto& stream : streams)
+        {
+            // Pushes the audio as fast as the recognizer accepts it, so the run measures throughput.
+            auto pushStream = stream->pushStream;
+            stream->startTime = chrono::steady_clock::now();
+            pushThreads.emplace_back([pushStream, &audio] { PushStreamInputFromAudio(pushStream, audio, nullptr); });
+        }
+    }
+    catch (...)
+    {
+        // The threads that were started push all of their audio and exit, so they can be joined.
+        for (auto& pushThread : pushThreads)
+        {
+            pushThread.join();
+        }
+        throw;
+    }
+
+    for (auto& stream : streams)
+    {
+        stream->sessionStopped.get_future().get();
+    }
+    auto wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    auto cpuSeconds = GetProcessCpuSeconds() - cpuStart;
+
+    for (auto& pushThread : pushThreads)
+    {
+        pushThread.join();
+    }
+    for (auto& stream : streams)
+    {
+        stream->recognizer->StopContinuousRecognitionAsync().get();
+    }
+
+    MultiStreamRunSummary summary;
+    summary.waitedPosts = resultPool->WaitedPosts();
+    summary.wallSeconds = wallSeconds;
+    summary.cpuSeconds = cpuSeconds;
+
+    double audioSeconds = double(audio.size()) / (GetEmbeddedSpeechSamplesPerSecond() * GetEmbeddedSpeechBitsPerSample() / 8 * GetEmbeddedSpeechChannels());
+    for (auto& stream : streams)
+    {
+        summary.realTimeFactors.push_back(chrono::duration<double>(stream->stopTime - stream->startTime).count() / audioSeconds);
+        summary.failedStreams += stream->failed ? 1 : 0;
+    }
+
+    // Handles the results still in the queue before reading the counts.
+    resultPool.reset();
+    for (auto& stream : streams)
+    {
+        summary.results += stream->results;
+    }
+    return summary;
+}
+
+
+// Measures how embedded speech recognition scales with the number of concurrent audio streams, e.g. to size hardware
+// for transcribing several channels at once on one device.
+// Runs 1, 2, 4, ... streams up to a given maximum and reports for each run:
+// - the real-time factor (RTF) of each stream, i.e. processing time / audio duration. If the RTF of every stream
+//   stays below 1, the device can transcribe that many live channels.
+// - the aggregate throughput in seconds of audio per second, and divided by the number of CPU cores,
+//   the number of live channels each core can handle.
+void EmbeddedSpeechRecognitionMultiStreamTest()
+{
+    cout << "Maximum number of concurrent streams (default 8): ";
+    cout.flush();
+    string input;
+    getline(cin, input);
+    size_t maxStreams = 8;
+    if (!input.empty())
+    {
+        istringstream iss(input);
+        iss >> maxStreams;
+        if (!iss || maxStreams < 1)
+        {
+            cerr << "## ERROR: Invalid number of streams.\n";
+            return;
+        }
+    }
+
+    auto speechConfig = CreateEmbeddedSpeechConfig();
+    if (!speechConfig)
+    {
+        return;
+    }
+    auto audio = ReadWavFileAudio(GetPerfTestAudioFileName());
+    double audioSeconds = double(audio.size()) / (GetEmbeddedSpeechSamplesPerSecond() * GetEmbeddedSpeechBitsPerSample() / 8 * GetEmbeddedSpeechChannels());
+    auto cores = max(1u, thread::hardware_concurrency());
+
+    cout << "Audio: " << GetPerfTestAudioFileName() << " (" << fixed << setprecision(1) << audioSeconds << " s per stream), CPU cores: " << cores << endl;
+
+    vector<size_t> streamCounts;
+    for (size_t count = 1; count < maxStreams; count *= 2)
+    {
+        streamCounts.push_back(count);
+    }
+    streamCounts.push_back(maxStreams);
+
+    double previousThroughput = 0.0;
+    size_t liveCapacity = 0;
+    for (auto streamCount : streamCounts)
+    {
+        cout << "\nRunning " << streamCount << " concurrent stream(s), please wait...\n";
+        auto summary = RunConcurrentStreams(speechConfig, audio, streamCount);
+
+        const auto& rtf = summary.realTimeFactors;
+        double meanRtf = 0.0;
+        for (auto value : rtf)
+        {
+            meanRtf += value / rtf.size();
+        }
+        double maxRtf = *max_element(rtf.begin(), rtf.end());
+        double throughput = audioSeconds * streamCount / summary.wallSeconds;
+
+        cout << setprecision(3);
+        cout << "  RTF per stream:     ";
+        for (auto value : rtf)
+        {
+            cout << value << " ";
+        }
+        cout << "\n  RTF mean / max:     " << meanRtf << " / " << maxRtf << "\n";
+        cout << "  Throughput:         " << throughput << " s of audio per s (" << throughput / cores << " channels per core)\n";
+        cout << "  CPU utilization:    " << setprecision(1) << 100.0 * summary.cpuSeconds / (summary.wallSeconds * cores) << "%\n";
+        cout << "  Final results:      " << summary.results << ", failed streams: " << summary.failedStreams
+             << ", result queue full: " << summary.waitedPosts << " times\n";
+
+        if (summary.failedStreams == 0 && maxRtf < 1.0)
+        {
+            liveCapacity = streamCount;
+        }
+        if (previousThroughput > 0.0 && throughput < previousThroughput * 1.1)
+        {
+            cout << "  NOTE: Throughput grew less than 10% from the previous run. Concurrency has stopped scaling.\n";
+        }
+        previousThroughput = throughput;
+    }
+
+    cout << "\nAll done! The device kept up with live audio on up to " << liveCapacity << " concurrent stream(s) tested.\n";
+    cout << defaultfloat << setprecision(6);
+}
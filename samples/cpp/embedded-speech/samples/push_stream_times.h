@@ -0,0 +1,45 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See https://aka.ms/csspeech/license for the full license information.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Records when audio was written into a push stream, so that the latency of a
+// result can be measured from when its audio was available to when it arrived.
+class PushStreamTimes final
+{
+private:
+    mutable std::mutex m_mutex;
+    std::vector<std::pair<uint64_t, std::chrono::steady_clock::time_point>> m_chunks; // end offset in bytes, write time
+
+public:
+    // Records that audio up to byte 'endOffset' was written at 'time'.
+    void Add(uint64_t endOffset, std::chrono::steady_clock::time_point time)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_chunks.emplace_back(endOffset, time);
+    }
+
+    // Gets when the audio just before byte 'offset' was written.
+    // Returns false if no audio has been written.
+    bool Find(uint64_t offset, std::chrono::steady_clock::time_point& time) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_chunks.empty())
+        {
+            return false;
+        }
+        auto chunk = std::upper_bound(m_chunks.begin(), m_chunks.end(), offset > 0 ? offset - 1 : 0,
+            [](uint64_t value, const std::pair<uint64_t, std::chrono::steady_clock::time_point>& item) { return value < item.first; });
+        time = chunk != m_chunks.end() ? chunk->second : m_chunks.back().second;
+        return true;
+    }
+};
@@ -0,0 +1,382 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See https://aka.ms/csspeech/license for the full license information.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <speechapi_cxx.h>
+
+using namespace std;
+using namespace Microsoft::CognitiveServices::Speech;
+using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+extern shared_ptr<EmbeddedSpeechConfig> CreateEmbeddedSpeechConfig();
+extern shared_ptr<HybridSpeechConfig> CreateHybridSpeechConfig();
+
+extern uint32_t GetEmbeddedSpeechSamplesPerSecond();
+extern uint8_t GetEmbeddedSpeechBitsPerSample();
+extern uint8_t GetEmbeddedSpeechChannels();
+
+extern const string GetSpeechWavAudioFileName();
+
+extern vector<uint8_t> ReadWavFileAudio(const string& fileName);
+extern void PushStreamInputFromAudio(shared_ptr<PushAudioInputStream> pushStream, const vector<uint8_t>& audio, function<void(uint64_t)> onWrite);
+extern string Prompt(const string& question, const string& defaultValue);
+
+
+// A recognizer that is ready to start, with the push stream that it reads audio from.
+// The Speech SDK binds the audio input to a recognizer when the recognizer is created,
+// so each one comes with a stream of its own and serves a single session.
+struct PooledRecognizer
+{
+    shared_ptr<PushAudioInputStream> pushStream;
+    shared_ptr<SpeechRecognizer> recognizer;
+};
+
+
+// Counters of a recognizer pool.
+struct RecognizerPoolMetrics
+{
+    uint64_t hits = 0;      // Acquire() calls that got a ready recognizer
+    uint64_t misses = 0;    // Acquire() calls that had to create a recognizer
+    uint64_t created = 0;   // recognizers created in the background
+    double averageCreateMilliseconds = 0.0;
+    size_t ready = 0;       // recognizers ready now
+};
+
+
+// Keeps a number of recognizers created ahead of time, so that creating one is
+// not on the path between a user action (e.g. push-to-talk) and recognition.
+// A background thread creates a replacement for each recognizer handed out,
+// and releases the recognizers handed back, which can also take a while.
+class RecognizerPool final
+{
+public:
+    // Creates a recognizer with the given audio input. This can use any of the
+    // SpeechRecognizer::FromConfig() overloads, i.e. embedded, hybrid or cloud.
+    using Factory = function<shared_ptr<SpeechRecognizer>(shared_ptr<AudioConfig>)>;
+
+    RecognizerPool(Factory factory, shared_ptr<AudioStreamFormat> format, size_t size)
+        : m_factory(move(factory)), m_format(move(format)), m_size(size)
+    {
+        m_thread = thread(&RecognizerPool::Replenish, this);
+    }
+
+    RecognizerPool(const RecognizerPool&) = delete;
+    RecognizerPool& operator=(const RecognizerPool&) = delete;
+
+    ~RecognizerPool()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+    }
+
+    // Returns a ready recognizer if there is one. Otherwise creates one on the calling thread.
+    // If 'hit' is given, it is set to whether the recognizer was ready.
+    unique_ptr<PooledRecognizer> Acquire(bool* hit = nullptr)
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if (hit)
+            {
+                *hit = !m_ready.empty();
+            }
+            if (!m_ready.empty())
+            {
+                auto pooled = move(m_ready.front());
+                m_ready.pop_front();
+                m_hits++;
+                m_changed.notify_all();
+                return pooled;
+            }
+            m_misses++;
+        }
+        return Create();
+    }
+
+    // Hands back a recognizer after its session has stopped and
+    // StopContinuousRecognitionAsync() has completed.
+    // The recognizer is released in the background.
+    void Release(unique_ptr<PooledRecognizer> pooled)
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_retired.push_back(move(pooled));
+        }
+        m_changed.notify_all();
+    }
+
+    // Waits until all recognizers of the pool are ready, e.g. at application startup.
+    void WaitUntilFull()
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_changed.wait(lock, [this] { return m_stopping || m_ready.size() >= m_size; });
+    }
+
+    RecognizerPoolMetrics GetMetrics()
+    {
+        lock_guard<mutex> lock(m_mutex);
+        RecognizerPoolMetrics metrics;
+        metrics.hits = m_hits;
+        metrics.misses = m_misses;
+        metrics.created = m_created;
+        metrics.averageCreateMilliseconds = m_created > 0 ? m_createMilliseconds / m_created : 0.0;
+        metrics.ready = m_ready.size();
+        return metrics;
+    }
+
+private:
+    unique_ptr<PooledRecognizer> Create()
+    {
+        auto pooled = make_unique<PooledRecognizer>();
+        pooled->pushStream = AudioInputStream::CreatePushStream(m_format);
+        pooled->recognizer = m_factory(AudioConfig::FromStreamInput(pooled->pushStream));
+        return pooled;
+    }
+
+    void Replenish()
+    {
+        unique_lock<mutex> lock(m_mutex);
+        while (true)
+        {
+            m_changed.wait(lock, [this] { return m_stopping || !m_retired.empty() || m_ready.size() < m_size; });
+            if (m_stopping)
+            {
+                return;
+            }
+
+            // Releases used recognizers first, so that their resources are free for new ones.
+            if (!m_retired.empty())
+            {
+                auto retired = move(m_retired);
+                m_retired.clear();
+                lock.unlock();
+                retired.clear();
+                lock.lock();
+                continue;
+            }
+
+            lock.unlock();
+            auto start = chrono::steady_clock::now();
+            unique_ptr<PooledRecognizer> pooled;
+            try
+            {
+                pooled = Create();
+            }
+            catch (const exception& e)
+            {
+                cerr << "RecognizerPool: " << e.what() << endl;
+            }
+            auto milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            lock.lock();
+
+            if (!pooled)
+            {
+                // Retries later, in case the failure was temporary.
+                m_changed.wait_for(lock, chrono::seconds(1), [this] { return m_stopping; });
+                continue;
+            }
+            m_created++;
+            m_createMilliseconds += milliseconds;
+            m_ready.push_back(move(pooled));
+            m_changed.notify_all();
+        }
+    }
+
+    const Factory m_factory;
+    const shared_ptr<AudioStreamFormat> m_format;
+    const size_t m_size;
+
+    mutex m_mutex;
+    condition_variable m_changed;
+    deque<unique_ptr<PooledRecognizer>> m_ready;
+    vector<unique_ptr<PooledRecognizer>> m_retired;
+    bool m_stopping = false;
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_created = 0;
+    double m_createMilliseconds = 0.0;
+    thread m_thread;
+};
+
+
+// Latency of one simulated push-to-talk request.
+struct RequestTimes
+{
+    double readyMilliseconds = 0.0;       // from the request to recognition started
+    double firstResultMilliseconds = 0.0; // from the request to the first (intermediate) result
+    string text;
+};
+
+// Recognizes 'audio' with 'recognizer', which reads from 'pushStream'.
+// 'requested' is when the user asked for recognition.
+static RequestTimes RecognizeRequest(shared_ptr<SpeechRecognizer> recognizer, shared_ptr<PushAudioInputStream> pushStream,
+    const vector<uint8_t>& audio, chrono::steady_clock::time_point requested)
+{
+    RequestTimes times;
+    promise<void> firstResult;
+    promise<void> sessionStopped;
+    atomic<bool> hasFirstResult(false);
+
+    auto signalFirstResult = [&firstResult, &hasFirstResult]()
+    {
+        if (!hasFirstResult.exchange(true))
+        {
+            firstResult.set_value();
+        }
+    };
+
+    recognizer->Recognizing += [&signalFirstResult](const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason == ResultReason::RecognizingSpeech)
+        {
+            signalFirstResult();
+        }
+    };
+    recognizer->Recognized += [&signalFirstResult, &times](const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason == ResultReason::RecognizedSpeech)
+        {
+            signalFirstResult();
+            times.text += (times.text.empty() ? "" : " ") + e.Result->Text;
+        }
+    };
+    recognizer->Canceled += [](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        if (e.Reason == CancellationReason::Error)
+        {
+            cerr << "CANCELED: ErrorCode=" << int(e.ErrorCode) << " ErrorDetails=" << e.ErrorDetails << endl;
+        }
+    };
+    recognizer->SessionStopped += [&sessionStopped, &signalFirstResult](const SessionEventArgs&)
+    {
+        signalFirstResult();
+        sessionStopped.set_value();
+    };
+
+    recognizer->StartContinuousRecognitionAsync().get();
+    times.readyMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - requested).count();
+
+    // An application would write audio from the microphone as the user speaks.
+    PushStreamInputFromAudio(pushStream, audio, nullptr);
+
+    firstResult.get_future().get();
+    times.firstResultMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - requested).count();
+    sessionStopped.get_future().get();
+    recognizer->StopContinuousRecognitionAsync().get();
+
+    // The handlers refer to local variables of this function.
+    recognizer->Recognizing.DisconnectAll();
+    recognizer->Recognized.DisconnectAll();
+    recognizer->Canceled.DisconnectAll();
+    recognizer->SessionStopped.DisconnectAll();
+    return times;
+}
+
+
+// Simulates push-to-talk requests, first creating a recognizer for each request,
+// then taking recognizers from a pool, and compares the latency.
+void EmbeddedSpeechRecognitionWithRecognizerPool()
+{
+    int poolSize = 0;
+    int requestCount = 0;
+    int pauseMilliseconds = 0;
+    istringstream(Prompt("Pool size", "2")) >> poolSize;
+    istringstream(Prompt("Requests", "5")) >> requestCount;
+    istringstream(Prompt("Pause between requests in milliseconds", "1000")) >> pauseMilliseconds;
+    auto configType = Prompt("Speech config, embedded or hybrid", "embedded");
+    if (poolSize < 1 || requestCount < 1 || pauseMilliseconds < 0)
+    {
+        throw invalid_argument("Invalid pool size, number of requests or pause.");
+    }
+
+    // Creating the config is not part of the request latency, so it is done once.
+    RecognizerPool::Factory factory;
+    if (configType == "embedded")
+    {
+        auto speechConfig = CreateEmbeddedSpeechConfig();
+        factory = [speechConfig](shared_ptr<AudioConfig> audioConfig) { return SpeechRecognizer::FromConfig(speechConfig, audioConfig); };
+    }
+    else if (configType == "hybrid")
+    {
+        auto speechConfig = CreateHybridSpeechConfig();
+        factory = [speechConfig](shared_ptr<AudioConfig> audioConfig) { return SpeechRecognizer::FromConfig(speechConfig, audioConfig); };
+    }
+    else
+    {
+        throw invalid_argument("Unknown speech config type " + configType + ".");
+    }
+
+    auto audio = ReadWavFileAudio(GetSpeechWavAudioFileName());
+    auto audioFormat = AudioStreamFormat::GetWaveFormatPCM(GetEmbeddedSpeechSamplesPerSecond(), GetEmbeddedSpeechBitsPerSample(), GetEmbeddedSpeechChannels());
+
+    auto printHeader = []()
+    {
+        cout << setw(8) << "Request" << setw(8) << "Pool" << setw(12) << "Ready ms" << setw(18) << "First result ms" << "  Text\n";
+    };
+    auto printRequest = [](int request, const string& pool, const RequestTimes& times)
+    {
+        cout << setw(8) << request << setw(8) << pool << fixed << setprecision(1)
+             << setw(12) << times.readyMilliseconds << setw(18) << times.firstResultMilliseconds << "  " << times.text << endl;
+    };
+
+    cout << "\nWithout a pool, a recognizer is created for each request.\n";
+    printHeader();
+    double withoutPoolMilliseconds = 0.0;
+    for (int i = 0; i < requestCount; i++)
+    {
+        this_thread::sleep_for(chrono::milliseconds(pauseMilliseconds));
+        auto requested = chrono::steady_clock::now();
+        auto pushStream = AudioInputStream::CreatePushStream(audioFormat);
+        auto recognizer = factory(AudioConfig::FromStreamInput(pushStream));
+        auto times = RecognizeRequest(recognizer, pushStream, audio, requested);
+        withoutPoolMilliseconds += times.readyMilliseconds;
+        printRequest(i + 1, "-", times);
+    }
+
+    cout << "\nWith a pool of " << poolSize << " recognizers.\n";
+    RecognizerPool pool(factory, audioFormat, static_cast<size_t>(poolSize));
+    // An application would create the pool at startup, while the user is not waiting yet.
+    pool.WaitUntilFull();
+    printHeader();
+    double withPoolMilliseconds = 0.0;
+    for (int i = 0; i < requestCount; i++)
+    {
+        this_thread::sleep_for(chrono::milliseconds(pauseMilliseconds));
+        auto requested = chrono::steady_clock::now();
+        bool hit = false;
+        auto pooled = pool.Acquire(&hit);
+        auto times = RecognizeRequest(pooled->recognizer, pooled->pushStream, audio, requested);
+        pool.Release(move(pooled));
+        withPoolMilliseconds += times.readyMilliseconds;
+        printRequest(i + 1, hit ? "hit" : "miss", times);
+    }
+
+    auto metrics = pool.GetMetrics();
+    cout << fixed << setprecision(1)
+         << "\nAverage time from request to recognition started:\n"
+         << "  without pool " << withoutPoolMilliseconds / requestCount << " ms\n"
+         << "  with pool    " << withPoolMilliseconds / requestCount << " ms\n"
+         << "Pool hits " << metrics.hits << ", misses " << metrics.misses
+         << ", recognizers created in the background " << metrics.created
+         << " (average " << metrics.averageCreateMilliseconds << " ms), ready now " << metrics.ready << endl;
+    if (metrics.misses > 0)
+    {
+        cout << "Requests came faster than the pool was replenished. Consider a larger pool.\n";
+    }
+}
@@ -3,10 +3,18 @@
 // Licensed under the MIT license. See https://aka.ms/csspeech/license for the full license information.
 //
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
 #include <thread>
 #include <speechapi_cxx.h>
 #include <nlohmann/json.hpp>
+#include "push_stream_times.h"
 
 using namespace std;
 using namespace Microsoft::CognitiveServices::Speech;
@@ -258,11 +266,88 @@ void RecognizeSpeech(shared_ptr<SpeechRecognizer> recognizer, bool useKeyword, b
 }
 
 
+// Options for writing audio into a push stream.
+struct PushStreamInputOptions
+{
+    // Bytes per write. 3200 bytes is 100ms of 16kHz 16-bit mono audio.
+    size_t chunkSize = 3200;
+    // If true, each chunk is written when its audio would be available from a live
+    // source like a microphone, i.e. at the audio rate. If false, chunks are written
+    // as fast as the push stream accepts them, like when recognizing recorded audio.
+    bool paced = false;
+    // Maximum random delay of each write in paced mode, to simulate a live source with
+    // uneven timing (e.g. audio received over a network). Delays do not accumulate.
+    uint32_t jitterMilliseconds = 0;
+};
+
+
+// Writes chunks of audio into a push stream, paced as given by the options.
+// If 'onWrite' is given, it is called with the end offset of each chunk in bytes
+// just before the chunk is written.
+class PushStreamInputWriter final
+{
+private:
+    shared_ptr<PushAudioInputStream> m_pushStream;
+    const PushStreamInputOptions m_options;
+    const function<void(uint64_t)> m_onWrite;
+    const double m_bytesPerSecond;
+    mt19937 m_random;
+    uniform_int_distribution<uint32_t> m_jitter;
+    uint64_t m_bytesWritten = 0;
+    const chrono::steady_clock::time_point m_startTime;
+
+public:
+    PushStreamInputWriter(shared_ptr<PushAudioInputStream> pushStream, PushStreamInputOptions options, function<void(uint64_t)> onWrite) :
+        m_pushStream(pushStream),
+        m_options(options),
+        m_onWrite(onWrite),
+        m_bytesPerSecond(GetEmbeddedSpeechSamplesPerSecond() * GetEmbeddedSpeechBitsPerSample() / 8.0 * GetEmbeddedSpeechChannels()),
+        m_random(random_device{}()),
+        m_jitter(0, options.jitterMilliseconds),
+        m_startTime(chrono::steady_clock::now())
+    {
+        if (options.chunkSize == 0)
+        {
+            throw invalid_argument("Chunk size must not be 0.");
+        }
+    }
+
+    size_t ChunkSize() const
+    {
+        return m_options.chunkSize;
+    }
+
+    // Writes a chunk of at most ChunkSize() bytes.
+    void Write(uint8_t* data, size_t size)
+    {
+        if (m_options.paced)
+        {
+            // Waits until the last sample of the chunk would have been captured.
+            auto audioEnd = chrono::duration<double>((m_bytesWritten + size) / m_bytesPerSecond);
+            auto delay = chrono::milliseconds(m_jitter(m_random));
+            this_thread::sleep_until(m_startTime + chrono::duration_cast<chrono::steady_clock::duration>(audioEnd) + delay);
+        }
+
+        m_bytesWritten += size;
+        if (m_onWrite)
+        {
+            m_onWrite(m_bytesWritten);
+        }
+
+        // Copy audio data from the data buffer into a push stream
+        // for the Speech SDK to consume.
+        // Data must NOT include any headers, only audio samples.
+        m_pushStream->Write(data, (uint32_t)size);
+    }
+};
+
+
 // Reads audio samples from the source and writes them into a push stream.
 // Push stream can be used when input audio is not generated faster than it
 // can be processed (i.e. the generation of input is the limiting factor).
 // The application determines the rate of input data transfer.
-void PushStreamInputReader(shared_ptr<PushAudioInputStream> pushStream)
+// If 'times' is given, the time of each write is recorded in it.
+void PushStreamInputReader(shared_ptr<PushAudioInputStream> pushStream, PushStreamInputOptions options, shared_ptr<PushStreamTimes> times)
 {
     try
     {
@@ -275,7 +360,13 @@ void PushStreamInputReader(shared_ptr<PushAudioInputStream> pushStream)
             throw invalid_argument("Failed to open input file " + GetSpeechRawAudioFileName());
         }
 
-        vector<uint8_t> buffer(3200); // 100ms of 16kHz 16-bit mono audio
+        function<void(uint64_t)> onWrite;
+        if (times)
+        {
+            onWrite = [times](uint64_t endOffset) { times->Add(endOffset, chrono::steady_clock::now()); };
+        }
+        PushStreamInputWriter writer(pushStream, options, onWrite);
+        vector<uint8_t> buffer(writer.ChunkSize());
 
         while (true)
         {
@@ -283,10 +374,7 @@ void PushStreamInputReader(shared_ptr<PushAudioInputStream> pushStream)
             input.read((char*)buffer.data(), buffer.size());
             auto bytesRead = input.gcount();
 
-            // Copy audio data from the data buffer into a push stream
-            // for the Speech SDK to consume.
-            // Data must NOT include any headers, only audio samples.
-            pushStream->Write(buffer.data(), (uint32_t)bytesRead);
+            writer.Write(buffer.data(), (size_t)bytesRead);
 
             if (!input)
             {
@@ -304,6 +392,33 @@ void PushStreamInputReader(shared_ptr<PushAudioInputStream> pushStream)
 }
 
 
+// Writes audio samples that are already in memory, e.g. read with ReadWavFileAudio,
+// into a push stream in 100ms chunks as fast as it accepts them, then closes the stream.
+// If 'onWrite' is given, it is called with the end offset of each chunk in bytes
+// just before the chunk is written, e.g. to measure latency from that time.
+void PushStreamInputFromAudio(shared_ptr<PushAudioInputStream> pushStream, const vector<uint8_t>& audio, function<void(uint64_t)> onWrite)
+{
+    try
+    {
+        PushStreamInputWriter writer(pushStream, PushStreamInputOptions(), onWrite);
+        // Write() takes a non-const buffer, so each chunk is copied.
+        vector<uint8_t> buffer(writer.ChunkSize());
+        for (size_t offset = 0; offset < audio.size(); offset += buffer.size())
+        {
+            auto size = min(buffer.size(), audio.size() - offset);
+            memcpy(buffer.data(), audio.data() + offset, size);
+            writer.Write(buffer.data(), size);
+        }
+    }
+    catch (const exception& e)
+    {
+        cerr << "PushStreamInputFromAudio: " << e.what() << endl;
+    }
+
+    pushStream->Close();
+}
+
+
 // Implements a pull stream callback that reads audio samples from the source.
 // Pull stream should be used when input audio may be generated faster than
 // it can be processed (i.e. the processing of input is the limiting factor).
@@ -408,7 +523,7 @@ void EmbeddedSpeechRecognitionFromPushStream()
     auto audioConfig = AudioConfig::FromStreamInput(pushStream);
 
     // Push data into the stream in another thread.
-    auto pushStreamThread = thread(PushStreamInputReader, pushStream);
+    auto pushStreamThread = thread(PushStreamInputReader, pushStream, PushStreamInputOptions(), nullptr);
 
     auto recognizer = SpeechRecognizer::FromConfig(speechConfig, audioConfig);
     RecognizeSpeech(recognizer, useKeyword, waitForUser);
@@ -513,3 +628,109 @@ void EmbeddedSpeechRecognitionPerformanceTest()
     recognitionEnd.get_future().get();
     recognizer->StopContinuousRecognitionAsync().get();
 }
+
+
+// Recognizes speech from a push stream fed in real time (like a microphone)
+// and at maximum speed (like recorded audio), and compares the latency of final
+// results. The latency of a result is the time from writing the end of its audio
+// into the push stream to the arrival of the result.
+void EmbeddedSpeechRecognitionPushStreamLatencyTest()
+{
+    uint32_t chunkMilliseconds = 100;
+    uint32_t jitterMilliseconds = 20;
+    string input;
+    cout << "Chunk size in milliseconds of audio (default " << chunkMilliseconds << "): ";
+    cout.flush();
+    getline(cin, input);
+    if (!input.empty())
+    {
+        istringstream(input) >> chunkMilliseconds;
+    }
+    cout << "Maximum jitter in milliseconds in real-time mode (default " << jitterMilliseconds << "): ";
+    cout.flush();
+    getline(cin, input);
+    if (!input.empty())
+    {
+        istringstream(input) >> jitterMilliseconds;
+    }
+
+    const uint32_t bytesPerSample = GetEmbeddedSpeechBitsPerSample() / 8 * GetEmbeddedSpeechChannels();
+    PushStreamInputOptions options;
+    options.chunkSize = (size_t)GetEmbeddedSpeechSamplesPerSecond() * chunkMilliseconds / 1000 * bytesPerSample;
+    options.jitterMilliseconds = jitterMilliseconds;
+    if (options.chunkSize == 0)
+    {
+        throw invalid_argument("Chunk size must be at least 1 millisecond.");
+    }
+    const double bytesPerSecond = (double)GetEmbeddedSpeechSamplesPerSecond() * bytesPerSample;
+
+    auto speechConfig = CreateEmbeddedSpeechConfig();
+    auto audioFormat = AudioStreamFormat::GetWaveFormatPCM(GetEmbeddedSpeechSamplesPerSecond(), GetEmbeddedSpeechBitsPerSample(), GetEmbeddedSpeechChannels());
+
+    for (auto paced : { true, false })
+    {
+        options.paced = paced;
+        cout << "\n" << (paced ? "Real-time" : "Maximum speed") << " push stream input, "
+             << chunkMilliseconds << "ms chunks" << (paced ? ", up to " + to_string(jitterMilliseconds) + "ms jitter" : "") << endl;
+
+        auto pushStream = AudioInputStream::CreatePushStream(audioFormat);
+        auto recognizer = SpeechRecognizer::FromConfig(speechConfig, AudioConfig::FromStreamInput(pushStream));
+        auto times = make_shared<PushStreamTimes>();
+        vector<double> latencies;
+        promise<void> recognitionEnd;
+
+        recognizer->Recognized += [&latencies, times, bytesPerSecond](const SpeechRecognitionEventArgs& e)
+        {
+            auto arrival = chrono::steady_clock::now();
+            if (e.Result->Reason != ResultReason::RecognizedSpeech)
+            {
+                return;
+            }
+            // Offset and duration are in ticks of 100 nanoseconds.
+            auto endOffset = (uint64_t)((e.Result->Offset() + e.Result->Duration()) / 1e7 * bytesPerSecond);
+            chrono::steady_clock::time_point written;
+            if (times->Find(endOffset, written))
+            {
+                auto latency = chrono::duration<double, milli>(arrival - written).count();
+                latencies.push_back(latency);
+                cout << "RECOGNIZED: Latency=" << (int)latency << "ms Text=" << e.Result->Text << endl;
+            }
+        };
+
+        recognizer->Canceled += [](const SpeechRecognitionCanceledEventArgs& e)
+        {
+            if (e.Reason == CancellationReason::Error)
+            {
+                cerr << "CANCELED: ErrorCode=" << int(e.ErrorCode) << " ErrorDetails=" << e.ErrorDetails << endl;
+            }
+        };
+
+        recognizer->SessionStopped += [&recognitionEnd](const SessionEventArgs&)
+        {
+            recognitionEnd.set_value();
+        };
+
+        auto startTime = chrono::steady_clock::now();
+        recognizer->StartContinuousRecognitionAsync().get();
+        auto pushStreamThread = thread(PushStreamInputReader, pushStream, options, times);
+        recognitionEnd.get_future().get();
+        auto wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+        pushStreamThread.join();
+        recognizer->StopContinuousRecognitionAsync().get();
+
+        if (latencies.empty())
+        {
+            cout << "No results.\n";
+            continue;
+        }
+        auto total = 0.0;
+        for (auto latency : latencies)
+        {
+            total += latency;
+        }
+        cout << "Results: " << latencies.size()
+             << ", latency average " << (int)(total / latencies.size()) << "ms"
+             << ", max " << (int)*max_element(latencies.begin(), latencies.end()) << "ms"
+             << ", elapsed time " << (int)(wallSeconds * 1000) << "ms\n";
+    }
+}
@@ -0,0 +1,442 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See https://aka.ms/csspeech/license for the full license information.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <speechapi_cxx.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace Microsoft::CognitiveServices::Speech;
+using namespace Microsoft::CognitiveServices::Speech::Audio;
+
+extern shared_ptr<EmbeddedSpeechConfig> CreateEmbeddedSpeechConfig();
+extern vector<string> GetEmbeddedSpeechModelPaths();
+extern bool IsEmbeddedSpeechModelPrefetchEnabled();
+
+extern const string GetSpeechWavAudioFileName();
+
+
+// Number of files that the model prefetcher reads at the same time.
+// Flash storage (eMMC, SD cards, SSDs) serves several concurrent reads faster than one at a time.
+const size_t ModelPrefetchThreadCount = 4;
+
+struct ModelFile
+{
+    string path;
+    uint64_t size;
+};
+
+// Adds the files in a model or voice folder and its subfolders to the list.
+static void ListModelFiles(const string& path, vector<ModelFile>& files)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    auto find = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    do
+    {
+        string name = data.cFileName;
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+        auto fullPath = path + "\\" + name;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            ListModelFiles(fullPath, files);
+        }
+        else
+        {
+            files.push_back({ fullPath, (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow });
+        }
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0)
+    {
+        return;
+    }
+    if (S_ISREG(status.st_mode))
+    {
+        files.push_back({ path, static_cast<uint64_t>(status.st_size) });
+        return;
+    }
+    if (!S_ISDIR(status.st_mode))
+    {
+        return;
+    }
+    auto dir = opendir(path.c_str());
+    if (dir == nullptr)
+    {
+        return;
+    }
+    while (auto entry = readdir(dir))
+    {
+        string name = entry->d_name;
+        if (name != "." && name != "..")
+        {
+            ListModelFiles(path + "/" + name, files);
+        }
+    }
+    closedir(dir);
+#endif
+}
+
+// Reads a file through once so that its content is in the file cache.
+// Returns the number of bytes read.
+static uint64_t PrefetchFile(const string& path, vector<char>& buffer, const atomic<bool>& stopping)
+{
+#ifdef __linux__
+    // Lets the kernel queue read-ahead for the whole file at once, instead of
+    // one read-ahead window at a time as the reads below progress.
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+#endif
+    ifstream file(path, ios::binary);
+    uint64_t bytes = 0;
+    while (!stopping && (file.read(buffer.data(), buffer.size()) || file.gcount() > 0))
+    {
+        bytes += static_cast<uint64_t>(file.gcount());
+    }
+    return bytes;
+}
+
+// Removes the files in model and voice folders from the file cache, so that
+// the next load reads them from storage like the first one after a reboot.
+// Pages that a running process has mapped stay cached.
+// Returns false if this is not supported on the platform.
+static bool EvictModelFiles(const vector<string>& paths)
+{
+#ifdef __linux__
+    vector<ModelFile> files;
+    for (const auto& path : paths)
+    {
+        ListModelFiles(path, files);
+    }
+    for (const auto& file : files)
+    {
+        auto fd = open(file.path.c_str(), O_RDONLY);
+        if (fd >= 0)
+        {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+    return true;
+#else
+    (void)paths;
+    return false;
+#endif
+}
+
+
+// Reads embedded speech model and voice files into the operating system file
+// cache in the background, so that a recognizer or synthesizer created later
+// loads them from memory. The files are read by several threads at once, which
+// is faster on flash storage than the mostly sequential reads of model loading.
+// This only helps if the device has enough free memory to keep the files cached.
+class ModelPrefetcher final
+{
+public:
+    ModelPrefetcher(vector<string> paths, size_t threadCount)
+        : m_start(chrono::steady_clock::now()), m_doneFuture(m_done.get_future())
+    {
+        m_thread = thread(&ModelPrefetcher::Run, this, move(paths), max<size_t>(threadCount, 1));
+    }
+
+    ModelPrefetcher(const ModelPrefetcher&) = delete;
+    ModelPrefetcher& operator=(const ModelPrefetcher&) = delete;
+
+    // Stops reading if not done yet.
+    ~ModelPrefetcher()
+    {
+        m_stopping = true;
+        m_thread.join();
+    }
+
+    // Waits until all files have been read.
+    void Wait() const
+    {
+        m_doneFuture.wait();
+    }
+
+    // These are valid after Wait() returns.
+    size_t FileCount() const { return m_fileCount; }
+    uint64_t ByteCount() const { return m_byteCount; }
+    double Seconds() const { return m_seconds; }
+
+private:
+    void Run(vector<string> paths, size_t threadCount)
+    {
+        vector<ModelFile> files;
+        for (const auto& path : paths)
+        {
+            ListModelFiles(path, files);
+        }
+        // Starts with the largest files so that the threads finish at about the same time.
+        sort(files.begin(), files.end(), [](const ModelFile& a, const ModelFile& b) { return a.size > b.size; });
+        m_fileCount = files.size();
+
+        atomic<size_t> next(0);
+        vector<thread> readers;
+        for (size_t i = 0; i < min(threadCount, files.size()); i++)
+        {
+            readers.emplace_back([this, &files, &next]()
+            {
+                vector<char> buffer(1024 * 1024);
+                for (auto index = next++; index < files.size() && !m_stopping; index = next++)
+                {
+                    m_byteCount += PrefetchFile(files[index].path, buffer, m_stopping);
+                }
+            });
+        }
+        for (auto& reader : readers)
+        {
+            reader.join();
+        }
+
+        m_seconds = chrono::duration<double>(chrono::steady_clock::now() - m_start).count();
+        m_done.set_value();
+    }
+
+    chrono::steady_clock::time_point m_start;
+    atomic<bool> m_stopping{ false };
+    atomic<uint64_t> m_byteCount{ 0 };
+    size_t m_fileCount = 0;
+    double m_seconds = 0.0;
+    promise<void> m_done;
+    shared_future<void> m_doneFuture;
+    thread m_thread;
+};
+
+// Prefetcher started by StartEmbeddedSpeechModelPrefetch().
+// It is stopped when the application exits if not done by then.
+static unique_ptr<ModelPrefetcher> startupModelPrefetcher;
+
+// Starts prefetching embedded speech model and voice files in the background
+// if enabled in settings. Call this as early as possible at startup.
+void StartEmbeddedSpeechModelPrefetch()
+{
+    if (!IsEmbeddedSpeechModelPrefetchEnabled())
+    {
+        return;
+    }
+    auto paths = GetEmbeddedSpeechModelPaths();
+    if (paths.empty())
+    {
+        return;
+    }
+    startupModelPrefetcher.reset(new ModelPrefetcher(paths, ModelPrefetchThreadCount));
+    cout << "Prefetching embedded speech model files in the background.\n";
+}
+
+
+// Time spent in each phase from the start of the application to the first recognition result.
+struct StartupTimes
+{
+    double configMilliseconds = 0.0;      // CreateEmbeddedSpeechConfig()
+    double recognizerMilliseconds = 0.0;  // SpeechRecognizer::FromConfig()
+    double firstResultMilliseconds = 0.0; // from StartContinuousRecognitionAsync() to the first (intermediate) result
+    double totalMilliseconds = 0.0;
+    bool hasResult = false;
+};
+
+static double MillisecondsBetween(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+{
+    return chrono::duration<double, milli>(end - start).count();
+}
+
+// Creates a config and a recognizer, and recognizes the example WAV file until the first result.
+static StartupTimes MeasureStartup()
+{
+    // Declared before the recognizer so that they outlive its event handlers.
+    promise<bool> firstEvent;
+    atomic<bool> signaled(false);
+    auto signal = [&firstEvent, &signaled](bool hasResult)
+    {
+        if (!signaled.exchange(true))
+        {
+            firstEvent.set_value(hasResult);
+        }
+    };
+
+    StartupTimes times;
+    auto start = chrono::steady_clock::now();
+
+    auto speechConfig = CreateEmbeddedSpeechConfig();
+    if (!speechConfig)
+    {
+        throw invalid_argument("Cannot create an embedded speech config.");
+    }
+    auto configCreated = chrono::steady_clock::now();
+
+    auto audioConfig = AudioConfig::FromWavFileInput(GetSpeechWavAudioFileName());
+    auto recognizer = SpeechRecognizer::FromConfig(speechConfig, audioConfig);
+    auto recognizerCreated = chrono::steady_clock::now();
+
+    recognizer->Recognizing += [&signal](const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason == ResultReason::RecognizingSpeech)
+        {
+            signal(true);
+        }
+    };
+    recognizer->Recognized += [&signal](const SpeechRecognitionEventArgs& e)
+    {
+        if (e.Result->Reason == ResultReason::RecognizedSpeech)
+        {
+            signal(true);
+        }
+    };
+    recognizer->Canceled += [&signal](const SpeechRecognitionCanceledEventArgs& e)
+    {
+        if (e.Reason == CancellationReason::Error)
+        {
+            cerr << "CANCELED: ErrorCode=" << int(e.ErrorCode) << " ErrorDetails=" << e.ErrorDetails << endl;
+        }
+        signal(false);
+    };
+    recognizer->SessionStopped += [&signal](const SessionEventArgs&)
+    {
+        signal(false);
+    };
+
+    auto recognitionStarting = chrono::steady_clock::now();
+    recognizer->StartContinuousRecognitionAsync().get();
+    times.hasResult = firstEvent.get_future().get();
+    auto firstResult = chrono::steady_clock::now();
+    recognizer->StopContinuousRecognitionAsync().get();
+
+    times.configMilliseconds = MillisecondsBetween(start, configCreated);
+    times.recognizerMilliseconds = MillisecondsBetween(configCreated, recognizerCreated);
+    times.firstResultMilliseconds = MillisecondsBetween(recognitionStarting, firstResult);
+    times.totalMilliseconds = MillisecondsBetween(start, firstResult);
+    return times;
+}
+
+static double Median(vector<double> values)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    sort(values.begin(), values.end());
+    auto middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+
+// Measures the time from creating an embedded speech config to the first
+// recognition result, when the model files are read from storage (cold)
+// and when they are already in the file cache (warm).
+void EmbeddedSpeechRecognitionStartupTest()
+{
+    int iterations = 3;
+    cout << "Measurements per scenario (default " << iterations << "): ";
+    cout.flush();
+    string input;
+    getline(cin, input);
+    if (!input.empty())
+    {
+        istringstream(input) >> iterations;
+    }
+    if (iterations < 1)
+    {
+        throw invalid_argument("The number of measurements must be at least 1.");
+    }
+
+    // A prefetch started with the application would otherwise interfere with the cold start.
+    if (startupModelPrefetcher)
+    {
+        startupModelPrefetcher->Wait();
+    }
+
+    auto paths = GetEmbeddedSpeechModelPaths();
+    auto canEvict = EvictModelFiles(paths);
+    if (!canEvict)
+    {
+        cout << "\nModel files cannot be removed from the file cache on this platform.\n"
+             << "The first measurement is a cold start only if it is the first model load since the device restarted.\n";
+    }
+
+    cout << "\n" << left << setw(16) << "Scenario" << right
+         << setw(12) << "Config ms" << setw(16) << "Recognizer ms" << setw(18) << "First result ms" << setw(12) << "Total ms"
+         << "  Prefetch\n";
+
+    map<string, vector<double>> totals;
+    auto report = [&totals](const string& scenario, const StartupTimes& times, const string& note)
+    {
+        totals[scenario].push_back(times.totalMilliseconds);
+        cout << left << setw(16) << scenario << right << fixed << setprecision(1)
+             << setw(12) << times.configMilliseconds
+             << setw(16) << times.recognizerMilliseconds
+             << setw(18) << times.firstResultMilliseconds
+             << setw(12) << times.totalMilliseconds
+             << "  " << note << (times.hasResult ? "" : " (no result)") << endl;
+    };
+
+    for (int i = 0; i < iterations; i++)
+    {
+        if (canEvict)
+        {
+            EvictModelFiles(paths);
+            report("cold", MeasureStartup(), "");
+
+            // Starts the prefetch the way StartEmbeddedSpeechModelPrefetch() does,
+            // and lets it run in parallel with config and recognizer creation.
+            EvictModelFiles(paths);
+            ModelPrefetcher prefetcher(paths, ModelPrefetchThreadCount);
+            auto times = MeasureStartup();
+            prefetcher.Wait();
+            ostringstream note;
+            note << fixed << setprecision(1) << prefetcher.FileCount() << " files, "
+                 << prefetcher.ByteCount() / (1024.0 * 1024.0) << " MB in " << prefetcher.Seconds() * 1000 << " ms";
+            report("cold, prefetch", times, note.str());
+        }
+        else if (i == 0)
+        {
+            report("first", MeasureStartup(), "");
+        }
+
+        report("warm", MeasureStartup(), "");
+    }
+
+    cout << "\nMedian time to the first result:\n";
+    for (const auto& scenario : { "cold", "cold, prefetch", "first", "warm" })
+    {
+        auto found = totals.find(scenario);
+        if (found != totals.end())
+        {
+            cout << "  " << left << setw(16) << scenario << right << fixed << setprecision(1)
+                 << Median(found->second) << " ms\n";
+        }
+    }
+}
@@ -0,0 +1,227 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <set>
+#include <string>
+#include <vector>
+#include "rest_helper.h"
+#include "trace_helper.h"
+
+// Uploads local files to Azure Blob Storage (or a compatible server, such as Azurite or stand_in_service.py) as block
+// blobs, so they can be transcribed with batch transcription, which only accepts URLs.
+// The file is read one block at a time and each block is sent with Put Block, several at once. At most
+// maxBlocksInFlight blocks are held in memory, however large the file. Put Block List then commits the blocks.
+// See:
+// https://learn.microsoft.com/rest/api/storageservices/put-block
+// https://learn.microsoft.com/rest/api/storageservices/put-block-list
+class BlobUploader
+{
+public:
+    struct UploadResult
+    {
+        // The blob URL, with the shared access signature of the container URL if it had one.
+        std::string url;
+        uint64_t bytes;
+        size_t blocks;
+        double seconds;
+    };
+
+private:
+    static constexpr const char* storageVersion = "2021-08-06";
+    // Put Block List accepts at most this many blocks.
+    static const size_t maxBlocks = 50000;
+
+    const std::string m_certificatePath;
+    // The container URL without the query.
+    std::string m_containerUrl;
+    // The query of the container URL without "?", usually a shared access signature. Can be empty.
+    std::string m_query;
+    const size_t m_blockBytes;
+    const size_t m_maxBlocksInFlight;
+
+    static std::string Base64(const std::string& value)
+    {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string result;
+        size_t index = 0;
+        for (; index + 2 < value.size(); index += 3)
+        {
+            uint32_t bits = (static_cast<unsigned char>(value[index]) << 16) | (static_cast<unsigned char>(value[index + 1]) << 8) | static_cast<unsigned char>(value[index + 2]);
+            result.push_back(alphabet[(bits >> 18) & 0x3F]);
+            result.push_back(alphabet[(bits >> 12) & 0x3F]);
+            result.push_back(alphabet[(bits >> 6) & 0x3F]);
+            result.push_back(alphabet[bits & 0x3F]);
+        }
+        if (index < value.size())
+        {
+            uint32_t bits = static_cast<unsigned char>(value[index]) << 16;
+            if (index + 1 < value.size())
+            {
+                bits |= static_cast<unsigned char>(value[index + 1]) << 8;
+            }
+            result.push_back(alphabet[(bits >> 18) & 0x3F]);
+            result.push_back(alphabet[(bits >> 12) & 0x3F]);
+            result.push_back(index + 1 < value.size() ? alphabet[(bits >> 6) & 0x3F] : '=');
+            result.push_back('=');
+        }
+        return result;
+    }
+
+    // Percent-encode everything except unreserved characters, for use in a URL path segment or query value.
+    static std::string UrlEncode(const std::string& value)
+    {
+        static const char hex[] = "0123456789ABCDEF";
+        std::string result;
+        for (char c : value)
+        {
+            unsigned char byte = static_cast<unsigned char>(c);
+            if (std::isalnum(byte) || '-' == c || '_' == c || '.' == c || '~' == c)
+            {
+                result.push_back(c);
+            }
+            else
+            {
+                result.push_back('%');
+                result.push_back(hex[byte >> 4]);
+                result.push_back(hex[byte & 0x0F]);
+            }
+        }
+        return result;
+    }
+
+    // Block IDs must all have the same length within a blob, so pad the block number.
+    static std::string BlockId(size_t index)
+    {
+        std::string number = std::to_string(index);
+        return Base64(std::string(6 - number.size(), '0') + number);
+    }
+
+    static std::string ContentTypeOf(const std::filesystem::path& path)
+    {
+        std::string extension = StringHelper::ToLower(path.extension().string());
+        if (".wav" == extension)
+        {
+            return "audio/wav";
+        }
+        else if (".mp3" == extension)
+        {
+            return "audio/mpeg";
+        }
+        else if (".ogg" == extension || ".opus" == extension)
+        {
+            return "audio/ogg";
+        }
+        return "application/octet-stream";
+    }
+
+    // Return the URL of *blobName*, with *operation* (for example "comp=block") and the container query appended.
+    std::string BlobUrl(const std::string& blobName, const std::string& operation) const
+    {
+        std::string url = m_containerUrl + "/" + UrlEncode(blobName);
+        std::string query = operation;
+        if (!m_query.empty())
+        {
+            query += (query.empty() ? "" : "&") + m_query;
+        }
+        return query.empty() ? url : url + "?" + query;
+    }
+
+public:
+    // *containerUrl* is the URL of an existing container, with a shared access signature that allows writing and
+    // reading blobs, for example "https://account.blob.core.windows.net/calls?sv=...&sig=...".
+    BlobUploader(const std::string& certificatePath, const std::string& containerUrl, size_t blockBytes, size_t maxBlocksInFlight)
+        : m_certificatePath(certificatePath), m_blockBytes(blockBytes), m_maxBlocksInFlight(std::max<size_t>(1, maxBlocksInFlight))
+    {
+        size_t queryStart = containerUrl.find('?');
+        m_containerUrl = containerUrl.substr(0, queryStart);
+        if (std::string::npos != queryStart)
+        {
+            m_query = containerUrl.substr(queryStart + 1);
+        }
+        while (!m_containerUrl.empty() && '/' == m_containerUrl.back())
+        {
+            m_containerUrl.pop_back();
+        }
+    }
+
+    // Upload *filePath* to a blob with the same file name, replacing any existing blob.
+    UploadResult Upload(const std::string& filePath)
+    {
+        TraceSpan span("Upload", "upload");
+        auto start = std::chrono::steady_clock::now();
+        std::filesystem::path path { filePath };
+        std::ifstream input(path, std::ios::binary);
+        if (!input.good())
+        {
+            throw std::exception(std::string("Unable to open file to upload: " + filePath).c_str());
+        }
+        const std::string blobName = path.filename().string();
+        const std::vector<std::string> headers { std::string("x-ms-version: ") + storageVersion, "Content-Type: application/octet-stream" };
+
+        std::vector<std::string> blockIds;
+        std::deque<std::future<void>> inFlight;
+        uint64_t bytes = 0;
+        while (true)
+        {
+            // Wait for the oldest block before reading another, so memory stays bounded.
+            if (inFlight.size() >= m_maxBlocksInFlight)
+            {
+                inFlight.front().get();
+                inFlight.pop_front();
+            }
+            std::string block(m_blockBytes, '\0');
+            input.read(&block[0], static_cast<std::streamsize>(m_blockBytes));
+            size_t blockSize = static_cast<size_t>(input.gcount());
+            if (0 == blockSize)
+            {
+                break;
+            }
+            if (blockIds.size() == maxBlocks)
+            {
+                throw std::exception(std::string("The file is too large to upload in " + std::to_string(maxBlocks) + " blocks. Use a larger block size: " + filePath).c_str());
+            }
+            block.resize(blockSize);
+            bytes += blockSize;
+            std::string blockId = BlockId(blockIds.size());
+            std::string url = BlobUrl(blobName, "comp=block&blockid=" + UrlEncode(blockId));
+            blockIds.push_back(std::move(blockId));
+            inFlight.push_back(std::async(std::launch::async, [this, url = std::move(url), block = std::move(block), &headers]() mutable {
+                RestHelper::SendPut(m_certificatePath, url, std::move(block), headers, std::set<int> { HTTP_CREATED });
+            }));
+        }
+        while (!inFlight.empty())
+        {
+            inFlight.front().get();
+            inFlight.pop_front();
+        }
+
+        std::string blockList = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<BlockList>";
+        for (const auto& blockId : blockIds)
+        {
+            blockList += "<Latest>" + blockId + "</Latest>";
+        }
+        blockList += "</BlockList>";
+        const std::vector<std::string> commitHeaders {
+            std::string("x-ms-version: ") + storageVersion,
+            "Content-Type: application/xml",
+            "x-ms-blob-content-type: " + ContentTypeOf(path)
+        };
+        RestHelper::SendPut(m_certificatePath, BlobUrl(blobName, "comp=blocklist"), std::move(blockList), commitHeaders, std::set<int> { HTTP_CREATED });
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        span.AddArg("bytes", bytes);
+        span.AddArg("blocks", blockIds.size());
+        return UploadResult { BlobUrl(blobName, ""), bytes, blockIds.size(), seconds };
+    }
+};
@@ -4,10 +4,17 @@
 //
 
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <filesystem>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <sstream>
@@ -15,17 +22,29 @@
 #include <vector>
 // You can download json.hpp from:
 // https://github.com/nlohmann/json/releases
+#include "blob_uploader.h"
+#include "checkpoint_store.h"
 #include "json.hpp"
 #include "json_helper.h"
+#include "output_writer.h"
+#include "parquet_writer.h"
+#include "pipeline_stats.h"
+#include "real_time_transcriber.h"
+#include "response_cache.h"
 #include "rest_helper.h"
-#include "string_helper.h"
+#include "../common/string_helper.h"
+#include "trace_helper.h"
+#include "transcription_phrases.h"
+#include "transcription_reader.h"
 #include "user_config.h"
+#include "webhook_listener.h"
 
 class CallCenter
 {
 private:
     // This should not change unless you switch to a new version of the Speech REST API.
     const std::string speechTranscriptionPath = "/speechtotext/v3.0/transcriptions";
+    const std::string speechWebhookPath = "/speechtotext/v3.0/webhooks";
 
     // These should not change unless you switch to a new version of the Cognitive Language REST API.
     const std::string sentimentAnalysisPath = "/language/:analyze-text";
@@ -33,17 +52,98 @@ private:
     const std::string conversationAnalysisPath = "/language/analyze-conversations/jobs";
     const std::string conversationAnalysisQuery = "?api-version=2022-05-15-preview";
     const std::string conversationSummaryModelVersion = "2022-05-15-preview";
+    // We can only analyze sentiment for 10 documents per request.
+    static constexpr size_t sentimentBatchSize = 10;
+    // In real-time mode, send a sentiment request for fewer than sentimentBatchSize phrases once the oldest has waited this long.
+    const std::chrono::milliseconds realTimeBatchDelay = std::chrono::milliseconds(1000);
+    // How many conversation items from the end of one conversation analysis window to repeat at the start of the next.
+    static constexpr size_t conversationShardOverlap = 4;
 
-    // How long to wait while polling batch transcription and conversation analysis status.
-    const int waitSeconds = 10;
+    // A window of conversation items [begin, end), analyzed as one job. Items [begin, ownedBegin) overlap the previous window.
+    struct ConversationShard
+    {
+        size_t begin;
+        size_t ownedBegin;
+        size_t end;
+    };
 
     std::shared_ptr<UserConfig> m_userConfig = NULL;
+    // Serializes writes to the output file when several calls are processed at once.
+    std::mutex m_outputMutex;
+    // Null unless --cacheDirectory is present.
+    std::shared_ptr<ResponseCache> m_cache = NULL;
+    // Null unless --inputFile is present.
+    std::shared_ptr<BlobUploader> m_uploader = NULL;
+    // Null unless --webhookPort is present.
+    std::shared_ptr<WebhookListener> m_webhookListener = NULL;
+    // The URI of the web hook registered with the Speech service, or empty if there is none.
+    std::string m_webhookUri;
+    // Null unless --parquetOutput is present.
+    std::shared_ptr<ParquetWriter> m_phrasesParquet = NULL;
+    std::shared_ptr<ParquetWriter> m_piiParquet = NULL;
+
+    // Columns of phrases.parquet, in the order of phraseParquetSchema.
+    enum PhraseParquetColumn : size_t { PhraseCall, PhraseId, PhraseChannel, PhraseSpeaker, PhraseOffsetInTicks, PhraseDurationInTicks,
+        PhraseConfidence, PhraseText, PhraseItn, PhraseLexical, PhraseMaskedItn, PhraseSentiment, PhrasePositiveScore, PhraseNeutralScore, PhraseNegativeScore };
+    inline static const std::vector<ParquetWriter::Column> phraseParquetSchema {
+        { "call", ParquetWriter::ColumnType::String },
+        { "phrase", ParquetWriter::ColumnType::Int32 },
+        { "channel", ParquetWriter::ColumnType::Int32 },
+        { "speaker", ParquetWriter::ColumnType::Int32 },
+        { "offset_in_ticks", ParquetWriter::ColumnType::Int64 },
+        { "duration_in_ticks", ParquetWriter::ColumnType::Int64 },
+        { "confidence", ParquetWriter::ColumnType::Double },
+        { "text", ParquetWriter::ColumnType::String },
+        { "itn", ParquetWriter::ColumnType::String },
+        { "lexical", ParquetWriter::ColumnType::String },
+        { "masked_itn", ParquetWriter::ColumnType::String },
+        { "sentiment", ParquetWriter::ColumnType::String },
+        { "positive_score", ParquetWriter::ColumnType::Double },
+        { "neutral_score", ParquetWriter::ColumnType::Double },
+        { "negative_score", ParquetWriter::ColumnType::Double }
+    };
+    // Columns of pii_entities.parquet, in the order of piiParquetSchema.
+    enum PiiParquetColumn : size_t { PiiCall, PiiPhrase, PiiCategory, PiiText, PiiOffset, PiiLength, PiiConfidence };
+    inline static const std::vector<ParquetWriter::Column> piiParquetSchema {
+        { "call", ParquetWriter::ColumnType::String },
+        { "phrase", ParquetWriter::ColumnType::Int32 },
+        { "category", ParquetWriter::ColumnType::String },
+        { "text", ParquetWriter::ColumnType::String },
+        { "offset", ParquetWriter::ColumnType::Int32 },
+        { "length", ParquetWriter::ColumnType::Int32 },
+        { "confidence", ParquetWriter::ColumnType::Double }
+    };
+
+    // Progress messages are suppressed in benchmark mode.
+    bool Verbose() const
+    {
+        return !m_userConfig->benchmarkCalls.has_value();
+    }
     
 public:
     CallCenter(std::shared_ptr<UserConfig> userConfig)
         : m_userConfig(userConfig)
     {
         RestHelper::Initialize();
+
+        // Pace requests to each service at the rate its pricing tier allows, and retry throttled requests.
+        RateControlOptions rateControlOptions;
+        rateControlOptions.maxRetries = m_userConfig->maxRetries;
+        RestHelper::SetDefaultRateControl(rateControlOptions);
+        if (m_userConfig->speechEndpoint.has_value())
+        {
+            rateControlOptions.requestsPerSecond = m_userConfig->speechRequestsPerSecond;
+            rateControlOptions.burst = std::max(1, static_cast<int>(m_userConfig->speechRequestsPerSecond));
+            RestHelper::SetRateControl(m_userConfig->speechEndpoint.value(), rateControlOptions);
+        }
+        rateControlOptions.requestsPerSecond = m_userConfig->languageRequestsPerSecond;
+        rateControlOptions.burst = std::max(1, static_cast<int>(m_userConfig->languageRequestsPerSecond));
+        RestHelper::SetRateControl(m_userConfig->languageEndpoint, rateControlOptions);
+        if (m_userConfig->compressRequests)
+        {
+            // Sentiment and conversation analysis requests carry the whole transcript, so they are the ones that benefit.
+            RestHelper::SetCompressRequests(m_userConfig->languageEndpoint, true);
+        }
         
         if (m_userConfig->outputFilePath.has_value())
         {
@@ -56,14 +156,86 @@ public:
                 outputStream.close();            
             }
         }
+
+        if (m_userConfig->cacheDirectory.has_value())
+        {
+            m_cache = std::make_shared<ResponseCache>(m_userConfig->cacheDirectory.value(), static_cast<uintmax_t>(m_userConfig->cacheMaxMegabytes) * 1024 * 1024);
+        }
+        if (m_userConfig->uploadFilePath.has_value())
+        {
+            m_uploader = std::make_shared<BlobUploader>(m_userConfig->certificatePath, m_userConfig->blobContainerUrl.value(), m_userConfig->uploadBlockBytes, m_userConfig->uploadConcurrency);
+        }
+        if (m_userConfig->parquetDirectory.has_value())
+        {
+            std::filesystem::path parquetDirectory { m_userConfig->parquetDirectory.value() };
+            std::filesystem::create_directories(parquetDirectory);
+            m_phrasesParquet = std::make_shared<ParquetWriter>((parquetDirectory / "phrases.parquet").string(), phraseParquetSchema);
+            m_piiParquet = std::make_shared<ParquetWriter>((parquetDirectory / "pii_entities.parquet").string(), piiParquetSchema);
+        }
+        if (m_userConfig->webhookPort.has_value() && m_userConfig->speechEndpoint.has_value())
+        {
+            // Listen before registering, so the listener can answer the validation challenge.
+            m_webhookListener = std::make_shared<WebhookListener>(m_userConfig->webhookPort.value());
+            m_webhookUri = CreateWebhook(m_userConfig->webhookUrl.value_or("http://localhost:" + std::to_string(m_userConfig->webhookPort.value()) + "/"));
+        }
     }
 
     ~CallCenter()
     {
+        if (!m_webhookUri.empty())
+        {
+            try
+            {
+                DeleteWebhook(m_webhookUri);
+            }
+            catch (const std::exception& e)
+            {
+                std::cout << "Unable to delete web hook " << m_webhookUri << ": " << e.what() << std::endl;
+            }
+        }
+        if (m_phrasesParquet)
+        {
+            try
+            {
+                m_phrasesParquet->Close();
+                m_piiParquet->Close();
+            }
+            catch (const std::exception& e)
+            {
+                std::cout << e.what() << std::endl;
+            }
+        }
         RestHelper::Dispose();
     }
 
-    std::string CreateTranscription(std::string uriToTranscribe)
+    // Register *webUrl* to receive a callback whenever a transcription completes, and return the web hook URI.
+    std::string CreateWebhook(const std::string& webUrl)
+    {
+        // Create Hook REST API request and response JSON sample and schema:
+        // https://westus.dev.cognitive.microsoft.com/docs/services/speech-to-text-api-v3-0/operations/CreateHook
+        std::string uri = m_userConfig->speechEndpoint.value() + speechWebhookPath;
+        nlohmann::json content = {
+            {"webUrl", webUrl},
+            {"events", { {"transcriptionCompletion", true} } },
+            {"displayName", "call_center_transcription_completion"}
+        };
+        std::shared_ptr<RestResult> result = RestHelper::SendPost(m_userConfig->certificatePath, uri, content.dump(), m_userConfig->speechSubscriptionKey.value(), std::set<int> { HTTP_CREATED });
+        return result->json["self"];
+    }
+
+    void DeleteWebhook(const std::string& webhookUri)
+    {
+        RestHelper::SendDelete(m_userConfig->certificatePath, webhookUri, m_userConfig->speechSubscriptionKey.value(), std::set<int> { HTTP_NO_CONTENT });
+    }
+
+    // The number of web hook callbacks received so far.
+    size_t WebhookCallbackCount() const
+    {
+        return m_webhookListener ? m_webhookListener->CallbackCount() : 0;
+    }
+
+    // Create one transcription job for every recording in *urisToTranscribe*. The job has a result file for each one.
+    std::string CreateTranscription(const std::vector<std::string>& urisToTranscribe)
     {
         // Create Transcription REST API request and response JSON sample and schema:
         // https://westus.dev.cognitive.microsoft.com/docs/services/speech-to-text-api-v3-0/operations/CreateTranscription
@@ -72,8 +244,7 @@ public:
         // - diarizationEnabled should only be used with mono audio input.
         std::string uri = m_userConfig->speechEndpoint.value() + speechTranscriptionPath;
         nlohmann::json content = {
-            // Note the value is a single-item array.
-            {"contentUrls", {uriToTranscribe}},
+            {"contentUrls", urisToTranscribe},
             {"properties",
                 // Start object definition
                 {
@@ -91,7 +262,7 @@ public:
         // Verify the transcription ID is a valid GUID.
         if (!StringHelper::IsUUID(transcriptionId))
         {
-            throw std::exception(std::string("Unable to parse response from Create Transcription API. Response:\n" + result->text).c_str());
+            throw std::exception(std::string("Unable to parse response from Create Transcription API. Response:\n" + result->json.dump()).c_str());
         }
         return transcriptionId;
     }
@@ -104,7 +275,7 @@ public:
         std::shared_ptr<RestResult> result = RestHelper::SendGet(m_userConfig->certificatePath, uri, m_userConfig->speechSubscriptionKey.value(), std::set<int> { HTTP_OK });
         if (StringHelper::CaseInsensitiveCompare("failed", result->json["status"].get<std::string>()))
         {
-            throw std::exception(std::string("Unable to transcribe audio input. Response:\n" + result->text).c_str());
+            throw std::exception(std::string("Unable to transcribe audio input. Response:\n" + result->json.dump()).c_str());
         }
         else
         {
@@ -115,9 +286,32 @@ public:
     void WaitForTranscription(std::string transcriptionId)
     {
         bool done = false;
+        if (m_webhookListener)
+        {
+            // Check the status as soon as the completion callback arrives. If it does not arrive within --webhookTimeoutMs,
+            // for example because the service cannot reach --webhookUrl, poll every --pollIntervalMs as without a web hook.
+            if (Verbose())
+            {
+                std::cout << "Waiting up to " << m_userConfig->webhookTimeoutMilliseconds / 1000.0 << " seconds for the transcription completion callback." << std::endl;
+            }
+            TraceSpan span("Wait for callback", "webhook");
+            span.AddArg("received", m_webhookListener->WaitForCompletion(transcriptionId, std::chrono::milliseconds(m_userConfig->webhookTimeoutMilliseconds)));
+            done = GetTranscriptionStatus(transcriptionId);
+        }
         while (!done) {
-            std::cout << "Waiting " + std::to_string(waitSeconds) + " seconds for transcription to complete." << std::endl;
-            Sleep(waitSeconds * 1000);
+            if (Verbose())
+            {
+                std::cout << "Waiting " << m_userConfig->pollIntervalMilliseconds / 1000.0 << " seconds for transcription to complete." << std::endl;
+            }
+            if (m_webhookListener)
+            {
+                // A late callback still ends the wait early.
+                m_webhookListener->WaitForCompletion(transcriptionId, std::chrono::milliseconds(m_userConfig->pollIntervalMilliseconds));
+            }
+            else
+            {
+                Sleep(m_userConfig->pollIntervalMilliseconds);
+            }
             done = GetTranscriptionStatus(transcriptionId);
         }
         return;
@@ -129,61 +323,73 @@ public:
         return RestHelper::SendGet(m_userConfig->certificatePath, uri, m_userConfig->speechSubscriptionKey.value(), std::set<int> { HTTP_OK });
     }
 
-    std::string GetTranscriptionUri(std::shared_ptr<RestResult> transcriptionFiles)
+    // Return the index of the contentUrls entry that a transcription result file belongs to. Result files are named
+    // contenturl_<index>.json.
+    static std::optional<size_t> ContentUrlIndex(const std::string& fileName)
     {
-        // Get Transcription Files JSON response sample and schema:
-        // https://westus.dev.cognitive.microsoft.com/docs/services/speech-to-text-api-v3-0/operations/GetTranscriptionFiles
-        std::optional<nlohmann::json> transcription = JsonHelper::TryFirstWhere([](nlohmann::json value) -> bool {
-            return StringHelper::CaseInsensitiveCompare("transcription", value["kind"].get<std::string>());
-        }, transcriptionFiles->json["values"]);
-        if (!transcription.has_value())
+        const std::string prefix = "contenturl_";
+        const std::string suffix = ".json";
+        if (fileName.size() <= prefix.size() + suffix.size() || !StringHelper::StartsWith(fileName, prefix) || !StringHelper::EndsWith(fileName, suffix))
         {
-            throw std::exception(std::string("Unable to parse transcription files. Response:\n" + transcriptionFiles->text).c_str());
+            return std::nullopt;
         }
-        else
+        std::string digits = fileName.substr(prefix.size(), fileName.size() - prefix.size() - suffix.size());
+        if (!std::all_of(digits.begin(), digits.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); }))
         {
-            return transcription.value()["links"]["contentUrl"];
+            return std::nullopt;
         }
+        return static_cast<size_t>(std::stoull(digits));
     }
 
-    nlohmann::json GetTranscription(std::string transcriptionUri)
-    {
-        return RestHelper::SendGet(m_userConfig->certificatePath, transcriptionUri, m_userConfig->speechSubscriptionKey.value(), std::set<int> { HTTP_OK })->json;
-    }
-
-    nlohmann::json GetTranscriptionPhrases(nlohmann::json transcription)
+    // Return the URI of the transcription result for each of the *recordingCount* recordings of a transcription
+    // job, in contentUrls order. The URI is empty for a recording that has no result, for example because it
+    // could not be transcribed.
+    std::vector<std::string> GetTranscriptionUris(std::string transcriptionId, size_t recordingCount)
     {
-        return JsonHelper::Map([this](nlohmann::json phrase) -> nlohmann::json
+        // Get Transcription Files JSON response sample and schema:
+        // https://westus.dev.cognitive.microsoft.com/docs/services/speech-to-text-api-v3-0/operations/GetTranscriptionFiles
+        std::vector<std::string> transcriptionUris(recordingCount);
+        std::shared_ptr<RestResult> transcriptionFiles = GetTranscriptionFiles(transcriptionId);
+        while (true)
         {
-            static int id = 0;
-            nlohmann::json best = phrase["nBest"][0];
-            // If the user specified stereo audio, and therefore we turned off diarization,
-            // only the channel property is present.
-            // Note: Channels are numbered from 0. Speakers are numbered from 1.
-            int speakerNumber;
-            if (phrase.contains("speaker"))
+            for (const auto& file : transcriptionFiles->json["values"])
             {
-                speakerNumber = phrase["speaker"] - 1;
-            }
-            else if (phrase.contains("channel"))
-            {
-                speakerNumber = phrase["channel"];
+                if (!StringHelper::CaseInsensitiveCompare("transcription", file["kind"].get<std::string>()))
+                {
+                    continue;
+                }
+                std::optional<size_t> index = ContentUrlIndex(file.value("name", std::string()));
+                // A job for one recording has one result, whatever it is named.
+                if (!index.has_value() && 1 == recordingCount)
+                {
+                    index = 0;
+                }
+                if (index.has_value() && index.value() < recordingCount)
+                {
+                    transcriptionUris[index.value()] = file["links"]["contentUrl"];
+                }
             }
-            else
+            // The files are returned in pages. @nextLink is the URL of the next page, if there is one.
+            if (!transcriptionFiles->json.contains("@nextLink") || !transcriptionFiles->json["@nextLink"].is_string())
             {
-                throw std::exception("nBest item contains neither channel nor speaker attribute.");
+                break;
             }
-            return
-            {
-                {"id", id++},
-                {"text", best["display"]},
-                {"itn", best["itn"]},
-                {"lexical", best["lexical"]},
-                {"speakerNumber", speakerNumber},
-                {"offset", phrase["offset"]},
-                {"offsetInTicks", phrase["offsetInTicks"]}
-            };
-        }, transcription["recognizedPhrases"]);
+            transcriptionFiles = RestHelper::SendGet(m_userConfig->certificatePath, transcriptionFiles->json["@nextLink"].get<std::string>(), m_userConfig->speechSubscriptionKey.value(), std::set<int> { HTTP_OK });
+        }
+        return transcriptionUris;
+    }
+
+    TranscriptionPhrases GetTranscription(std::string transcriptionUri)
+    {
+        // Skip building a JSON DOM for the transcription, which can be very large. Read only the fields we need instead,
+        // and each whole phrase only if the full output needs it. The reader parses the response as it downloads, so
+        // the whole transcription text is never in memory.
+        TranscriptionPhrases phrases;
+        bool keepPhraseJson = m_userConfig->outputFilePath.has_value();
+        RestHelper::SendGet(m_userConfig->certificatePath, transcriptionUri, m_userConfig->speechSubscriptionKey.value(), std::set<int> { HTTP_OK }, [&phrases, keepPhraseJson](std::istream& input) {
+            phrases = TranscriptionReader::Read(input, keepPhraseJson);
+        });
+        return phrases;
     }
 
     void DeleteTranscription(std::string transcriptionId)
@@ -193,131 +399,186 @@ public:
         return;
     }
     
-    nlohmann::json GetSentimentAnalysis(nlohmann::json phrases)
+    // Send a sentiment analysis request, or return the cached response if the same request was sent before.
+    nlohmann::json SendSentimentAnalysisRequest(const std::string& content)
     {
+        std::string cacheKey;
+        if (m_cache)
+        {
+            cacheKey = ResponseCache::Key(m_userConfig->languageEndpoint + sentimentAnalysisPath, sentimentAnalysisQuery, content);
+            std::optional<std::string> cached = m_cache->Get(cacheKey);
+            if (cached.has_value())
+            {
+                // A corrupt entry is not fatal. Discard it and send the request again.
+                nlohmann::json response = nlohmann::json::parse(cached.value(), nullptr, false);
+                if (!response.is_discarded())
+                {
+                    return response;
+                }
+                m_cache->Discard(cacheKey);
+            }
+        }
         std::string uri = m_userConfig->languageEndpoint + sentimentAnalysisPath + sentimentAnalysisQuery;
-        
-        // Create a map of phrase ID to phrase data so we can retrieve it later.
-        nlohmann::json phraseData;
+        std::shared_ptr<RestResult> result = RestHelper::SendPost(m_userConfig->certificatePath, uri, content, m_userConfig->languageSubscriptionKey, std::set<int> { HTTP_OK }, true, nullptr != m_cache);
+        if (m_cache)
+        {
+            m_cache->Put(cacheKey, result->text);
+        }
+        return std::move(result->json);
+    }
+
+    // Analyze sentiment for phrases [*begin*, *end*), and store the results at the positions of those phrases in *sentiments*.
+    // Preconditions:
+    // *end* - *begin* is at most sentimentBatchSize.
+    // *sentiments* has at least *end* elements.
+    void AnalyzeSentiment(const TranscriptionPhrases& phrases, size_t begin, size_t end, PhraseSentiments& sentiments)
+    {
+        TraceSpan span("Sentiment batch", "analysis");
+        span.AddArg("phrases", end - begin);
         // Convert each transcription phrase to a "document" as expected by the sentiment analysis REST API.
-        nlohmann::json documents_1 = JsonHelper::Map([this, &phraseData](nlohmann::json phrase) -> nlohmann::json
+        nlohmann::json documents = nlohmann::json::array();
+        for (size_t index = begin; index < end; index++)
         {
-            // Let C++ know phrase["id"] is an int.
-            // Otherwise it complains [ is ambiguous.
-            phraseData[phrase["id"].get<int>()] =
-            {
-                {"speakerNumber", phrase["speakerNumber"]},
-                {"offsetInTicks", phrase["offsetInTicks"]}
-            };
-            return
+            documents.push_back(
             {
-                {"id", phrase["id"]},
-                {"language", this->m_userConfig->language},
-                {"text", phrase["text"]}
-            };
-        }, phrases);
+                {"id", std::to_string(phrases.ids[index])},
+                {"language", m_userConfig->language},
+                {"text", phrases.Text(index)}
+            });
+        }
 
-        // We can only analyze sentiment for 10 documents per request.
-        nlohmann::json documents_2 = JsonHelper::Chunk(documents_1, 10);
-        
-        nlohmann::json results_1 = JsonHelper::Map([this, uri](nlohmann::json documents_chunk) -> nlohmann::json {
-            nlohmann::json content =
-            {
-                {"kind", "SentimentAnalysis"},
-                {"analysisInput",
-                    // Start object definition
-                    {
-                        {"documents", documents_chunk}
-                    }
-                }
-            };
-            return RestHelper::SendPost(this->m_userConfig->certificatePath, uri, content.dump(), this->m_userConfig->languageSubscriptionKey, std::set<int> { HTTP_OK })->json;
-        }, documents_2);
-        
-        nlohmann::json results_2 = JsonHelper::Map([phraseData](nlohmann::json results_chunk) -> nlohmann::json
+        nlohmann::json content =
         {
-            return JsonHelper::Map([phraseData](nlohmann::json document) -> nlohmann::json
-            {
-                return
+            {"kind", "SentimentAnalysis"},
+            {"analysisInput",
+                // Start object definition
                 {
-                    {"speakerNumber", phraseData[std::stoi(document["id"].get<std::string>())]["speakerNumber"]},
-                    {"offsetInTicks", phraseData[std::stoi(document["id"].get<std::string>())]["offsetInTicks"]},
-                    {"document", document}
-                };
-            }, results_chunk["results"]["documents"]);
-        }, results_1);
-        return JsonHelper::Concat(results_2);
-    }
-    
-    std::vector<std::string> GetSentimentsForSimpleOutput(nlohmann::json sentimentAnalysis_1)
-    {
-        std::vector<std::string> retval;
-        nlohmann::json sentimentAnalysis_2 = JsonHelper::SortBy([](nlohmann::json document_1, nlohmann::json document_2) -> bool {
-            return document_1["offsetInTicks"].get<double>() < document_2["offsetInTicks"].get<double>();
-        }, sentimentAnalysis_1);
-        for (auto& item : sentimentAnalysis_2)
+                    {"documents", std::move(documents)}
+                }
+            }
+        };
+        nlohmann::json result = SendSentimentAnalysisRequest(content.dump());
+        // Phrase IDs match phrase positions, so each result document is stored at the position of its phrase.
+        for (const auto& document : result["results"]["documents"])
         {
-            retval.push_back(item["document"]["sentiment"].get<std::string>());
+            size_t index = std::stoi(document["id"].get_ref<const std::string&>());
+            const nlohmann::json& confidenceScores = document["confidenceScores"];
+            sentiments.sentiments[index] = PhraseSentiments::SentimentFromString(document["sentiment"].get_ref<const std::string&>());
+            sentiments.positiveScores[index] = confidenceScores["positive"].get<double>();
+            sentiments.neutralScores[index] = confidenceScores["neutral"].get<double>();
+            sentiments.negativeScores[index] = confidenceScores["negative"].get<double>();
         }
-        return retval;
     }
 
-    std::vector<nlohmann::json> GetSentimentConfidenceScores(nlohmann::json sentimentAnalysis_1)
+    PhraseSentiments GetSentimentAnalysis(const TranscriptionPhrases& phrases)
     {
-        std::vector<nlohmann::json> retval;
-        nlohmann::json sentimentAnalysis_2 = JsonHelper::SortBy([](nlohmann::json document_1, nlohmann::json document_2) -> bool {
-            return document_1["offsetInTicks"].get<double>() < document_2["offsetInTicks"].get<double>();
-        }, sentimentAnalysis_1);
-        for (auto& item : sentimentAnalysis_2)
+        PhraseSentiments retval;
+        retval.Resize(phrases.Size());
+        for (size_t begin = 0; begin < phrases.Size(); begin += sentimentBatchSize)
         {
-            retval.push_back(item["document"]["confidenceScores"]);
+            AnalyzeSentiment(phrases, begin, std::min(begin + sentimentBatchSize, phrases.Size()), retval);
         }
         return retval;
     }
     
-    nlohmann::json MergeSentimentConfidenceScoresIntoTranscription(nlohmann::json transcription, std::vector<nlohmann::json> sentimentConfidenceScores)
-    {
-        int id = 0;
-        nlohmann::json recognizedPhrases_2 = JsonHelper::Map([&id, sentimentConfidenceScores](nlohmann::json phrase) -> nlohmann::json
-        {
-            nlohmann::json nBest_2 = JsonHelper::Map([id, sentimentConfidenceScores](nlohmann::json item) -> nlohmann::json
-            {
-                // Add the sentiment confidence scores to the item in the nBest array.
-                // TODO2 We are adding the same sentiment data to each nBest item.
-                // However, the sentiment data are based on the phrase from the first nBest item.
-                // See GetTranscriptionPhrases() and GetSentimentAnalysis().
-                item["sentiment"] = sentimentConfidenceScores[id];
-                return item;
-            }, phrase["nBest"]);
-            phrase["nBest"] = nBest_2;
-            id++;
-            return phrase;
-        }, transcription["recognizedPhrases"]);
-        transcription["recognizedPhrases"] = recognizedPhrases_2;
-        return transcription;
+    // Write the transcription for the full output from the transcription phrases, and add the sentiment confidence scores.
+    // Phrases the reader kept whole are written as they were received, with every nBest item and word timing. Other
+    // phrases, such as those from real-time transcription, are written from their columns with only the best nBest item.
+    // Keys are written in sorted order, as nlohmann::json would write them.
+    void WriteTranscriptionForFullOutput(JsonWriter& writer, const TranscriptionPhrases& phrases, const PhraseSentiments& sentimentAnalysis)
+    {
+        writer.BeginObject();
+        writer.Key("combinedRecognizedPhrases").BeginArray();
+        for (const auto& combinedPhrase : phrases.combinedRecognizedPhrases)
+        {
+            writer.BeginObject()
+                .Field("channel", combinedPhrase.channel)
+                .Field("display", combinedPhrase.display)
+                .Field("itn", combinedPhrase.itn)
+                .Field("lexical", combinedPhrase.lexical)
+                .Field("maskedITN", combinedPhrase.maskedItn)
+                .EndObject();
+        }
+        writer.EndArray();
+        writer.Field("duration", phrases.duration);
+        writer.Field("durationInTicks", phrases.durationInTicks);
+
+        writer.Key("recognizedPhrases").BeginArray();
+        for (size_t index = 0; index < phrases.Size(); index++)
+        {
+            nlohmann::json sentiment =
+            {
+                {"negative", sentimentAnalysis.negativeScores[index]},
+                {"neutral", sentimentAnalysis.neutralScores[index]},
+                {"positive", sentimentAnalysis.positiveScores[index]}
+            };
+            if (!phrases.Json(index).empty())
+            {
+                nlohmann::json phrase = nlohmann::json::parse(phrases.Json(index));
+                // The sentiment scores were computed from the best item's text. Add them to every nBest item.
+                auto nBest = phrase.find("nBest");
+                if (phrase.end() != nBest)
+                {
+                    for (auto& item : *nBest)
+                    {
+                        item["sentiment"] = sentiment;
+                    }
+                }
+                writer.Value(phrase);
+                continue;
+            }
+            writer.BeginObject()
+                .Field("channel", phrases.channels[index])
+                .Field("duration", phrases.Duration(index))
+                .Field("durationInTicks", phrases.durationsInTicks[index]);
+            writer.Key("nBest").BeginArray().BeginObject()
+                .Field("confidence", phrases.confidences[index])
+                .Field("display", phrases.Text(index))
+                .Field("itn", phrases.Itn(index))
+                .Field("lexical", phrases.Lexical(index))
+                .Field("maskedITN", phrases.MaskedItn(index));
+            // Add the sentiment confidence scores to the best item in the nBest array.
+            writer.Field("sentiment", sentiment);
+            writer.EndObject().EndArray();
+            writer.Field("offset", phrases.Offset(index))
+                .Field("offsetInTicks", phrases.offsetsInTicks[index])
+                .Field("recognitionStatus", phrases.RecognitionStatus(index));
+            if (phrases.speakers[index] > 0)
+            {
+                writer.Field("speaker", phrases.speakers[index]);
+            }
+            writer.EndObject();
+        }
+        writer.EndArray();
+
+        writer.Field("source", phrases.source);
+        writer.Field("timestamp", phrases.timestamp);
+        writer.EndObject();
     }
     
-    nlohmann::json TranscriptionPhrasesToConversationItems(nlohmann::json phrases)
+    nlohmann::json TranscriptionPhrasesToConversationItems(const TranscriptionPhrases& phrases)
     {
-        return JsonHelper::Map([](nlohmann::json phrase) -> nlohmann::json {
-            static int id = 0;
-            return
+        nlohmann::json retval = nlohmann::json::array();
+        retval.get_ref<nlohmann::json::array_t&>().reserve(phrases.Size());
+        for (size_t index = 0; index < phrases.Size(); index++)
+        {
+            retval.push_back(
             {
-                {"id", id++},
-                {"text", phrase["text"]},
-                {"itn", phrase["itn"]},
-                {"lexical", phrase["lexical"]},
+                {"id", phrases.ids[index]},
+                {"text", phrases.Text(index)},
+                {"itn", phrases.Itn(index)},
+                {"lexical", phrases.Lexical(index)},
                 // The first person to speak is probably the agent.
-                {"role", 0 == phrase["speakerNumber"] ? "Agent" : "Customer"},
-                {"participantId", phrase["speakerNumber"]}
-            };
-        }, phrases);
+                {"role", 0 == phrases.speakerNumbers[index] ? "Agent" : "Customer"},
+                {"participantId", phrases.speakerNumbers[index]}
+            });
+        }
+        return retval;
     }
 
-    std::string RequestConversationAnalysis(nlohmann::json conversationItems)
+    nlohmann::json GetConversationAnalysisRequest(const nlohmann::json& conversationItems)
     {
-        std::string uri = m_userConfig->languageEndpoint + conversationAnalysisPath + conversationAnalysisQuery;
-        nlohmann::json content =
+        return
         {
             {"displayName", "call_center_analyze_conversation_task"},
             {"analysisInput",
@@ -381,8 +642,13 @@ public:
                 }
             }
         };
-        std::shared_ptr<RestResult> result = RestHelper::SendPost(m_userConfig->certificatePath, uri, content.dump(), m_userConfig->languageSubscriptionKey, std::set<int> { HTTP_ACCEPTED });
-        return result->headers["operation-location"];
+    }
+
+    std::string RequestConversationAnalysis(const std::string& content)
+    {
+        std::string uri = m_userConfig->languageEndpoint + conversationAnalysisPath + conversationAnalysisQuery;
+        std::shared_ptr<RestResult> result = RestHelper::SendPost(m_userConfig->certificatePath, uri, content, m_userConfig->languageSubscriptionKey, std::set<int> { HTTP_ACCEPTED });
+        return std::string(result->headers.Get("operation-location"));
     }
     
     bool GetConversationAnalysisStatus(std::string conversationAnalysisUrl)
@@ -390,7 +656,7 @@ public:
         std::shared_ptr<RestResult> result = RestHelper::SendGet(m_userConfig->certificatePath, conversationAnalysisUrl, m_userConfig->languageSubscriptionKey, std::set<int> { HTTP_OK });
         if (StringHelper::CaseInsensitiveCompare("failed", result->json["status"].get<std::string>()))
         {
-            throw std::exception(std::string("Unable to analyze conversation. Response:\n" + result->text).c_str());
+            throw std::exception(std::string("Unable to analyze conversation. Response:\n" + result->json.dump()).c_str());
         }
         else
         {
@@ -402,27 +668,220 @@ public:
     {
         bool done = false;
         while (!done) {
-            std::cout << "Waiting " + std::to_string(waitSeconds) + " seconds for conversation analysis to complete." << std::endl;
-            Sleep(waitSeconds * 1000);
+            if (Verbose())
+            {
+                std::cout << "Waiting " << m_userConfig->pollIntervalMilliseconds / 1000.0 << " seconds for conversation analysis to complete." << std::endl;
+            }
+            Sleep(m_userConfig->pollIntervalMilliseconds);
             done = GetConversationAnalysisStatus(conversationAnalysisUrl);
         }
         return;
     }
     
-    nlohmann::json GetConversationAnalysis(std::string conversationAnalysisUrl)
+    std::shared_ptr<RestResult> GetConversationAnalysis(std::string conversationAnalysisUrl)
+    {
+        // Keep the response text to cache it.
+        return RestHelper::SendGet(m_userConfig->certificatePath, conversationAnalysisUrl, m_userConfig->languageSubscriptionKey, std::set<int> { HTTP_OK }, nullptr != m_cache);
+    }
+
+    // Submit a conversation analysis job, wait for it and return its result. If the same job was
+    // submitted before, return the cached result instead. The job result is keyed by the submitted
+    // request, since the job URL differs every time.
+    nlohmann::json RunConversationAnalysisJob(const nlohmann::json& conversationItems)
+    {
+        TraceSpan span("Conversation analysis job", "analysis");
+        span.AddArg("items", conversationItems.size());
+        std::string content = GetConversationAnalysisRequest(conversationItems).dump();
+        std::string cacheKey;
+        if (m_cache)
+        {
+            cacheKey = ResponseCache::Key(m_userConfig->languageEndpoint + conversationAnalysisPath, conversationAnalysisQuery, content);
+            std::optional<std::string> cached = m_cache->Get(cacheKey);
+            if (cached.has_value())
+            {
+                // A corrupt entry is not fatal. Discard it and run the job again.
+                nlohmann::json response = nlohmann::json::parse(cached.value(), nullptr, false);
+                if (!response.is_discarded())
+                {
+                    span.AddArg("cached", true);
+                    return response;
+                }
+                m_cache->Discard(cacheKey);
+            }
+        }
+        // NOTE: Conversation summary is currently in gated public preview. You can sign up here:
+        // https://aka.ms/applyforconversationsummarization/
+        std::string conversationAnalysisUrl = RequestConversationAnalysis(content);
+        WaitForConversationAnalysis(conversationAnalysisUrl);
+        std::shared_ptr<RestResult> result = GetConversationAnalysis(conversationAnalysisUrl);
+        if (m_cache)
+        {
+            m_cache->Put(cacheKey, result->text);
+        }
+        return std::move(result->json);
+    }
+
+    // Split conversation items into windows whose requests are at most conversationShardCharacters serialized characters each.
+    // Each window after the first starts with up to conversationShardOverlap items from the end of the previous
+    // window, so its summary has some context. Every item is owned by exactly one window, which reports its PII.
+    std::vector<ConversationShard> ShardConversation(const nlohmann::json& conversationItems)
+    {
+        // The request around the items counts against the limit too.
+        const size_t envelope = GetConversationAnalysisRequest(nlohmann::json::array()).dump().size();
+        const size_t limit = m_userConfig->conversationShardCharacters > envelope ? m_userConfig->conversationShardCharacters - envelope : 0;
+        std::vector<size_t> characters;
+        characters.reserve(conversationItems.size());
+        for (const auto& item : conversationItems)
+        {
+            // Include the comma that separates the item from the next one.
+            characters.push_back(item.dump().size() + 1);
+        }
+
+        std::vector<ConversationShard> shards;
+        size_t begin = 0;
+        size_t ownedBegin = 0;
+        while (ownedBegin < conversationItems.size())
+        {
+            size_t total = 0;
+            for (size_t index = begin; index < ownedBegin; index++)
+            {
+                total += characters[index];
+            }
+            // Drop the oldest overlap items until the first owned item fits.
+            while (begin < ownedBegin && total + characters[ownedBegin] > limit)
+            {
+                total -= characters[begin];
+                begin++;
+            }
+            size_t end = ownedBegin;
+            // Always take at least one item, even if it is larger than the limit by itself.
+            while (end < conversationItems.size() && (end == ownedBegin || total + characters[end] <= limit))
+            {
+                total += characters[end];
+                end++;
+            }
+            shards.push_back(ConversationShard { begin, ownedBegin, end });
+
+            // Start the next window with the last few items of this one, using at most half the limit for them.
+            size_t overlap = 0;
+            begin = end;
+            while (begin > ownedBegin && end - begin < conversationShardOverlap && overlap + characters[begin - 1] <= limit / 2)
+            {
+                begin--;
+                overlap += characters[begin];
+            }
+            ownedBegin = end;
+        }
+        return shards;
+    }
+
+    static nlohmann::json& FindTask(nlohmann::json& conversationAnalysis, const std::string& taskName)
     {
-        return RestHelper::SendGet(m_userConfig->certificatePath, conversationAnalysisUrl, m_userConfig->languageSubscriptionKey, std::set<int> { HTTP_OK })->json;
+        for (auto& task : conversationAnalysis["tasks"]["items"])
+        {
+            if (StringHelper::CaseInsensitiveCompare(taskName, task["taskName"].get<std::string>()))
+            {
+                return task;
+            }
+        }
+        throw std::exception(std::string("Conversation analysis result has no task named " + taskName + ".").c_str());
     }
 
-    nlohmann::json GetConversationAnalysisForSimpleOutput(nlohmann::json conversationAnalysis)
+    // Merge the results of the shards of one conversation into a result shaped like that of a single job:
+    // summaries with the same aspect are joined in order, and each conversation item's PII comes from the shard that owns it.
+    nlohmann::json MergeConversationAnalyses(const nlohmann::json& conversationItems, const std::vector<ConversationShard>& shards, std::vector<nlohmann::json>& results)
     {
-        nlohmann::json tasks = conversationAnalysis["tasks"]["items"];
+        nlohmann::json merged = std::move(results[0]);
+        nlohmann::json& mergedSummaries = FindTask(merged, "summary_1")["results"]["conversations"][0]["summaries"];
+        nlohmann::json& mergedItems = FindTask(merged, "PII_1")["results"]["conversations"][0]["conversationItems"];
+        nlohmann::json shardItems = std::move(mergedItems);
+        mergedItems = nlohmann::json::array();
+
+        for (size_t shard = 0; shard < shards.size(); shard++)
+        {
+            // Conversation item IDs are phrase IDs, which are already global, so items only need to be attributed to their owner.
+            std::set<std::string> ownedIds;
+            for (size_t index = shards[shard].ownedBegin; index < shards[shard].end; index++)
+            {
+                ownedIds.insert(conversationItems[index]["id"].dump());
+            }
+            if (shard > 0)
+            {
+                shardItems = std::move(FindTask(results[shard], "PII_1")["results"]["conversations"][0]["conversationItems"]);
+                for (auto& summary : FindTask(results[shard], "summary_1")["results"]["conversations"][0]["summaries"])
+                {
+                    auto existing = std::find_if(mergedSummaries.begin(), mergedSummaries.end(), [&summary](const nlohmann::json& mergedSummary) -> bool {
+                        return mergedSummary["aspect"] == summary["aspect"];
+                    });
+                    if (existing == mergedSummaries.end())
+                    {
+                        mergedSummaries.push_back(std::move(summary));
+                    }
+                    else
+                    {
+                        (*existing)["text"] = (*existing)["text"].get<std::string>() + " " + summary["text"].get<std::string>();
+                    }
+                }
+            }
+            for (auto& item : shardItems)
+            {
+                // The service returns IDs as strings. Compare them the same way as the IDs we sent, which are numbers.
+                std::string id = item["id"].is_string() ? item["id"].get<std::string>() : item["id"].dump();
+                if (ownedIds.count(id) > 0)
+                {
+                    mergedItems.push_back(std::move(item));
+                }
+            }
+        }
+        return merged;
+    }
+
+    // Analyze the conversation (PII and summary). Long conversations are split into overlapping windows
+    // that are analyzed as concurrent jobs, so no request exceeds the size limit, and the results are merged.
+    nlohmann::json AnalyzeConversation(const nlohmann::json& conversationItems)
+    {
+        std::vector<ConversationShard> shards = ShardConversation(conversationItems);
+        if (shards.size() <= 1)
+        {
+            return RunConversationAnalysisJob(conversationItems);
+        }
+        if (Verbose())
+        {
+            std::cout << "Analyzing the conversation in " << shards.size() << " parts." << std::endl;
+        }
+        std::vector<std::future<nlohmann::json>> jobs;
+        for (const auto& shard : shards)
+        {
+            nlohmann::json shardItems(conversationItems.begin() + shard.begin, conversationItems.begin() + shard.end);
+            jobs.push_back(std::async(std::launch::async, [this, shardItems = std::move(shardItems)]() {
+                return RunConversationAnalysisJob(shardItems);
+            }));
+        }
+        std::vector<nlohmann::json> results;
+        for (auto& job : jobs)
+        {
+            results.push_back(job.get());
+        }
+        return MergeConversationAnalyses(conversationItems, shards, results);
+    }
+
+    void PrintReport()
+    {
+        if (m_cache)
+        {
+            m_cache->Report(std::cout);
+        }
+    }
+
+    nlohmann::json GetConversationAnalysisForSimpleOutput(const nlohmann::json& conversationAnalysis)
+    {
+        const nlohmann::json& tasks = conversationAnalysis["tasks"]["items"];
         
-        nlohmann::json summaryTask = JsonHelper::TryFirstWhere([](nlohmann::json task) -> bool {
+        const nlohmann::json& summaryTask = JsonHelper::FirstWhere([](const nlohmann::json& task) -> bool {
             return StringHelper::CaseInsensitiveCompare("summary_1", task["taskName"].get<std::string>());
-        }, tasks).value();
-        nlohmann::json conversationSummaries = summaryTask["results"]["conversations"][0]["summaries"];
-        nlohmann::json conversationSummary = JsonHelper::Map([](nlohmann::json summary) -> nlohmann::json {
+        }, tasks, "summary_1 task");
+        const nlohmann::json& conversationSummaries = summaryTask["results"]["conversations"][0]["summaries"];
+        nlohmann::json conversationSummary = JsonHelper::Map([](const nlohmann::json& summary) -> nlohmann::json {
             return
             {
                 {"aspect", summary["aspect"]},
@@ -430,12 +889,12 @@ public:
             };
         }, conversationSummaries);
 
-        nlohmann::json PIITask = JsonHelper::TryFirstWhere([](nlohmann::json task) -> bool {
+        const nlohmann::json& PIITask = JsonHelper::FirstWhere([](const nlohmann::json& task) -> bool {
             return StringHelper::CaseInsensitiveCompare("pii_1", task["taskName"].get<std::string>());
-        }, tasks).value();
-        nlohmann::json conversationItems = PIITask["results"]["conversations"][0]["conversationItems"];
-        nlohmann::json conversationPIIAnalysis = JsonHelper::Map([](nlohmann::json conversationItem) -> nlohmann::json {
-            return JsonHelper::Map([](nlohmann::json entity) -> nlohmann::json {
+        }, tasks, "pii_1 task");
+        const nlohmann::json& conversationItems = PIITask["results"]["conversations"][0]["conversationItems"];
+        nlohmann::json conversationPIIAnalysis = JsonHelper::Map([](const nlohmann::json& conversationItem) -> nlohmann::json {
+            return JsonHelper::Map([](const nlohmann::json& entity) -> nlohmann::json {
                 return
                 {
                     {"category", entity["category"]},
@@ -446,127 +905,771 @@ public:
 
         return
         {
-            {"conversationSummary", conversationSummary},
-            {"conversationPIIAnalysis", conversationPIIAnalysis}
+            {"conversationSummary", std::move(conversationSummary)},
+            {"conversationPIIAnalysis", std::move(conversationPIIAnalysis)}
         };
     }
     
-    // Create a string that contains each transcription phrase, followed by sentiment, PII, and so on.
-    std::string GetSimpleOutput(nlohmann::json transcriptionPhrases, std::vector<std::string> transcriptionSentiments, nlohmann::json conversationAnalysis)
+    // Write one transcription phrase, followed by sentiment and PII.
+    // *conversationPIIAnalysis* is the conversationPIIAnalysis array from GetConversationAnalysisForSimpleOutput,
+    // or an empty array if PII analysis is not available yet.
+    void WritePhraseOutput(OutputWriter& output, const TranscriptionPhrases& transcriptionPhrases, const PhraseSentiments& transcriptionSentiments, const nlohmann::json& conversationPIIAnalysis, size_t index)
     {
-        std::ostringstream result;
-        for (auto index = 0; index < transcriptionPhrases.size(); index++)
+        output.Write("Phrase: ").WriteJsonString(transcriptionPhrases.Text(index)).Write('\n');
+        output.Write("Speaker: ").Write(static_cast<int64_t>(transcriptionPhrases.speakerNumbers[index])).Write('\n');
+        if (index < transcriptionSentiments.Size())
         {
-            result << "Phrase: " << transcriptionPhrases[index]["text"] << "\n";
-            result << "Speaker: " << transcriptionPhrases[index]["speakerNumber"] << "\n";
-            if (index < transcriptionSentiments.size())
-            {
-                result << "Sentiment: " << transcriptionSentiments[index] << "\n";
-            }
-            if (index < conversationAnalysis["conversationPIIAnalysis"].size())
+            output.Write("Sentiment: ").Write(PhraseSentiments::SentimentToString(transcriptionSentiments.sentiments[index])).Write('\n');
+        }
+        if (index < conversationPIIAnalysis.size())
+        {
+            if (conversationPIIAnalysis[index].size() > 0)
             {
-                if (conversationAnalysis["conversationPIIAnalysis"][index].size() > 0)
+                output.Write("Recognized entities (PII):\n");
+                for (const auto& entity : conversationPIIAnalysis[index])
                 {
-                    std::string entities = JsonHelper::Fold([](std::string acc, nlohmann::json entity) -> std::string {
-                        std::ostringstream result;
-                        result << acc << "    Category: " << entity["category"] << ". Text: " << entity["text"] << ".\n";
-                        return result.str();
-                    }, "Recognized entities (PII):\n", conversationAnalysis["conversationPIIAnalysis"][index]);
-                    result << entities;
-                }
-                else
-                {
-                    result << "Recognized entities (PII): none.\n";
+                    output.Write("    Category: ").WriteJsonString(entity["category"].get_ref<const std::string&>())
+                        .Write(". Text: ").WriteJsonString(entity["text"].get_ref<const std::string&>()).Write(".\n");
                 }
             }
-            result << "\n";
+            else
+            {
+                output.Write("Recognized entities (PII): none.\n");
+            }
+        }
+        output.Write('\n');
+    }
+
+    void WriteConversationSummary(OutputWriter& output, const nlohmann::json& conversationAnalysis)
+    {
+        output.Write("Conversation summary:\n");
+        for (const auto& item : conversationAnalysis["conversationSummary"])
+        {
+            output.Write("    ").WriteJsonString(item["aspect"].get_ref<const std::string&>())
+                .Write(": ").WriteJsonString(item["summary"].get_ref<const std::string&>()).Write(".\n");
         }
-        std::string summary = JsonHelper::Fold([](std::string acc, nlohmann::json item) -> std::string {
-            std::ostringstream result;
-            result << acc << "    " << item["aspect"] << ": " << item["summary"] << ".\n";
-            return result.str();
-        }, "Conversation summary:\n", conversationAnalysis["conversationSummary"]);
-        result << summary;
-        
-        return result.str();
+    }
+
+    // Write each transcription phrase, followed by sentiment, PII, and so on.
+    void WriteSimpleOutput(OutputWriter& output, const TranscriptionPhrases& transcriptionPhrases, const PhraseSentiments& transcriptionSentiments, const nlohmann::json& conversationAnalysis)
+    {
+        for (size_t index = 0; index < transcriptionPhrases.Size(); index++)
+        {
+            WritePhraseOutput(output, transcriptionPhrases, transcriptionSentiments, conversationAnalysis["conversationPIIAnalysis"], index);
+        }
+        WriteConversationSummary(output, conversationAnalysis);
     }
     
-    void PrintSimpleOutput(nlohmann::json transcriptionPhrases, nlohmann::json sentimentAnalysis, nlohmann::json conversationAnalysis)
+    void PrintSimpleOutput(std::ostream& outputStream, const TranscriptionPhrases& transcriptionPhrases, const PhraseSentiments& sentimentAnalysis, const nlohmann::json& conversationAnalysis)
     {
-        std::vector<std::string> sentiments = GetSentimentsForSimpleOutput(sentimentAnalysis);
         nlohmann::json conversation = GetConversationAnalysisForSimpleOutput(conversationAnalysis);
-        std::cout << GetSimpleOutput(transcriptionPhrases, sentiments, conversation);
+        OutputWriter output(outputStream);
+        WriteSimpleOutput(output, transcriptionPhrases, sentimentAnalysis, conversation);
     }
     
-    nlohmann::json GetConversationAnalysisForFullOutput(std::vector<nlohmann::json> transcriptionPhrases, nlohmann::json conversationAnalysis)
+    // Write the conversation summary and PII analysis results for the full output. Each conversation item
+    // gets the channel and offset of its transcription phrase.
+    void WriteConversationAnalysisForFullOutput(JsonWriter& writer, const TranscriptionPhrases& transcriptionPhrases, const nlohmann::json& conversationAnalysis)
     {
         // Get the conversation summary and conversation PII analysis task results.
-        nlohmann::json tasks = conversationAnalysis["tasks"]["items"];
+        const nlohmann::json& tasks = conversationAnalysis["tasks"]["items"];
         
-        nlohmann::json summaryTask = JsonHelper::TryFirstWhere([](nlohmann::json task) -> bool {
+        const nlohmann::json& summaryTask = JsonHelper::FirstWhere([](const nlohmann::json& task) -> bool {
             return StringHelper::CaseInsensitiveCompare("summary_1", task["taskName"].get<std::string>());
-        }, tasks).value();
-        nlohmann::json conversationSummaryResults = summaryTask["results"];
+        }, tasks, "summary_1 task");
+        const nlohmann::json& conversationSummaryResults = summaryTask["results"];
         
-        nlohmann::json PIITask = JsonHelper::TryFirstWhere([](nlohmann::json task) -> bool {
+        const nlohmann::json& PIITask = JsonHelper::FirstWhere([](const nlohmann::json& task) -> bool {
             return StringHelper::CaseInsensitiveCompare("pii_1", task["taskName"].get<std::string>());
-        }, tasks).value();
-        nlohmann::json conversationPIIResults = PIITask["results"];
+        }, tasks, "pii_1 task");
+        const nlohmann::json& conversationPIIResults = PIITask["results"];
 
         // There should be only one conversation.
-        nlohmann::json conversation = conversationPIIResults["conversations"][0];
-        // Order conversation items by ID so they match the order of the transcription phrases.
-        nlohmann::json conversationItems_1 = JsonHelper::SortBy([](nlohmann::json item_1, nlohmann::json item_2) -> bool { return std::stoi(item_1["id"].get<std::string>()) < std::stoi(item_2["id"].get<std::string>()); }, conversation["conversationItems"]);
-        
-        auto combinedRedactedContent = std::vector<nlohmann::json>(2);
-        combinedRedactedContent.push_back(nlohmann::json());
-        combinedRedactedContent.push_back(nlohmann::json());
-
-        nlohmann::json conversationItems_2 = JsonHelper::Map([transcriptionPhrases, &combinedRedactedContent](nlohmann::json item) -> nlohmann::json
-        {
-            static int index = 0;
-            // Get the channel and offset for this conversation item from the corresponding transcription phrase.
-            int channel = transcriptionPhrases[index]["speakerNumber"];
-            // Add channel and offset to conversation item.
-            item["channel"] = channel;
-            item["offset"] = transcriptionPhrases[index]["offset"];
-            // Get the text, lexical, and itn fields from redacted content, and append them to the combined redacted content for this channel.
-            nlohmann::json redactedContent = item["redactedContent"];
-            combinedRedactedContent[channel]["display"] += redactedContent["text"];
-            combinedRedactedContent[channel]["lexical"] += redactedContent["lexical"];
-            combinedRedactedContent[channel]["itn"] += redactedContent["itn"];
-            index++;
-            return item;
-        }, conversationItems_1);
-        conversation["conversationItems"] = conversationItems_2;
+        const nlohmann::json& conversation = conversationPIIResults["conversations"][0];
+        const nlohmann::json& conversationItems = conversation["conversationItems"];
+        // Visit conversation items in ID order so they match the order of the transcription phrases.
+        std::vector<size_t> order = JsonHelper::SortIndicesBy([](const nlohmann::json& item_1, const nlohmann::json& item_2) -> bool { return std::stoi(item_1["id"].get<std::string>()) < std::stoi(item_2["id"].get<std::string>()); }, conversationItems);
+        int channelCount = 0;
+        for (size_t index = 0; index < order.size(); index++)
+        {
+            channelCount = std::max(channelCount, transcriptionPhrases.speakerNumbers[index] + 1);
+        }
 
-        return
+        writer.BeginObject();
+        writer.Key("conversationPiiResults").BeginObject();
+        // For each channel, list the redacted text, lexical, and itn fields of its conversation items.
+        writer.Key("combinedRedactedContent").BeginArray();
+        for (int channel = 0; channel < channelCount; channel++)
         {
-            {"conversationSummaryResults", conversationSummaryResults},
-            {"conversationPiiResults",
+            writer.BeginObject();
+            for (const auto& [key, field] : { std::pair { "display", "text" }, std::pair { "itn", "itn" }, std::pair { "lexical", "lexical" } })
+            {
+                writer.Key(key).BeginArray();
+                for (size_t index = 0; index < order.size(); index++)
                 {
-                    {"combinedRedactedContent", combinedRedactedContent},
-                    {"conversations", conversation}
+                    if (channel == transcriptionPhrases.speakerNumbers[index])
+                    {
+                        writer.Value(conversationItems[order[index]]["redactedContent"][field]);
+                    }
                 }
+                writer.EndArray();
             }
-        };
+            writer.EndObject();
+        }
+        writer.EndArray();
+
+        writer.Key("conversations").BeginObject();
+        for (const auto& field : conversation.items())
+        {
+            if ("conversationItems" != field.key())
+            {
+                writer.Key(field.key()).Value(field.value());
+                continue;
+            }
+            writer.Key("conversationItems").BeginArray();
+            for (size_t index = 0; index < order.size(); index++)
+            {
+                // Copy one item at a time to add the channel and offset from the corresponding transcription phrase.
+                nlohmann::json item = conversationItems[order[index]];
+                item["channel"] = transcriptionPhrases.speakerNumbers[index];
+                item["offset"] = transcriptionPhrases.Offset(index);
+                writer.Value(item);
+            }
+            writer.EndArray();
+        }
+        writer.EndObject();
+        writer.EndObject();
+
+        writer.Field("conversationSummaryResults", conversationSummaryResults);
+        writer.EndObject();
     }
     
-    void PrintFullOutput(std::string outputFilePathValue, nlohmann::json transcription, std::vector<nlohmann::json> sentimentConfidenceScores, std::vector<nlohmann::json> transcriptionPhrases, nlohmann::json conversationAnalysis)
+    void PrintFullOutput(std::string outputFilePathValue, const PhraseSentiments& sentimentAnalysis, const TranscriptionPhrases& transcriptionPhrases, const nlohmann::json& conversationAnalysis)
+    {
+        std::lock_guard<std::mutex> lock(m_outputMutex);
+        std::ofstream outputStream;
+        outputStream.open(outputFilePathValue, std::ios_base::app);
+        OutputWriter output(outputStream);
+        JsonWriter writer(output);
+        writer.BeginObject();
+        writer.Key("conversationAnalyticsResults");
+        WriteConversationAnalysisForFullOutput(writer, transcriptionPhrases, conversationAnalysis);
+        writer.Key("transcription");
+        WriteTranscriptionForFullOutput(writer, transcriptionPhrases, sentimentAnalysis);
+        writer.EndObject();
+    }
+
+    // Append the phrases, sentiment and PII entities of one call to the --parquetOutput files, as one row group each.
+    void WriteParquetOutput(const TranscriptionPhrases& transcriptionPhrases, const PhraseSentiments& sentimentAnalysis, const nlohmann::json& conversationAnalysis)
+    {
+        const std::string_view call = transcriptionPhrases.source;
+        ParquetWriter::RowGroup phrases = m_phrasesParquet->NewRowGroup();
+        for (size_t index = 0; index < transcriptionPhrases.Size(); index++)
+        {
+            bool hasSentiment = index < sentimentAnalysis.Size();
+            phrases.Add(PhraseCall, call)
+                .Add(PhraseId, static_cast<int32_t>(transcriptionPhrases.ids[index]))
+                .Add(PhraseChannel, static_cast<int32_t>(transcriptionPhrases.channels[index]))
+                .Add(PhraseSpeaker, static_cast<int32_t>(transcriptionPhrases.speakers[index]))
+                .Add(PhraseOffsetInTicks, transcriptionPhrases.offsetsInTicks[index])
+                .Add(PhraseDurationInTicks, transcriptionPhrases.durationsInTicks[index])
+                .Add(PhraseConfidence, transcriptionPhrases.confidences[index])
+                .Add(PhraseText, transcriptionPhrases.Text(index))
+                .Add(PhraseItn, transcriptionPhrases.Itn(index))
+                .Add(PhraseLexical, transcriptionPhrases.Lexical(index))
+                .Add(PhraseMaskedItn, transcriptionPhrases.MaskedItn(index))
+                .Add(PhraseSentiment, std::string_view(PhraseSentiments::SentimentToString(hasSentiment ? sentimentAnalysis.sentiments[index] : Sentiment::Neutral)))
+                .Add(PhrasePositiveScore, hasSentiment ? sentimentAnalysis.positiveScores[index] : 0.0)
+                .Add(PhraseNeutralScore, hasSentiment ? sentimentAnalysis.neutralScores[index] : 0.0)
+                .Add(PhraseNegativeScore, hasSentiment ? sentimentAnalysis.negativeScores[index] : 0.0);
+        }
+        m_phrasesParquet->WriteRowGroup(phrases);
+
+        const nlohmann::json& PIITask = JsonHelper::FirstWhere([](const nlohmann::json& task) -> bool {
+            return StringHelper::CaseInsensitiveCompare("pii_1", task["taskName"].get<std::string>());
+        }, conversationAnalysis["tasks"]["items"], "pii_1 task");
+        ParquetWriter::RowGroup entities = m_piiParquet->NewRowGroup();
+        for (const auto& conversationItem : PIITask["results"]["conversations"][0]["conversationItems"])
+        {
+            // Conversation item IDs are phrase IDs. See TranscriptionPhrasesToConversationItems.
+            int32_t phrase = std::stoi(conversationItem["id"].get<std::string>());
+            for (const auto& entity : conversationItem["entities"])
+            {
+                entities.Add(PiiCall, call)
+                    .Add(PiiPhrase, phrase)
+                    .Add(PiiCategory, std::string_view(entity["category"].get_ref<const std::string&>()))
+                    .Add(PiiText, std::string_view(entity["text"].get_ref<const std::string&>()))
+                    .Add(PiiOffset, entity.value("offset", static_cast<int32_t>(0)))
+                    .Add(PiiLength, entity.value("length", static_cast<int32_t>(0)))
+                    .Add(PiiConfidence, entity.value("confidenceScore", 0.0));
+            }
+        }
+        m_piiParquet->WriteRowGroup(entities);
+    }
+
+    // Upload the input file if there is one, start batch transcription and wait for it. Return the transcription ID.
+    // If *checkpoints* has the ID of an earlier transcription of this call, wait for that one instead, and only
+    // start over if it failed or no longer exists.
+    std::string Transcribe(const std::optional<std::string>& inputAudioURL, const CheckpointStore* checkpoints, PipelineStats* stats)
+    {
+        PipelineStats::StageTimer timer(stats, "Transcription");
+        std::optional<std::string> savedTranscriptionId = (checkpoints && m_userConfig->resume) ? checkpoints->LoadTranscriptionId() : std::nullopt;
+        if (savedTranscriptionId.has_value())
+        {
+            try
+            {
+                WaitForTranscription(savedTranscriptionId.value());
+                return savedTranscriptionId.value();
+            }
+            catch (const std::exception& e)
+            {
+                if (Verbose())
+                {
+                    std::cout << "Unable to resume transcription " << savedTranscriptionId.value() << ", so starting a new one. " << e.what() << std::endl;
+                }
+            }
+        }
+
+        // Batch transcription only accepts URLs, so upload a local file first.
+        std::string audioURL;
+        if (m_uploader)
+        {
+            PipelineStats::StageTimer uploadTimer(stats, "Upload");
+            BlobUploader::UploadResult upload = m_uploader->Upload(m_userConfig->uploadFilePath.value());
+            audioURL = upload.url;
+            if (Verbose())
+            {
+                std::cout << "Uploaded " << upload.bytes << " bytes in " << upload.blocks << " blocks in " << upload.seconds << " seconds ("
+                    << upload.bytes / 1048576.0 / std::max(upload.seconds, 0.001) << " MB/s)." << std::endl;
+            }
+        }
+        else
+        {
+            audioURL = inputAudioURL.value();
+        }
+
+        // How to use batch transcription:
+        // https://github.com/MicrosoftDocs/azure-docs/blob/main/articles/cognitive-services/Speech-Service/batch-transcription.md
+        std::string transcriptionId = CreateTranscription({ audioURL });
+        if (checkpoints)
+        {
+            checkpoints->SaveTranscriptionId(transcriptionId);
+        }
+        WaitForTranscription(transcriptionId);
+        return transcriptionId;
+    }
+
+    // Return the checkpoints for the call with *callInput*, for example its audio URL, or null if --checkpointDirectory is not present.
+    std::unique_ptr<CheckpointStore> OpenCheckpoints(const std::string& callInput)
+    {
+        if (!m_userConfig->checkpointDirectory.has_value())
+        {
+            return nullptr;
+        }
+        return std::make_unique<CheckpointStore>(m_userConfig->checkpointDirectory.value(), callInput);
+    }
+
+    void ReportResumed(const char* stage)
+    {
+        if (Verbose())
+        {
+            std::cout << "Resumed " << stage << " from checkpoint." << std::endl;
+        }
+    }
+
+    // Run the stages that follow transcription for one call: sentiment analysis, conversation analysis and output.
+    // If *resume* is true, skip stages that have a checkpoint.
+    void AnalyzeCall(const TranscriptionPhrases& phrases, const CheckpointStore* checkpoints, bool resume, PipelineStats* stats)
     {
-        nlohmann::json results =
+        // Each stage depends on the ones before it, so once a stage runs again, later stages run again too.
+        PhraseSentiments sentimentAnalysis;
+        std::optional<PhraseSentiments> savedSentiments = resume ? checkpoints->LoadSentiments(phrases.Size()) : std::nullopt;
+        if (savedSentiments.has_value())
+        {
+            sentimentAnalysis = std::move(savedSentiments.value());
+            ReportResumed("sentiment analysis");
+        }
+        else
+        {
+            {
+                PipelineStats::StageTimer timer(stats, "Sentiment analysis");
+                sentimentAnalysis = GetSentimentAnalysis(phrases);
+            }
+            if (checkpoints)
+            {
+                checkpoints->SaveSentiments(sentimentAnalysis);
+            }
+            resume = false;
+        }
+
+        nlohmann::json conversationAnalysis;
+        std::optional<nlohmann::json> savedConversationAnalysis = resume ? checkpoints->LoadConversationAnalysis() : std::nullopt;
+        if (savedConversationAnalysis.has_value())
+        {
+            conversationAnalysis = std::move(savedConversationAnalysis.value());
+            ReportResumed("conversation analysis");
+        }
+        else
         {
-            {"transcription", MergeSentimentConfidenceScoresIntoTranscription(transcription, sentimentConfidenceScores)},
-            {"conversationAnalyticsResults", GetConversationAnalysisForFullOutput(transcriptionPhrases, conversationAnalysis)}
+            {
+                PipelineStats::StageTimer timer(stats, "Conversation analysis");
+                conversationAnalysis = AnalyzeConversation(TranscriptionPhrasesToConversationItems(phrases));
+            }
+            if (checkpoints)
+            {
+                checkpoints->SaveConversationAnalysis(conversationAnalysis);
+            }
+        }
+
+        PipelineStats::StageTimer timer(stats, "Output");
+        if (Verbose())
+        {
+            PrintSimpleOutput(std::cout, phrases, sentimentAnalysis, conversationAnalysis);
+        }
+        else
+        {
+            // Write the simple output to a stream with no buffer, which discards it, so the benchmark includes its cost.
+            std::ostream discard(nullptr);
+            PrintSimpleOutput(discard, phrases, sentimentAnalysis, conversationAnalysis);
+        }
+        if (m_userConfig->outputFilePath.has_value())
+        {
+            PrintFullOutput(m_userConfig->outputFilePath.value(), sentimentAnalysis, phrases, conversationAnalysis);
+        }
+        if (m_phrasesParquet)
+        {
+            WriteParquetOutput(phrases, sentimentAnalysis, conversationAnalysis);
+        }
+    }
+
+    // Run the pipeline for one call, from transcription to output.
+    // If *stats* is not null, record how long each stage takes.
+    // With --checkpointDirectory, save the result of each stage. With --resume, skip stages that were saved before.
+    void ProcessCall(const std::optional<std::string>& inputAudioURL, PipelineStats* stats)
+    {
+        // Name each call's checkpoints for its input, so they are found again when the same call is rerun.
+        std::unique_ptr<CheckpointStore> checkpoints = OpenCheckpoints(m_userConfig->inputFilePath.has_value() ? m_userConfig->inputFilePath.value()
+            : m_userConfig->uploadFilePath.has_value() ? std::filesystem::absolute(m_userConfig->uploadFilePath.value()).string()
+            : inputAudioURL.value());
+        bool resume = checkpoints && m_userConfig->resume;
+
+        TranscriptionPhrases phrases;
+        std::optional<TranscriptionPhrases> savedPhrases = resume ? checkpoints->LoadPhrases() : std::nullopt;
+        if (savedPhrases.has_value())
+        {
+            phrases = std::move(savedPhrases.value());
+            ReportResumed("transcription");
+        }
+        else
+        {
+            if (m_userConfig->inputFilePath.has_value())
+            {
+                PipelineStats::StageTimer timer(stats, "Read JSON input");
+                phrases = TranscriptionReader::ReadFile(m_userConfig->inputFilePath.value(), m_userConfig->outputFilePath.has_value());
+            }
+            else
+            {
+                std::string transcriptionId = Transcribe(inputAudioURL, checkpoints.get(), stats);
+                if (Verbose())
+                {
+                    std::cout << "Transcription ID: " << transcriptionId << std::endl;
+                }
+                PipelineStats::StageTimer timer(stats, "Transcription download");
+                std::string transcriptionUri = GetTranscriptionUris(transcriptionId, 1)[0];
+                if (transcriptionUri.empty())
+                {
+                    throw std::exception("The transcription has no result file.");
+                }
+                if (Verbose())
+                {
+                    std::cout << "Transcription URI: " << transcriptionUri << std::endl;
+                }
+                phrases = GetTranscription(transcriptionUri);
+            }
+            if (checkpoints)
+            {
+                checkpoints->SavePhrases(phrases);
+            }
+            resume = false;
+        }
+
+        AnalyzeCall(phrases, checkpoints.get(), resume, stats);
+    }
+
+    // Run the pipeline for several calls, transcribing them all with one batch transcription job, so the calls share
+    // the job's overhead and one job is polled instead of one per call. Then analyze each call in turn.
+    // A call that fails does not stop the others. Return the number of calls that failed.
+    size_t ProcessCallGroup(const std::vector<std::string>& inputAudioURLs, PipelineStats* stats)
+    {
+        std::vector<std::unique_ptr<CheckpointStore>> checkpoints;
+        std::vector<std::optional<TranscriptionPhrases>> phrases(inputAudioURLs.size());
+        // The calls that still need to be transcribed.
+        std::vector<size_t> pending;
+        for (size_t call = 0; call < inputAudioURLs.size(); call++)
+        {
+            checkpoints.push_back(OpenCheckpoints(inputAudioURLs[call]));
+            if (checkpoints[call] && m_userConfig->resume)
+            {
+                phrases[call] = checkpoints[call]->LoadPhrases();
+            }
+            if (!phrases[call].has_value())
+            {
+                pending.push_back(call);
+            }
+        }
+
+        std::vector<std::string> transcriptionUris;
+        if (!pending.empty())
+        {
+            std::vector<std::string> pendingURLs;
+            for (size_t call : pending)
+            {
+                pendingURLs.push_back(inputAudioURLs[call]);
+            }
+            std::string transcriptionId;
+            {
+                PipelineStats::StageTimer timer(stats, "Transcription");
+                transcriptionId = CreateTranscription(pendingURLs);
+                WaitForTranscription(transcriptionId);
+            }
+            if (Verbose())
+            {
+                std::cout << "Transcription ID: " << transcriptionId << " (" << pending.size() << " recordings)" << std::endl;
+            }
+            PipelineStats::StageTimer timer(stats, "Transcription files");
+            transcriptionUris = GetTranscriptionUris(transcriptionId, pending.size());
+        }
+
+        size_t failedCalls = 0;
+        size_t nextPending = 0;
+        for (size_t call = 0; call < inputAudioURLs.size(); call++)
+        {
+            try
+            {
+                if (Verbose())
+                {
+                    std::cout << "Call: " << inputAudioURLs[call] << std::endl;
+                }
+                bool resume = phrases[call].has_value();
+                if (resume)
+                {
+                    ReportResumed("transcription");
+                }
+                else
+                {
+                    // The result files are in the same order as the recordings in the job.
+                    const std::string& transcriptionUri = transcriptionUris[nextPending++];
+                    if (transcriptionUri.empty())
+                    {
+                        throw std::exception("The transcription job has no result file for this recording.");
+                    }
+                    PipelineStats::StageTimer timer(stats, "Transcription download");
+                    phrases[call] = GetTranscription(transcriptionUri);
+                    if (checkpoints[call])
+                    {
+                        checkpoints[call]->SavePhrases(phrases[call].value());
+                    }
+                }
+                AnalyzeCall(phrases[call].value(), checkpoints[call].get(), resume, stats);
+            }
+            catch (const std::exception& e)
+            {
+                failedCalls++;
+                std::lock_guard<std::mutex> lock(m_outputMutex);
+                std::cout << "Call " << inputAudioURLs[call] << " failed: " << e.what() << std::endl;
+            }
+            // Free the phrases of each call once it is analyzed.
+            phrases[call].reset();
+        }
+        return failedCalls;
+    }
+
+    // Transcribe a local WAV file with streaming transcription, and analyze the sentiment of phrases as they are
+    // recognized, so results appear seconds after each utterance instead of after the whole call is processed.
+    // Conversation analysis (PII and summary) needs the whole conversation, so it runs when transcription ends.
+    // Phrases are written in the order they are recognized. With --stereo, each channel is transcribed by its own
+    // recognizer at the same time, so when transcription ends the phrases of both channels are merged by offset,
+    // as batch transcription returns them, before conversation analysis.
+    void ProcessCallRealTime(const std::string& audioFilePath)
+    {
+        using Clock = std::chrono::steady_clock;
+        struct QueuedPhrase
+        {
+            PhraseRecord record;
+            Clock::time_point recognizedAt;
         };
-        
-        std::ofstream outputStream;
-        outputStream.open(this->m_userConfig->outputFilePath.value(), std::ios_base::app);
-        outputStream << results.dump(2);
-        outputStream.close();
+
+        // Phrases recognized on Speech SDK threads, waiting for the loop below.
+        std::mutex queueMutex;
+        std::condition_variable queueChanged;
+        std::vector<QueuedPhrase> queue;
+        bool transcriptionDone = false;
+        std::exception_ptr transcriptionError;
+
+        auto speechConfig = Microsoft::CognitiveServices::Speech::SpeechConfig::FromSubscription(m_userConfig->speechSubscriptionKey.value(), m_userConfig->speechRegion.value());
+        speechConfig->SetSpeechRecognitionLanguage(m_userConfig->locale);
+        // The detailed output format includes the lexical, ITN and masked ITN forms of each phrase.
+        speechConfig->SetOutputFormat(Microsoft::CognitiveServices::Speech::OutputFormat::Detailed);
+        RealTimeTranscriber transcriber(speechConfig, audioFilePath, m_userConfig->useStereoAudio, [&](PhraseRecord&& phrase)
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(QueuedPhrase { std::move(phrase), Clock::now() });
+            queueChanged.notify_one();
+        });
+        std::thread transcriptionThread([&]()
+        {
+            try
+            {
+                TraceSpan span("Real-time transcription", "stage");
+                transcriber.Run();
+            }
+            catch (...)
+            {
+                transcriptionError = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(queueMutex);
+            transcriptionDone = true;
+            queueChanged.notify_one();
+        });
+        // If analysis below throws, stop transcription and wait for it, since it uses the transcriber and the queue.
+        struct TranscriptionThreadJoiner
+        {
+            RealTimeTranscriber& transcriber;
+            std::thread& thread;
+            ~TranscriptionThreadJoiner()
+            {
+                if (thread.joinable())
+                {
+                    transcriber.Stop();
+                    thread.join();
+                }
+            }
+        } transcriptionThreadJoiner { transcriber, transcriptionThread };
+
+        TranscriptionPhrases phrases;
+        // Batch transcription sets the source to the audio URL. Use the audio file path, so the call is identified in the output.
+        phrases.source = audioFilePath;
+        PhraseSentiments sentiments;
+        std::vector<Clock::time_point> recognizedAt;
+        // Phrases [0, analyzed) have been analyzed and written.
+        size_t analyzed = 0;
+        PipelineStats stats;
+        OutputWriter output(std::cout);
+        const nlohmann::json noPIIAnalysis = nlohmann::json::array();
+        bool done = false;
+        while (!done)
+        {
+            std::vector<QueuedPhrase> arrived;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                size_t pending = phrases.Size() - analyzed;
+                if (0 == pending)
+                {
+                    queueChanged.wait(lock, [&]() { return transcriptionDone || !queue.empty(); });
+                }
+                else
+                {
+                    // Wait for a full batch, but not past the time the oldest pending phrase is due.
+                    queueChanged.wait_until(lock, recognizedAt[analyzed] + realTimeBatchDelay, [&]() { return transcriptionDone || pending + queue.size() >= sentimentBatchSize; });
+                }
+                arrived.swap(queue);
+                done = transcriptionDone;
+            }
+            for (auto& phrase : arrived)
+            {
+                phrases.Add(phrase.record);
+                recognizedAt.push_back(phrase.recognizedAt);
+            }
+            sentiments.Resize(phrases.Size());
+
+            while (phrases.Size() - analyzed >= sentimentBatchSize
+                || (phrases.Size() > analyzed && (done || Clock::now() >= recognizedAt[analyzed] + realTimeBatchDelay)))
+            {
+                size_t end = std::min(analyzed + sentimentBatchSize, phrases.Size());
+                AnalyzeSentiment(phrases, analyzed, end, sentiments);
+                for (size_t index = analyzed; index < end; index++)
+                {
+                    WritePhraseOutput(output, phrases, sentiments, noPIIAnalysis, index);
+                    stats.Record("Recognized to sentiment", std::chrono::duration<double, std::milli>(Clock::now() - recognizedAt[index]).count());
+                }
+                output.Flush();
+                std::cout.flush();
+                analyzed = end;
+            }
+        }
+        transcriptionThread.join();
+        if (transcriptionError)
+        {
+            std::rethrow_exception(transcriptionError);
+        }
+        if (0 == phrases.Size())
+        {
+            std::cout << "No speech was recognized." << std::endl;
+            return;
+        }
+        if (m_userConfig->useStereoAudio)
+        {
+            sentiments.Reorder(phrases.SortByOffset());
+        }
+
+        nlohmann::json conversationAnalysis;
+        {
+            TraceSpan span("Conversation analysis", "stage");
+            conversationAnalysis = AnalyzeConversation(TranscriptionPhrasesToConversationItems(phrases));
+        }
+        nlohmann::json conversation = GetConversationAnalysisForSimpleOutput(conversationAnalysis);
+        const nlohmann::json& conversationPIIAnalysis = conversation["conversationPIIAnalysis"];
+        output.Write("Recognized entities (PII):\n");
+        for (size_t index = 0; index < conversationPIIAnalysis.size() && index < phrases.Size(); index++)
+        {
+            for (const auto& entity : conversationPIIAnalysis[index])
+            {
+                output.Write("    Phrase ").Write(static_cast<int64_t>(phrases.ids[index]))
+                    .Write(". Category: ").WriteJsonString(entity["category"].get_ref<const std::string&>())
+                    .Write(". Text: ").WriteJsonString(entity["text"].get_ref<const std::string&>()).Write(".\n");
+            }
+        }
+        WriteConversationSummary(output, conversation);
+        output.Write('\n');
+        output.Flush();
+        stats.Report(std::cout);
+
+        if (m_userConfig->outputFilePath.has_value())
+        {
+            PrintFullOutput(m_userConfig->outputFilePath.value(), sentiments, phrases, conversationAnalysis);
+        }
+        if (m_phrasesParquet)
+        {
+            WriteParquetOutput(phrases, sentiments, conversationAnalysis);
+        }
     }
 };
 
+// Push --benchmark N calls through the pipeline, --concurrency at a time, and report per-stage latency and throughput.
+// Use this with stand_in_service.py to measure pipeline and RestHelper changes without a network or service quota.
+void RunBenchmark(std::shared_ptr<CallCenter> callCenter, std::shared_ptr<UserConfig> userConfig)
+{
+    const int calls = userConfig->benchmarkCalls.value();
+    PipelineStats stats;
+    std::atomic<int> nextCall = 0;
+    std::atomic<int> failedCalls = 0;
+
+    // Without --input, each call gets its own synthetic audio URL, which the stand-in service accepts.
+    auto inputAudioURLFor = [&](int call) -> std::string {
+        return userConfig->inputAudioURL.has_value()
+            ? userConfig->inputAudioURL.value()
+            : "https://localhost/synthetic_call_" + std::to_string(call) + ".wav";
+    };
+    // Calls are grouped into multi-recording transcription jobs unless they are read from JSON or uploaded.
+    const int callsPerJob = (userConfig->inputFilePath.has_value() || userConfig->uploadFilePath.has_value()) ? 1 : userConfig->callsPerJob;
+
+    std::cout << "Running " << calls << " calls, " << userConfig->benchmarkConcurrency << " at a time";
+    if (callsPerJob > 1)
+    {
+        std::cout << ", " << callsPerJob << " per transcription job";
+    }
+    std::cout << "." << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int worker = 0; worker < userConfig->benchmarkConcurrency; worker++)
+    {
+        workers.emplace_back([&]()
+        {
+            if (callsPerJob > 1)
+            {
+                for (int firstCall = nextCall.fetch_add(callsPerJob); firstCall < calls; firstCall = nextCall.fetch_add(callsPerJob))
+                {
+                    std::vector<std::string> inputAudioURLs;
+                    for (int call = firstCall; call < std::min(calls, firstCall + callsPerJob); call++)
+                    {
+                        inputAudioURLs.push_back(inputAudioURLFor(call));
+                    }
+                    try
+                    {
+                        auto jobStart = std::chrono::steady_clock::now();
+                        failedCalls += static_cast<int>(callCenter->ProcessCallGroup(inputAudioURLs, &stats));
+                        stats.Record("Total per job", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - jobStart).count());
+                    }
+                    catch (const std::exception& e)
+                    {
+                        failedCalls += static_cast<int>(inputAudioURLs.size());
+                        std::cout << "Job for calls " << firstCall << " to " << firstCall + inputAudioURLs.size() - 1 << " failed: " << e.what() << std::endl;
+                    }
+                }
+                return;
+            }
+            for (int call = nextCall++; call < calls; call = nextCall++)
+            {
+                std::optional<std::string> inputAudioURL = inputAudioURLFor(call);
+                try
+                {
+                    TraceSpan span("Call " + std::to_string(call), "call");
+                    auto callStart = std::chrono::steady_clock::now();
+                    callCenter->ProcessCall(inputAudioURL, &stats);
+                    stats.Record("Total", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - callStart).count());
+                }
+                catch (const std::exception& e)
+                {
+                    failedCalls++;
+                    std::cout << "Call " << call << " failed: " << e.what() << std::endl;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "\nCalls: " << calls << " (" << failedCalls << " failed)\n";
+    std::cout << "Wall-clock time: " << seconds << " seconds\n";
+    std::cout << "Throughput: " << (calls - failedCalls) / seconds << " calls per second, " << 60.0 * (calls - failedCalls) / seconds << " calls per minute\n\n";
+    stats.Report(std::cout);
+    std::cout << "\n";
+    RestHelper::ReportRateControl(std::cout);
+    if (userConfig->webhookPort.has_value())
+    {
+        std::cout << "Web hook callbacks received: " << callCenter->WebhookCallbackCount() << std::endl;
+    }
+}
+
+// Process each recording listed in --inputList, --callsPerJob recordings per transcription job.
+void RunInputList(std::shared_ptr<CallCenter> callCenter, std::shared_ptr<UserConfig> userConfig)
+{
+    std::ifstream input(userConfig->inputListPath.value());
+    if (!input.good())
+    {
+        throw std::exception(std::string("Unable to open input list: " + userConfig->inputListPath.value()).c_str());
+    }
+    std::vector<std::string> inputAudioURLs;
+    std::string line;
+    while (std::getline(input, line))
+    {
+        std::string_view url = StringHelper::Trim(line);
+        if (!url.empty() && '#' != url[0])
+        {
+            inputAudioURLs.emplace_back(url);
+        }
+    }
+
+    size_t failedCalls = 0;
+    for (size_t firstCall = 0; firstCall < inputAudioURLs.size(); firstCall += userConfig->callsPerJob)
+    {
+        std::vector<std::string> group(inputAudioURLs.begin() + firstCall, inputAudioURLs.begin() + std::min(inputAudioURLs.size(), firstCall + userConfig->callsPerJob));
+        try
+        {
+            failedCalls += callCenter->ProcessCallGroup(group, nullptr);
+        }
+        catch (const std::exception& e)
+        {
+            failedCalls += group.size();
+            std::cout << "Transcription job for " << group.size() << " calls failed: " << e.what() << std::endl;
+        }
+    }
+    std::cout << "Processed " << inputAudioURLs.size() << " calls (" << failedCalls << " failed)." << std::endl;
+}
+
 int main(int argc, char* argv[])
 {    
     const std::string usage = "Usage: call_center.exe [...]\n\n"
@@ -591,12 +1694,80 @@ int main(int argc, char* argv[])
 "                                    Default: en-US\n\n"
 "  INPUT\n"
 "    --input URL                     Input audio from URL.\n"
-"                                    Required unless --jsonInput is present.\n"
+"                                    Required unless --jsonInput or --inputFile is present.\n"
 "    --jsonInput FILE                Input JSON Speech batch transcription result from FILE. Overrides --input.\n"
+"    --inputList FILE                Process each audio URL in FILE, one per line. Lines that start with # are ignored.\n"
+"    --callsPerJob N                 Transcribe up to N recordings from --inputList or --benchmark with one batch\n"
+"                                    transcription job, which saves the job overhead and status polling of N-1\n"
+"                                    jobs. Each recording is still analyzed and output separately. Default: 1\n"
+"    --inputFile FILE                Upload the local audio FILE to --blobContainer, and transcribe it from there.\n"
+"                                    Overrides --input.\n"
+"    --blobContainer URL             The URL of a blob container to upload --inputFile to, with a shared access\n"
+"                                    signature that allows writing and reading blobs. You can use Azurite or\n"
+"                                    stand_in_service.py, for example http://localhost:8080/devstoreaccount1/calls\n"
+"    --uploadBlockMegabytes N        Upload --inputFile in blocks of N MB. Default: 4\n"
+"    --uploadConcurrency N           Upload up to N blocks at once. At most N blocks are held in memory. Default: 4\n"
 "    --stereo                        Use stereo audio format.\n"
-"                                    If this is not present, mono is assumed.\n\n"
+"                                    If this is not present, mono is assumed.\n"
+"    --realTime                      Transcribe --input, which must be the path to a 16-bit PCM WAV file, with\n"
+"                                    streaming transcription, and print each phrase with its sentiment as soon as\n"
+"                                    it is recognized. With --stereo, each channel is transcribed separately.\n"
+"                                    Requires --speechRegion.\n\n"
 "  OUTPUT\n"
-"    --output FILE                   Output phrase list and conversation summary to text file.\n";
+"    --output FILE                   Output phrase list and conversation summary to text file.\n"
+"    --parquetOutput DIRECTORY       Also write the results of each call to Apache Parquet files in DIRECTORY, for\n"
+"                                    analytics tools: phrases.parquet has a row for each phrase, with its speaker,\n"
+"                                    offset, text and sentiment scores, and pii_entities.parquet has a row for each\n"
+"                                    PII entity. Each call is appended as one row group.\n\n"
+"  CONVERSATION ANALYSIS\n"
+"    --conversationShardCharacters N Split conversations longer than N characters of request JSON into overlapping\n"
+"                                    windows, analyze them concurrently, and merge the results. Default: 100000\n\n"
+"  BENCHMARK\n"
+"    --benchmark N                   Run N calls through the pipeline and report per-stage latency percentiles\n"
+"                                    and throughput instead of printing results. Without --input or --jsonInput,\n"
+"                                    each call uses a synthetic audio URL, so use this with stand_in_service.py.\n"
+"    --concurrency N                 How many calls to process at once with --benchmark. Default: 1\n"
+"    --speechEndpoint ENDPOINT       Use ENDPOINT instead of the endpoint for --speechRegion,\n"
+"                                    for example http://localhost:8080 for stand_in_service.py.\n"
+"    --pollIntervalMs MILLISECONDS   How long to wait between transcription and conversation analysis status requests.\n"
+"                                    Default: 10000\n\n"
+"  CACHE\n"
+"    --cacheDirectory DIRECTORY      Cache sentiment and conversation analysis results in DIRECTORY, and reuse them\n"
+"                                    instead of sending the same request again.\n"
+"    --cacheMaxMegabytes MEGABYTES   When the cache grows past this size, remove the least recently used results.\n"
+"                                    Default: 256\n\n"
+"  RATE CONTROL\n"
+"    --speechRequestsPerSecond RATE  Send at most RATE requests per second to the Speech endpoint.\n"
+"    --languageRequestsPerSecond RATE\n"
+"                                    Send at most RATE requests per second to the Language endpoint.\n"
+"                                    Set these to the quota of your pricing tier. Default: no limit\n"
+"    --maxRetries N                  How many times to retry a request that is throttled or fails with a transient error.\n"
+"                                    Retries honor Retry-After. Default: 5\n\n"
+"  COMPRESSION\n"
+"    --compressRequests              Send sentiment and conversation analysis requests of 1 KB or more gzip-compressed,\n"
+"                                    with Content-Encoding: gzip. Use this only if your Language endpoint, or a proxy\n"
+"                                    in front of it, accepts compressed requests. Responses are always requested with\n"
+"                                    Accept-Encoding and decompressed as they arrive.\n\n"
+"  CHECKPOINTS\n"
+"    --checkpointDirectory DIRECTORY Save the result of each stage of each call (transcription, sentiment analysis\n"
+"                                    and conversation analysis) in a directory for the call under DIRECTORY.\n"
+"                                    With --benchmark, only synthetic calls can be checkpointed.\n"
+"    --resume                        Skip the stages of a call that were saved in --checkpointDirectory by an\n"
+"                                    earlier run, for example one that failed partway through. A transcription\n"
+"                                    that was started but not downloaded is waited for rather than started again.\n\n"
+"  WEB HOOKS\n"
+"    --webhookPort PORT              Listen on PORT for transcription completion callbacks from the Speech service,\n"
+"                                    and check a transcription's status when its callback arrives instead of every\n"
+"                                    --pollIntervalMs. The web hook is registered at startup and deleted at exit.\n"
+"    --webhookUrl URL                The public URL the Speech service sends callbacks to, which must forward to\n"
+"                                    PORT. Default: http://localhost:PORT/, which works with stand_in_service.py.\n"
+"    --webhookTimeoutMs MILLISECONDS How long to wait for a callback before checking the status anyway. After that,\n"
+"                                    the status is checked every --pollIntervalMs, or when a late callback arrives.\n"
+"                                    Default: the value of --pollIntervalMs\n\n"
+"  TRACING\n"
+"    --trace FILE                    Write a trace of each pipeline stage and HTTP request, including DNS, connect,\n"
+"                                    TLS, time to first byte and transfer times, to FILE. Open it in\n"
+"                                    chrome://tracing or https://ui.perfetto.dev\n";
 
     try
     {
@@ -607,42 +1778,32 @@ int main(int argc, char* argv[])
         else
         {
             std::shared_ptr<UserConfig> userConfig = UserConfigFromArgs(argc, argv, usage);
+            if (userConfig->traceFilePath.has_value())
+            {
+                TraceHelper::Enable();
+            }
             auto callCenter = std::make_shared<CallCenter>(userConfig);
-
-            nlohmann::json transcription;
-            if (userConfig->inputFilePath.has_value())
+            if (userConfig->benchmarkCalls.has_value())
+            {
+                RunBenchmark(callCenter, userConfig);
+            }
+            else if (userConfig->inputListPath.has_value())
             {
-                std::ifstream f(userConfig->inputFilePath.value());
-                transcription = nlohmann::json::parse(f);
+                RunInputList(callCenter, userConfig);
+            }
+            else if (userConfig->realTime)
+            {
+                callCenter->ProcessCallRealTime(userConfig->inputAudioURL.value());
             }
             else
             {
-                // How to use batch transcription:
-                // https://github.com/MicrosoftDocs/azure-docs/blob/main/articles/cognitive-services/Speech-Service/batch-transcription.md
-                std::string transcriptionId = callCenter->CreateTranscription(userConfig->inputAudioURL.value());
-                callCenter->WaitForTranscription(transcriptionId);
-                std::cout << "Transcription ID: " << transcriptionId << std::endl;
-                std::shared_ptr<RestResult> transcriptionFiles = callCenter->GetTranscriptionFiles(transcriptionId);
-                std::string transcriptionUri = callCenter->GetTranscriptionUri(transcriptionFiles);
-                std::cout << "Transcription URI: " << transcriptionUri << std::endl;
-                transcription = callCenter->GetTranscription(transcriptionUri);
-            }
-            
-            // For stereo audio, the phrases are sorted by channel number, so resort them by offset.
-            transcription["recognizedPhrases"] = JsonHelper::SortBy([](nlohmann::json phrase_1, nlohmann::json phrase_2) -> bool { return phrase_1["offsetInTicks"] < phrase_2["offsetInTicks"]; }, transcription["recognizedPhrases"]);
-            nlohmann::json phrases = callCenter->GetTranscriptionPhrases(transcription);
-            nlohmann::json sentimentAnalysis = callCenter->GetSentimentAnalysis(phrases);
-            std::vector<nlohmann::json> sentimentConfidenceScores = callCenter->GetSentimentConfidenceScores(sentimentAnalysis);
-            nlohmann::json conversationItems = callCenter->TranscriptionPhrasesToConversationItems(phrases);
-            // NOTE: Conversation summary is currently in gated public preview. You can sign up here:
-            // https://aka.ms/applyforconversationsummarization/
-            std::string conversationAnalysisUrl = callCenter->RequestConversationAnalysis(conversationItems);
-            callCenter->WaitForConversationAnalysis(conversationAnalysisUrl);
-            nlohmann::json conversationAnalysis = callCenter->GetConversationAnalysis(conversationAnalysisUrl);
-            callCenter->PrintSimpleOutput(phrases, sentimentAnalysis, conversationAnalysis);
-            if (userConfig->outputFilePath.has_value())
-            {
-                callCenter->PrintFullOutput(userConfig->outputFilePath.value(), transcription, sentimentConfidenceScores, phrases, conversationAnalysis);
+                callCenter->ProcessCall(userConfig->inputAudioURL, nullptr);
+            }
+            callCenter->PrintReport();
+            if (userConfig->traceFilePath.has_value())
+            {
+                TraceHelper::WriteFile(userConfig->traceFilePath.value());
+                std::cout << "Trace written to " << userConfig->traceFilePath.value() << "." << std::endl;
             }
         }
     }
@@ -0,0 +1,362 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+// You can download json.hpp from:
+// https://github.com/nlohmann/json/releases
+#include "json.hpp"
+#include "response_cache.h"
+#include "transcription_phrases.h"
+
+// Saves the result of each pipeline stage of one call to a checkpoint directory, so a call that fails partway
+// through can be resumed from the last completed stage instead of starting over. Stages are saved as:
+// - transcription.id: the batch transcription ID, as text. Resuming waits for the same transcription.
+// - phrases.bin: the TranscriptionPhrases columns and string arena, as raw arrays.
+// - sentiments.bin: the PhraseSentiments columns, as raw arrays.
+// - conversation.cbor: the conversation analysis result, as CBOR.
+// Each file is written to a temporary file and renamed, so a crash never leaves a partial checkpoint.
+// Binary checkpoints start with a header that identifies the format and the machine's integer sizes and byte
+// order. A checkpoint with a different header, or that is truncated, is ignored and the stage runs again.
+class CheckpointStore
+{
+private:
+    static constexpr char magic[4] = { 'C', 'C', 'K', 'P' };
+    // Increment this when the format of a binary checkpoint changes.
+    static constexpr uint32_t formatVersion = 2;
+
+    const std::filesystem::path m_directory;
+
+    class BinaryWriter
+    {
+    private:
+        std::ostream& m_output;
+
+    public:
+        BinaryWriter(std::ostream& output) : m_output(output) {}
+
+        template<typename T>
+        void Write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be written as bytes.");
+            m_output.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        void Write(const std::string& value)
+        {
+            Write(static_cast<uint64_t>(value.size()));
+            m_output.write(value.data(), value.size());
+        }
+
+        template<typename T>
+        void Write(const std::vector<T>& values)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Only vectors of trivially copyable values can be written as bytes.");
+            Write(static_cast<uint64_t>(values.size()));
+            m_output.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+        }
+    };
+
+    // Reads what BinaryWriter wrote from a buffer. Throws std::exception if the buffer is too short for what it
+    // claims to contain, so a corrupt size never causes a huge allocation.
+    class BinaryReader
+    {
+    private:
+        const std::string& m_buffer;
+        size_t m_position = 0;
+
+        void ReadBytes(char* data, size_t size)
+        {
+            if (size > m_buffer.size() - m_position)
+            {
+                throw std::exception("The checkpoint is truncated.");
+            }
+            std::memcpy(data, m_buffer.data() + m_position, size);
+            m_position += size;
+        }
+
+    public:
+        BinaryReader(const std::string& buffer) : m_buffer(buffer) {}
+
+        template<typename T>
+        T Read()
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be read as bytes.");
+            T value;
+            ReadBytes(reinterpret_cast<char*>(&value), sizeof(T));
+            return value;
+        }
+
+        // Read a count of elements that each take at least *minimumElementBytes* in the buffer.
+        size_t ReadCount(size_t minimumElementBytes)
+        {
+            uint64_t count = Read<uint64_t>();
+            if (count > (m_buffer.size() - m_position) / std::max<size_t>(1, minimumElementBytes))
+            {
+                throw std::exception("The checkpoint is truncated.");
+            }
+            return static_cast<size_t>(count);
+        }
+
+        void Read(std::string& value)
+        {
+            value.resize(ReadCount(1));
+            ReadBytes(&value[0], value.size());
+        }
+
+        template<typename T>
+        void Read(std::vector<T>& values)
+        {
+            values.resize(ReadCount(sizeof(T)));
+            ReadBytes(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T));
+        }
+    };
+
+    static void WriteHeader(BinaryWriter& writer)
+    {
+        writer.Write(magic);
+        writer.Write(formatVersion);
+        writer.Write(static_cast<uint8_t>(sizeof(size_t)));
+        writer.Write(static_cast<uint16_t>(1));
+    }
+
+    static bool ReadHeader(BinaryReader& reader)
+    {
+        char fileMagic[4];
+        fileMagic[0] = reader.Read<char>();
+        fileMagic[1] = reader.Read<char>();
+        fileMagic[2] = reader.Read<char>();
+        fileMagic[3] = reader.Read<char>();
+        // The byte order marker reads as 1 only if the file was written with our byte order.
+        return 0 == std::memcmp(fileMagic, magic, sizeof(magic))
+            && formatVersion == reader.Read<uint32_t>()
+            && sizeof(size_t) == reader.Read<uint8_t>()
+            && 1 == reader.Read<uint16_t>();
+    }
+
+    // Write *content* to *name* in the checkpoint directory, through a temporary file.
+    void Save(const std::string& name, const std::string& content) const
+    {
+        std::filesystem::path path = m_directory / name;
+        std::filesystem::path tempPath = m_directory / (name + ".tmp");
+        {
+            std::ofstream output(tempPath, std::ios::binary | std::ios::trunc);
+            output.write(content.data(), content.size());
+            if (!output.good())
+            {
+                throw std::exception(std::string("Unable to write checkpoint file: " + tempPath.string()).c_str());
+            }
+        }
+        std::filesystem::rename(tempPath, path);
+    }
+
+    std::optional<std::string> Load(const std::string& name) const
+    {
+        std::ifstream input(m_directory / name, std::ios::binary);
+        if (!input.good())
+        {
+            return std::nullopt;
+        }
+        std::ostringstream content;
+        content << input.rdbuf();
+        return content.str();
+    }
+
+public:
+    // Use a directory under *rootDirectory* named for *callInput*, for example the audio URL or input file path,
+    // so each call has its own checkpoints.
+    CheckpointStore(const std::string& rootDirectory, const std::string& callInput)
+        : m_directory(std::filesystem::path(rootDirectory) / ResponseCache::Key("checkpoint", std::to_string(formatVersion), callInput))
+    {
+        std::filesystem::create_directories(m_directory);
+    }
+
+    std::string Directory() const
+    {
+        return m_directory.string();
+    }
+
+    void SaveTranscriptionId(const std::string& transcriptionId) const
+    {
+        Save("transcription.id", transcriptionId);
+    }
+
+    std::optional<std::string> LoadTranscriptionId() const
+    {
+        return Load("transcription.id");
+    }
+
+    void SavePhrases(const TranscriptionPhrases& phrases) const
+    {
+        std::ostringstream output;
+        BinaryWriter writer(output);
+        WriteHeader(writer);
+        writer.Write(phrases.source);
+        writer.Write(phrases.timestamp);
+        writer.Write(phrases.duration);
+        writer.Write(phrases.durationInTicks);
+        writer.Write(static_cast<uint64_t>(phrases.combinedRecognizedPhrases.size()));
+        for (const auto& combined : phrases.combinedRecognizedPhrases)
+        {
+            writer.Write(combined.channel);
+            writer.Write(combined.lexical);
+            writer.Write(combined.itn);
+            writer.Write(combined.maskedItn);
+            writer.Write(combined.display);
+        }
+        writer.Write(phrases.Arena());
+        writer.Write(phrases.ids);
+        writer.Write(phrases.speakerNumbers);
+        writer.Write(phrases.channels);
+        writer.Write(phrases.speakers);
+        writer.Write(phrases.offsetsInTicks);
+        writer.Write(phrases.durationsInTicks);
+        writer.Write(phrases.confidences);
+        writer.Write(phrases.recognitionStatuses);
+        writer.Write(phrases.offsets);
+        writer.Write(phrases.durations);
+        writer.Write(phrases.texts);
+        writer.Write(phrases.itns);
+        writer.Write(phrases.lexicals);
+        writer.Write(phrases.maskedItns);
+        writer.Write(phrases.jsons);
+        Save("phrases.bin", output.str());
+    }
+
+    std::optional<TranscriptionPhrases> LoadPhrases() const
+    {
+        std::optional<std::string> content = Load("phrases.bin");
+        if (!content.has_value())
+        {
+            return std::nullopt;
+        }
+        try
+        {
+            BinaryReader reader(content.value());
+            if (!ReadHeader(reader))
+            {
+                return std::nullopt;
+            }
+            TranscriptionPhrases phrases;
+            reader.Read(phrases.source);
+            reader.Read(phrases.timestamp);
+            reader.Read(phrases.duration);
+            phrases.durationInTicks = reader.Read<int64_t>();
+            // Each combined phrase has a channel and four string lengths.
+            phrases.combinedRecognizedPhrases.resize(reader.ReadCount(sizeof(int) + 4 * sizeof(uint64_t)));
+            for (auto& combined : phrases.combinedRecognizedPhrases)
+            {
+                combined.channel = reader.Read<int>();
+                reader.Read(combined.lexical);
+                reader.Read(combined.itn);
+                reader.Read(combined.maskedItn);
+                reader.Read(combined.display);
+            }
+            std::string arena;
+            reader.Read(arena);
+            phrases.SetArena(std::move(arena));
+            reader.Read(phrases.ids);
+            reader.Read(phrases.speakerNumbers);
+            reader.Read(phrases.channels);
+            reader.Read(phrases.speakers);
+            reader.Read(phrases.offsetsInTicks);
+            reader.Read(phrases.durationsInTicks);
+            reader.Read(phrases.confidences);
+            reader.Read(phrases.recognitionStatuses);
+            reader.Read(phrases.offsets);
+            reader.Read(phrases.durations);
+            reader.Read(phrases.texts);
+            reader.Read(phrases.itns);
+            reader.Read(phrases.lexicals);
+            reader.Read(phrases.maskedItns);
+            reader.Read(phrases.jsons);
+            if (!phrases.IsValid())
+            {
+                return std::nullopt;
+            }
+            return phrases;
+        }
+        catch (const std::exception&)
+        {
+            return std::nullopt;
+        }
+    }
+
+    void SaveSentiments(const PhraseSentiments& sentiments) const
+    {
+        std::ostringstream output;
+        BinaryWriter writer(output);
+        WriteHeader(writer);
+        writer.Write(sentiments.sentiments);
+        writer.Write(sentiments.positiveScores);
+        writer.Write(sentiments.neutralScores);
+        writer.Write(sentiments.negativeScores);
+        Save("sentiments.bin", output.str());
+    }
+
+    // Return the saved sentiments if they are for *phraseCount* phrases.
+    std::optional<PhraseSentiments> LoadSentiments(size_t phraseCount) const
+    {
+        std::optional<std::string> content = Load("sentiments.bin");
+        if (!content.has_value())
+        {
+            return std::nullopt;
+        }
+        try
+        {
+            BinaryReader reader(content.value());
+            if (!ReadHeader(reader))
+            {
+                return std::nullopt;
+            }
+            PhraseSentiments sentiments;
+            reader.Read(sentiments.sentiments);
+            reader.Read(sentiments.positiveScores);
+            reader.Read(sentiments.neutralScores);
+            reader.Read(sentiments.negativeScores);
+            if (phraseCount != sentiments.sentiments.size() || phraseCount != sentiments.positiveScores.size()
+                || phraseCount != sentiments.neutralScores.size() || phraseCount != sentiments.negativeScores.size())
+            {
+                return std::nullopt;
+            }
+            return sentiments;
+        }
+        catch (const std::exception&)
+        {
+            return std::nullopt;
+        }
+    }
+
+    void SaveConversationAnalysis(const nlohmann::json& conversationAnalysis) const
+    {
+        std::vector<uint8_t> cbor = nlohmann::json::to_cbor(conversationAnalysis);
+        Save("conversation.cbor", std::string(cbor.begin(), cbor.end()));
+    }
+
+    std::optional<nlohmann::json> LoadConversationAnalysis() const
+    {
+        std::optional<std::string> content = Load("conversation.cbor");
+        if (!content.has_value())
+        {
+            return std::nullopt;
+        }
+        // Do not throw if the file is corrupt. Return a discarded value instead.
+        nlohmann::json conversationAnalysis = nlohmann::json::from_cbor(content.value(), true, false);
+        if (conversationAnalysis.is_discarded())
+        {
+            return std::nullopt;
+        }
+        return conversationAnalysis;
+    }
+};
@@ -0,0 +1,260 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+// You can download json.hpp from:
+// https://github.com/nlohmann/json/releases
+#include "json.hpp"
+
+// Collects output in a reusable buffer and writes it to a stream whenever the buffer fills up, so writing
+// a report costs one stream write per buffer rather than one per value, and never holds the whole report.
+class OutputWriter
+{
+private:
+    // Flush when the buffer reaches this size.
+    static const size_t flushSize = 64 * 1024;
+
+    std::ostream& m_output;
+    std::string m_buffer;
+
+public:
+    OutputWriter(std::ostream& output) : m_output(output)
+    {
+        m_buffer.reserve(flushSize + 1024);
+    }
+
+    ~OutputWriter()
+    {
+        Flush();
+    }
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    OutputWriter& Write(std::string_view value)
+    {
+        m_buffer.append(value);
+        if (m_buffer.size() >= flushSize)
+        {
+            Flush();
+        }
+        return *this;
+    }
+
+    OutputWriter& Write(char value)
+    {
+        m_buffer.push_back(value);
+        if (m_buffer.size() >= flushSize)
+        {
+            Flush();
+        }
+        return *this;
+    }
+
+    OutputWriter& Write(int64_t value)
+    {
+        return Write(std::string_view(std::to_string(value)));
+    }
+
+    // Write *value* as a JSON string, with quotes and escapes, the same way nlohmann::json::dump does.
+    OutputWriter& WriteJsonString(std::string_view value)
+    {
+        Write('"');
+        for (char c : value)
+        {
+            switch (c)
+            {
+            case '"': Write("\\\""); break;
+            case '\\': Write("\\\\"); break;
+            case '\b': Write("\\b"); break;
+            case '\f': Write("\\f"); break;
+            case '\n': Write("\\n"); break;
+            case '\r': Write("\\r"); break;
+            case '\t': Write("\\t"); break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+                    Write(std::string_view(escaped));
+                }
+                else
+                {
+                    Write(c);
+                }
+            }
+        }
+        return Write('"');
+    }
+
+    void Flush()
+    {
+        m_output.write(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+};
+
+// Writes JSON to an OutputWriter one element at a time, formatted the same way as nlohmann::json::dump(2).
+// Callers open and close objects and arrays and write keys and values in order, so a large document is
+// never built in memory. Values that already are nlohmann::json, such as service results, are written
+// recursively without serializing them to a temporary string.
+// Note: nlohmann::json sorts object keys. To produce the same output, callers write keys in sorted order.
+class JsonWriter
+{
+private:
+    static const int indentSize = 2;
+
+    struct Frame
+    {
+        bool isArray;
+        size_t count;
+    };
+
+    OutputWriter& m_output;
+    std::vector<Frame> m_stack;
+    // True after Key, so the value that follows goes on the same line.
+    bool m_afterKey = false;
+
+    void Indent()
+    {
+        for (size_t level = 0; level < m_stack.size() * indentSize; level++)
+        {
+            m_output.Write(' ');
+        }
+    }
+
+    // Write the separator and indentation that go before an array element or object key.
+    void BeforeValue()
+    {
+        if (m_afterKey)
+        {
+            m_afterKey = false;
+        }
+        else if (!m_stack.empty())
+        {
+            m_output.Write(m_stack.back().count++ > 0 ? ",\n" : "\n");
+            Indent();
+        }
+    }
+
+    void End(char closing)
+    {
+        Frame frame = m_stack.back();
+        m_stack.pop_back();
+        if (frame.count > 0)
+        {
+            m_output.Write('\n');
+            Indent();
+        }
+        m_output.Write(closing);
+    }
+
+public:
+    JsonWriter(OutputWriter& output) : m_output(output) {}
+
+    JsonWriter& BeginObject()
+    {
+        BeforeValue();
+        m_output.Write('{');
+        m_stack.push_back(Frame { false, 0 });
+        return *this;
+    }
+
+    JsonWriter& EndObject()
+    {
+        End('}');
+        return *this;
+    }
+
+    JsonWriter& BeginArray()
+    {
+        BeforeValue();
+        m_output.Write('[');
+        m_stack.push_back(Frame { true, 0 });
+        return *this;
+    }
+
+    JsonWriter& EndArray()
+    {
+        End(']');
+        return *this;
+    }
+
+    JsonWriter& Key(std::string_view key)
+    {
+        BeforeValue();
+        m_output.WriteJsonString(key).Write(": ");
+        m_afterKey = true;
+        return *this;
+    }
+
+    JsonWriter& String(std::string_view value)
+    {
+        BeforeValue();
+        m_output.WriteJsonString(value);
+        return *this;
+    }
+
+    JsonWriter& Integer(int64_t value)
+    {
+        BeforeValue();
+        m_output.Write(value);
+        return *this;
+    }
+
+    JsonWriter& Value(const nlohmann::json& value)
+    {
+        switch (value.type())
+        {
+        case nlohmann::json::value_t::object:
+            BeginObject();
+            for (const auto& item : value.items())
+            {
+                Key(item.key()).Value(item.value());
+            }
+            return EndObject();
+        case nlohmann::json::value_t::array:
+            BeginArray();
+            for (const auto& item : value)
+            {
+                Value(item);
+            }
+            return EndArray();
+        case nlohmann::json::value_t::string:
+            return String(value.get_ref<const std::string&>());
+        default:
+            // Numbers, Booleans and null. Use nlohmann::json so floating point numbers are formatted the same way.
+            BeforeValue();
+            m_output.Write(std::string_view(value.dump()));
+            return *this;
+        }
+    }
+
+    // Write "key": value.
+    template<typename T>
+    JsonWriter& Field(std::string_view key, const T& value)
+    {
+        Key(key);
+        if constexpr (std::is_convertible_v<const T&, std::string_view>)
+        {
+            return String(value);
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            return Integer(static_cast<int64_t>(value));
+        }
+        else
+        {
+            return Value(value);
+        }
+    }
+};
@@ -0,0 +1,462 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+
+// Writes Thrift structs with the compact protocol, which is how Parquet encodes its file and page metadata. Only
+// the field types Parquet metadata uses are supported. See:
+// https://github.com/apache/thrift/blob/master/doc/specs/thrift-compact-protocol.md
+class ThriftCompactWriter
+{
+public:
+    enum FieldType : uint8_t { I32 = 5, I64 = 6, Binary = 8, List = 9, Struct = 12 };
+
+private:
+    std::string& m_output;
+    // The ID of the last field written in each open struct. Field headers store the difference from it.
+    std::vector<int16_t> m_lastFieldIds { 0 };
+
+    void Varint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            m_output.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        m_output.push_back(static_cast<char>(value));
+    }
+
+    static uint64_t ZigZag(int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    void FieldHeader(int16_t id, FieldType type)
+    {
+        int16_t delta = id - m_lastFieldIds.back();
+        if (delta > 0 && delta <= 15)
+        {
+            m_output.push_back(static_cast<char>((delta << 4) | type));
+        }
+        else
+        {
+            m_output.push_back(static_cast<char>(type));
+            Varint(ZigZag(id));
+        }
+        m_lastFieldIds.back() = id;
+    }
+
+public:
+    ThriftCompactWriter(std::string& output) : m_output(output) {}
+
+    ThriftCompactWriter& I32Field(int16_t id, int32_t value)
+    {
+        FieldHeader(id, I32);
+        Varint(ZigZag(value));
+        return *this;
+    }
+
+    ThriftCompactWriter& I64Field(int16_t id, int64_t value)
+    {
+        FieldHeader(id, I64);
+        Varint(ZigZag(value));
+        return *this;
+    }
+
+    ThriftCompactWriter& BinaryField(int16_t id, std::string_view value)
+    {
+        FieldHeader(id, Binary);
+        BinaryElement(value);
+        return *this;
+    }
+
+    // Begin a struct field. Write its fields, then call EndStruct.
+    ThriftCompactWriter& BeginStructField(int16_t id)
+    {
+        FieldHeader(id, Struct);
+        return BeginStruct();
+    }
+
+    // Begin a list field of *size* elements of *elementType*. Write each element with an *Element method.
+    ThriftCompactWriter& BeginListField(int16_t id, FieldType elementType, size_t size)
+    {
+        FieldHeader(id, List);
+        if (size < 15)
+        {
+            m_output.push_back(static_cast<char>((size << 4) | elementType));
+        }
+        else
+        {
+            m_output.push_back(static_cast<char>(0xF0 | elementType));
+            Varint(size);
+        }
+        return *this;
+    }
+
+    // Begin a struct, for example the top-level struct or a struct element of a list.
+    ThriftCompactWriter& BeginStruct()
+    {
+        m_lastFieldIds.push_back(0);
+        return *this;
+    }
+
+    ThriftCompactWriter& EndStruct()
+    {
+        m_output.push_back(0);
+        m_lastFieldIds.pop_back();
+        return *this;
+    }
+
+    ThriftCompactWriter& I32Element(int32_t value)
+    {
+        Varint(ZigZag(value));
+        return *this;
+    }
+
+    ThriftCompactWriter& BinaryElement(std::string_view value)
+    {
+        Varint(value.size());
+        m_output.append(value);
+        return *this;
+    }
+};
+
+// Writes a table to an Apache Parquet file, one row group at a time, so a file can grow call by call and readers
+// can scan only the columns they need. See https://parquet.apache.org/docs/file-format/
+// To keep the writer small, every column is required (never null) and flat, each column chunk is one data page,
+// values are PLAIN-encoded, and pages are gzip-compressed. The footer, which lists the row groups, is written by
+// Close, so the file is readable only after Close.
+class ParquetWriter
+{
+public:
+    enum class ColumnType { Int32, Int64, Double, String };
+
+    struct Column
+    {
+        std::string name;
+        ColumnType type;
+    };
+
+    // The rows of one row group, buffered column by column. Add a value to each column for each row.
+    class RowGroup
+    {
+    private:
+        friend class ParquetWriter;
+
+        const std::vector<Column>& m_schema;
+        // The PLAIN-encoded values of each column.
+        std::vector<std::string> m_values;
+        std::vector<size_t> m_counts;
+
+        template<typename T>
+        void AppendLittleEndian(size_t column, ColumnType type, T value)
+        {
+            if (m_schema[column].type != type)
+            {
+                throw std::exception(std::string("The value has the wrong type for Parquet column " + m_schema[column].name + ".").c_str());
+            }
+            // Parquet is little-endian, like the x86 and ARM machines this sample runs on.
+            char bytes[sizeof(T)];
+            std::memcpy(bytes, &value, sizeof(T));
+            m_values[column].append(bytes, sizeof(T));
+            m_counts[column]++;
+        }
+
+    public:
+        RowGroup(const std::vector<Column>& schema) : m_schema(schema), m_values(schema.size()), m_counts(schema.size(), 0) {}
+
+        RowGroup& Add(size_t column, int32_t value)
+        {
+            AppendLittleEndian(column, ColumnType::Int32, value);
+            return *this;
+        }
+
+        RowGroup& Add(size_t column, int64_t value)
+        {
+            AppendLittleEndian(column, ColumnType::Int64, value);
+            return *this;
+        }
+
+        RowGroup& Add(size_t column, double value)
+        {
+            AppendLittleEndian(column, ColumnType::Double, value);
+            return *this;
+        }
+
+        // A string is stored as its length followed by its bytes.
+        RowGroup& Add(size_t column, std::string_view value)
+        {
+            AppendLittleEndian(column, ColumnType::String, static_cast<uint32_t>(value.size()));
+            m_values[column].append(value);
+            return *this;
+        }
+
+        size_t Rows() const
+        {
+            return m_counts.empty() ? 0 : m_counts[0];
+        }
+    };
+
+private:
+    static constexpr char magic[4] = { 'P', 'A', 'R', '1' };
+    // Values of enums in parquet.thrift.
+    enum ParquetType : int32_t { INT32 = 1, INT64 = 2, DOUBLE = 5, BYTE_ARRAY = 6 };
+    static constexpr int32_t requiredRepetition = 0;
+    static constexpr int32_t utf8ConvertedType = 0;
+    static constexpr int32_t plainEncoding = 0;
+    static constexpr int32_t rleEncoding = 3;
+    static constexpr int32_t gzipCodec = 2;
+    static constexpr int32_t dataPageType = 0;
+
+    struct ColumnChunkMetadata
+    {
+        int64_t offset;
+        int64_t values;
+        int64_t uncompressedBytes;
+        int64_t compressedBytes;
+    };
+
+    struct RowGroupMetadata
+    {
+        std::vector<ColumnChunkMetadata> columns;
+        int64_t rows;
+        int64_t uncompressedBytes;
+    };
+
+    const std::vector<Column> m_schema;
+    const std::string m_path;
+    std::ofstream m_output;
+    int64_t m_position = 0;
+    std::vector<RowGroupMetadata> m_rowGroups;
+    bool m_closed = false;
+    std::mutex m_mutex;
+
+    static ParquetType PhysicalType(ColumnType type)
+    {
+        switch (type)
+        {
+        case ColumnType::Int32:
+            return INT32;
+        case ColumnType::Int64:
+            return INT64;
+        case ColumnType::Double:
+            return DOUBLE;
+        default:
+            return BYTE_ARRAY;
+        }
+    }
+
+    // Return *content* compressed with gzip, which Parquet readers accept as the GZIP codec.
+    static std::string Gzip(const std::string& content)
+    {
+        z_stream stream {};
+        // Add 16 to the window bits to write a gzip header and trailer instead of a zlib one.
+        if (Z_OK != deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY))
+        {
+            throw std::exception("deflateInit2() failed.");
+        }
+        std::string compressed(deflateBound(&stream, static_cast<uLong>(content.size())), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(content.data()));
+        stream.avail_in = static_cast<uInt>(content.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&compressed[0]);
+        stream.avail_out = static_cast<uInt>(compressed.size());
+        int result = deflate(&stream, Z_FINISH);
+        compressed.resize(stream.total_out);
+        deflateEnd(&stream);
+        if (Z_STREAM_END != result)
+        {
+            throw std::exception("deflate() failed.");
+        }
+        return compressed;
+    }
+
+    void Write(const std::string& bytes)
+    {
+        m_output.write(bytes.data(), bytes.size());
+        m_position += static_cast<int64_t>(bytes.size());
+    }
+
+    std::string FileMetadata() const
+    {
+        int64_t rows = 0;
+        for (const auto& rowGroup : m_rowGroups)
+        {
+            rows += rowGroup.rows;
+        }
+        std::string metadata;
+        ThriftCompactWriter thrift(metadata);
+        thrift.BeginStruct();
+        thrift.I32Field(1, 1);
+        // The schema is a tree flattened in depth-first order. The root has the columns as children.
+        thrift.BeginListField(2, ThriftCompactWriter::Struct, m_schema.size() + 1);
+        thrift.BeginStruct().BinaryField(4, "schema").I32Field(5, static_cast<int32_t>(m_schema.size())).EndStruct();
+        for (const auto& column : m_schema)
+        {
+            thrift.BeginStruct()
+                .I32Field(1, PhysicalType(column.type))
+                .I32Field(3, requiredRepetition)
+                .BinaryField(4, column.name);
+            if (ColumnType::String == column.type)
+            {
+                thrift.I32Field(6, utf8ConvertedType);
+            }
+            thrift.EndStruct();
+        }
+        thrift.I64Field(3, rows);
+        thrift.BeginListField(4, ThriftCompactWriter::Struct, m_rowGroups.size());
+        for (const auto& rowGroup : m_rowGroups)
+        {
+            thrift.BeginStruct();
+            thrift.BeginListField(1, ThriftCompactWriter::Struct, rowGroup.columns.size());
+            for (size_t index = 0; index < rowGroup.columns.size(); index++)
+            {
+                const ColumnChunkMetadata& chunk = rowGroup.columns[index];
+                thrift.BeginStruct().I64Field(2, chunk.offset);
+                thrift.BeginStructField(3)
+                    .I32Field(1, PhysicalType(m_schema[index].type));
+                thrift.BeginListField(2, ThriftCompactWriter::I32, 1).I32Element(plainEncoding);
+                thrift.BeginListField(3, ThriftCompactWriter::Binary, 1).BinaryElement(m_schema[index].name);
+                thrift.I32Field(4, gzipCodec)
+                    .I64Field(5, chunk.values)
+                    .I64Field(6, chunk.uncompressedBytes)
+                    .I64Field(7, chunk.compressedBytes)
+                    .I64Field(9, chunk.offset)
+                    .EndStruct();
+                thrift.EndStruct();
+            }
+            thrift.I64Field(2, rowGroup.uncompressedBytes)
+                .I64Field(3, rowGroup.rows)
+                .EndStruct();
+        }
+        thrift.BinaryField(6, "call_center");
+        thrift.EndStruct();
+        return metadata;
+    }
+
+public:
+    // Create *path*, replacing any existing file, for a table with the columns in *schema*.
+    ParquetWriter(const std::string& path, std::vector<Column> schema)
+        : m_schema(std::move(schema)), m_path(path), m_output(path, std::ios::binary | std::ios::trunc)
+    {
+        if (!m_output.good())
+        {
+            throw std::exception(std::string("Unable to open Parquet output file: " + path).c_str());
+        }
+        Write(std::string(magic, sizeof(magic)));
+    }
+
+    ParquetWriter(const ParquetWriter&) = delete;
+    ParquetWriter& operator=(const ParquetWriter&) = delete;
+
+    ~ParquetWriter()
+    {
+        try
+        {
+            Close();
+        }
+        catch (const std::exception&)
+        {
+            // Destructors must not throw. Call Close to handle errors.
+        }
+    }
+
+    RowGroup NewRowGroup() const
+    {
+        return RowGroup(m_schema);
+    }
+
+    // Append *rowGroup* to the file. Safe to call from several threads.
+    void WriteRowGroup(const RowGroup& rowGroup)
+    {
+        const size_t rows = rowGroup.Rows();
+        for (size_t column = 0; column < m_schema.size(); column++)
+        {
+            if (rowGroup.m_counts[column] != rows)
+            {
+                throw std::exception(std::string("Parquet column " + m_schema[column].name + " has the wrong number of values.").c_str());
+            }
+        }
+        if (0 == rows)
+        {
+            return;
+        }
+        // Compress outside the lock, so threads writing row groups at once only wait for each other's writes.
+        RowGroupMetadata metadata { {}, static_cast<int64_t>(rows), 0 };
+        std::vector<std::string> pages;
+        for (size_t column = 0; column < m_schema.size(); column++)
+        {
+            const std::string& values = rowGroup.m_values[column];
+            std::string compressed = Gzip(values);
+            std::string page;
+            ThriftCompactWriter thrift(page);
+            thrift.BeginStruct()
+                .I32Field(1, dataPageType)
+                .I32Field(2, static_cast<int32_t>(values.size()))
+                .I32Field(3, static_cast<int32_t>(compressed.size()));
+            // Required columns have no definition or repetition levels, but the header still names their encoding.
+            thrift.BeginStructField(5)
+                .I32Field(1, static_cast<int32_t>(rows))
+                .I32Field(2, plainEncoding)
+                .I32Field(3, rleEncoding)
+                .I32Field(4, rleEncoding)
+                .EndStruct();
+            thrift.EndStruct();
+            // Column chunk sizes include the page header, which is not compressed.
+            int64_t uncompressedBytes = static_cast<int64_t>(page.size() + values.size());
+            page += compressed;
+            metadata.columns.push_back(ColumnChunkMetadata { 0, static_cast<int64_t>(rows), uncompressedBytes, static_cast<int64_t>(page.size()) });
+            metadata.uncompressedBytes += uncompressedBytes;
+            pages.push_back(std::move(page));
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed)
+        {
+            throw std::exception(std::string("The Parquet output file is closed: " + m_path).c_str());
+        }
+        for (size_t column = 0; column < m_schema.size(); column++)
+        {
+            metadata.columns[column].offset = m_position;
+            Write(pages[column]);
+        }
+        m_rowGroups.push_back(std::move(metadata));
+        m_output.flush();
+        if (!m_output.good())
+        {
+            throw std::exception(std::string("Unable to write Parquet output file: " + m_path).c_str());
+        }
+    }
+
+    // Write the footer and close the file. Does nothing if the file is already closed.
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed)
+        {
+            return;
+        }
+        m_closed = true;
+        std::string metadata = FileMetadata();
+        Write(metadata);
+        uint32_t metadataBytes = static_cast<uint32_t>(metadata.size());
+        char length[sizeof(metadataBytes)];
+        std::memcpy(length, &metadataBytes, sizeof(length));
+        Write(std::string(length, sizeof(length)));
+        Write(std::string(magic, sizeof(magic)));
+        m_output.close();
+        if (m_output.fail())
+        {
+            throw std::exception(std::string("Unable to write Parquet output file: " + m_path).c_str());
+        }
+    }
+};
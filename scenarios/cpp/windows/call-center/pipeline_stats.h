@@ -0,0 +1,93 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "trace_helper.h"
+
+// Collects how long each call center pipeline stage takes, across calls and threads, and reports
+// latency percentiles per stage.
+class PipelineStats
+{
+private:
+    std::mutex m_mutex;
+    // Stage names in the order they were first recorded, so the report follows the pipeline.
+    std::vector<std::string> m_stageNames;
+    std::map<std::string, std::vector<double>> m_stageMilliseconds;
+
+    // Nearest-rank percentile. *sorted* must not be empty.
+    static double Percentile(const std::vector<double>& sorted, double percentile)
+    {
+        size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * sorted.size()));
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+
+public:
+    // Measures one stage from construction to destruction, and records it as a trace span if tracing is enabled.
+    // Does not record the stage in stats if *stats* is null.
+    class StageTimer
+    {
+    private:
+        PipelineStats* m_stats;
+        std::string m_stage;
+        TraceSpan m_span;
+        std::chrono::steady_clock::time_point m_start;
+
+    public:
+        StageTimer(PipelineStats* stats, std::string stage) : m_stats(stats), m_stage(std::move(stage)), m_span(m_stage, "stage"), m_start(std::chrono::steady_clock::now()) {}
+
+        ~StageTimer()
+        {
+            if (nullptr != m_stats)
+            {
+                m_stats->Record(m_stage, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count());
+            }
+        }
+    };
+
+    void Record(const std::string& stage, double milliseconds)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto samples = m_stageMilliseconds.find(stage);
+        if (samples == m_stageMilliseconds.end())
+        {
+            m_stageNames.push_back(stage);
+            samples = m_stageMilliseconds.emplace(stage, std::vector<double>()).first;
+        }
+        samples->second.push_back(milliseconds);
+    }
+
+    void Report(std::ostream& output)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::ios_base::fmtflags flags = output.flags();
+        std::streamsize precision = output.precision();
+        output << std::left << std::setw(28) << "Stage" << std::right
+            << std::setw(8) << "Count" << std::setw(12) << "p50 (ms)" << std::setw(12) << "p90 (ms)"
+            << std::setw(12) << "p99 (ms)" << std::setw(12) << "Max (ms)" << "\n";
+        output << std::fixed << std::setprecision(1);
+        for (const auto& stage : m_stageNames)
+        {
+            std::vector<double> sorted = m_stageMilliseconds[stage];
+            std::sort(sorted.begin(), sorted.end());
+            output << std::left << std::setw(28) << stage << std::right
+                << std::setw(8) << sorted.size()
+                << std::setw(12) << Percentile(sorted, 50)
+                << std::setw(12) << Percentile(sorted, 90)
+                << std::setw(12) << Percentile(sorted, 99)
+                << std::setw(12) << sorted.back() << "\n";
+        }
+        output.flags(flags);
+        output.precision(precision);
+    }
+};
@@ -0,0 +1,249 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+// You can get the Speech SDK from NuGet (Microsoft.CognitiveServices.Speech) or from:
+// https://aka.ms/csspeech/cppref
+#include <speechapi_cxx.h>
+// You can download json.hpp from:
+// https://github.com/nlohmann/json/releases
+#include "json.hpp"
+#include "stereo_splitter.h"
+#include "transcription_phrases.h"
+#include "../common/wav_file_reader.h"
+
+// Transcribes a local WAV file with ConversationTranscriber, pushing the audio through a push stream, and
+// reports each phrase as soon as it is recognized. For stereo audio, each channel gets its own push stream
+// and transcriber, and phrases are attributed to channels. For mono audio, phrases are attributed to the
+// speakers the service identifies.
+// Phrases are reported on Speech SDK threads, so the callback should only queue them.
+class RealTimeTranscriber
+{
+private:
+    // How much audio to push at once, in sample frames per channel. 100 ms at 16 kHz.
+    static const uint32_t framesPerWrite = 1600;
+
+    struct Channel
+    {
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::Audio::PushAudioInputStream> stream;
+        std::shared_ptr<Microsoft::CognitiveServices::Speech::Transcription::ConversationTranscriber> transcriber;
+    };
+
+    WavFileReader m_reader;
+    WAVEFORMAT m_format;
+    std::function<void(PhraseRecord&&)> m_onPhrase;
+    std::vector<Channel> m_channels;
+
+    std::mutex m_mutex;
+    std::condition_variable m_sessionStopped;
+    size_t m_runningSessions = 0;
+    std::optional<std::string> m_error;
+    // Set by Stop, to end Run early.
+    std::atomic<bool> m_stopping = false;
+
+    // Format a duration in ticks (100 ns) as ISO 8601, the way batch transcription does, for example "PT1.23S".
+    static std::string TicksToIsoDuration(int64_t ticks)
+    {
+        std::ostringstream result;
+        result << "PT" << ticks / 10000000;
+        int64_t fraction = ticks % 10000000;
+        if (fraction > 0)
+        {
+            std::ostringstream digits;
+            digits << std::setw(7) << std::setfill('0') << fraction;
+            std::string fractionDigits = digits.str();
+            fractionDigits.erase(fractionDigits.find_last_not_of('0') + 1);
+            result << "." << fractionDigits;
+        }
+        result << "S";
+        return result.str();
+    }
+
+    PhraseRecord PhraseFromResult(const std::shared_ptr<Microsoft::CognitiveServices::Speech::Transcription::ConversationTranscriptionResult>& result, size_t channel)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        PhraseRecord phrase;
+        phrase.recognitionStatus = "Success";
+        if (m_channels.size() > 1)
+        {
+            phrase.channel = static_cast<int>(channel);
+        }
+        else
+        {
+            // Speaker IDs look like "Guest-1". Speakers that could not be identified are "Unknown", and count as channel 0.
+            size_t separator = result->SpeakerId.find_last_of('-');
+            if (std::string::npos != separator && separator + 1 < result->SpeakerId.size() && std::isdigit(static_cast<unsigned char>(result->SpeakerId[separator + 1])))
+            {
+                phrase.speaker = std::stoi(result->SpeakerId.substr(separator + 1));
+            }
+            else
+            {
+                phrase.channel = 0;
+            }
+        }
+        phrase.offsetInTicks = static_cast<int64_t>(result->Offset());
+        phrase.durationInTicks = static_cast<int64_t>(result->Duration());
+        phrase.offset = TicksToIsoDuration(phrase.offsetInTicks);
+        phrase.duration = TicksToIsoDuration(phrase.durationInTicks);
+        phrase.display = result->Text;
+
+        // The detailed result has the lexical, ITN and masked ITN forms and the confidence.
+        nlohmann::json detailed = nlohmann::json::parse(result->Properties.GetProperty(PropertyId::SpeechServiceResponse_JsonResult), nullptr, false);
+        if (!detailed.is_discarded() && detailed.contains("NBest") && detailed["NBest"].is_array() && !detailed["NBest"].empty())
+        {
+            const nlohmann::json& best = detailed["NBest"][0];
+            phrase.confidence = best.value("Confidence", 0.0);
+            phrase.lexical = best.value("Lexical", std::string());
+            phrase.itn = best.value("ITN", std::string());
+            phrase.maskedItn = best.value("MaskedITN", std::string());
+        }
+        else
+        {
+            phrase.lexical = phrase.itn = phrase.maskedItn = result->Text;
+        }
+        return phrase;
+    }
+
+    void Connect(size_t channelIndex)
+    {
+        using namespace Microsoft::CognitiveServices::Speech;
+        using namespace Microsoft::CognitiveServices::Speech::Transcription;
+        Channel& channel = m_channels[channelIndex];
+
+        channel.transcriber->Transcribed.Connect([this, channelIndex](const ConversationTranscriptionEventArgs& e)
+        {
+            if (ResultReason::RecognizedSpeech == e.Result->Reason && !e.Result->Text.empty())
+            {
+                m_onPhrase(PhraseFromResult(e.Result, channelIndex));
+            }
+        });
+
+        channel.transcriber->Canceled.Connect([this](const ConversationTranscriptionCanceledEventArgs& e)
+        {
+            if (CancellationReason::Error == e.Reason)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_error = "Transcription canceled. Error code: " + std::to_string(static_cast<int>(e.ErrorCode)) + ". Details: " + e.ErrorDetails;
+            }
+        });
+
+        channel.transcriber->SessionStopped.Connect([this](const SessionEventArgs&)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_runningSessions--;
+            m_sessionStopped.notify_all();
+        });
+    }
+
+    void PushAudio()
+    {
+        // The constructor checked that the audio is 16-bit mono, or 16-bit stereo with a channel per stream.
+        const uint32_t channelCount = static_cast<uint32_t>(m_channels.size());
+        std::vector<int16_t> frames(framesPerWrite * channelCount);
+        std::vector<int16_t> left(framesPerWrite);
+        std::vector<int16_t> right(framesPerWrite);
+        uint32_t bytesRead = 0;
+        while (!m_stopping && (bytesRead = m_reader.Read(reinterpret_cast<uint8_t*>(frames.data()), static_cast<uint32_t>(frames.size() * sizeof(int16_t)))) > 0)
+        {
+            if (1 == channelCount)
+            {
+                m_channels[0].stream->Write(reinterpret_cast<uint8_t*>(frames.data()), bytesRead);
+                continue;
+            }
+            // Deinterleave the frames, and push each channel's samples to its own stream.
+            uint32_t frameCount = bytesRead / m_format.BlockAlign;
+            StereoSplitter::Split(frames.data(), frameCount, left.data(), right.data());
+            m_channels[0].stream->Write(reinterpret_cast<uint8_t*>(left.data()), frameCount * sizeof(int16_t));
+            m_channels[1].stream->Write(reinterpret_cast<uint8_t*>(right.data()), frameCount * sizeof(int16_t));
+        }
+        for (auto& channel : m_channels)
+        {
+            channel.stream->Close();
+        }
+    }
+
+public:
+    // Preconditions:
+    // *audioFilePath* is a 16-bit PCM WAV file. If *splitChannels* is true it has two channels, otherwise one.
+    RealTimeTranscriber(std::shared_ptr<Microsoft::CognitiveServices::Speech::SpeechConfig> speechConfig, const std::string& audioFilePath, bool splitChannels, std::function<void(PhraseRecord&&)> onPhrase)
+        : m_reader(audioFilePath), m_format(m_reader.GetFormat()), m_onPhrase(std::move(onPhrase))
+    {
+        using namespace Microsoft::CognitiveServices::Speech::Audio;
+        using namespace Microsoft::CognitiveServices::Speech::Transcription;
+        if (16 != m_format.BitsPerSample)
+        {
+            throw std::exception("Real-time mode requires 16-bit PCM audio.");
+        }
+        if (m_format.BlockAlign != m_format.Channels * sizeof(int16_t))
+        {
+            throw std::exception("The audio file has an unexpected block alignment for 16-bit PCM audio.");
+        }
+        if (splitChannels && 2 != m_format.Channels)
+        {
+            throw std::exception("--stereo was specified, but the audio file does not have two channels.");
+        }
+        if (!splitChannels && 1 != m_format.Channels)
+        {
+            throw std::exception("The audio file has more than one channel. Specify --stereo to transcribe each channel separately.");
+        }
+
+        auto format = AudioStreamFormat::GetWaveFormatPCM(m_format.SamplesPerSec, 16, 1);
+        for (uint16_t channel = 0; channel < m_format.Channels; channel++)
+        {
+            auto stream = AudioInputStream::CreatePushStream(format);
+            auto transcriber = ConversationTranscriber::FromConfig(speechConfig, AudioConfig::FromStreamInput(stream));
+            m_channels.push_back(Channel { stream, transcriber });
+        }
+        for (size_t channel = 0; channel < m_channels.size(); channel++)
+        {
+            Connect(channel);
+        }
+    }
+
+    // Push all of the audio, and return when every channel has been transcribed.
+    void Run()
+    {
+        m_runningSessions = m_channels.size();
+        for (auto& channel : m_channels)
+        {
+            channel.transcriber->StartTranscribingAsync().get();
+        }
+        PushAudio();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_sessionStopped.wait(lock, [this]() { return 0 == m_runningSessions || m_stopping; });
+        }
+        for (auto& channel : m_channels)
+        {
+            channel.transcriber->StopTranscribingAsync().get();
+        }
+        m_reader.Close();
+        if (m_error.has_value())
+        {
+            throw std::exception(m_error.value().c_str());
+        }
+    }
+
+    // Stop pushing audio, and make Run stop transcribing and return without waiting for the rest of the audio.
+    // Can be called from any thread.
+    void Stop()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_sessionStopped.notify_all();
+    }
+};
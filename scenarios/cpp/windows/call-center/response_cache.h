@@ -0,0 +1,173 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A persistent cache of responses to idempotent analysis requests. Each response is stored in its own file,
+// named for a hash of the endpoint, API version and request body, so re-running the same analysis (for
+// example after changing the output format, or after a crash partway through a batch) does not send the
+// request again. When the files grow past the size limit, the least recently used ones are removed.
+class ResponseCache
+{
+private:
+    const std::filesystem::path m_directory;
+    const uintmax_t m_maxBytes;
+    std::mutex m_mutex;
+    // Approximate total size of the cache files. Recomputed when we evict.
+    uintmax_t m_bytes = 0;
+    std::atomic<uint64_t> m_hits = 0;
+    std::atomic<uint64_t> m_misses = 0;
+    std::atomic<uint64_t> m_tempFileCount = 0;
+
+    // 64-bit FNV-1a. Unlike std::hash, the result is the same across runs, compilers and platforms,
+    // which a key for files on disk requires.
+    static uint64_t Fnv1a(uint64_t hash, const std::string& value)
+    {
+        for (unsigned char c : value)
+        {
+            hash ^= c;
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    std::filesystem::path PathFor(const std::string& key) const
+    {
+        return m_directory / (key + ".json");
+    }
+
+    // Remove the least recently used files until the cache fits in m_maxBytes.
+    // Preconditions: m_mutex is locked.
+    void Evict()
+    {
+        struct Entry
+        {
+            std::filesystem::path path;
+            std::filesystem::file_time_type lastUsed;
+            uintmax_t size;
+        };
+        std::vector<Entry> entries;
+        uintmax_t total = 0;
+        std::error_code error;
+        for (const auto& file : std::filesystem::directory_iterator(m_directory, error))
+        {
+            if (file.is_regular_file(error) && ".json" == file.path().extension())
+            {
+                Entry entry { file.path(), file.last_write_time(error), file.file_size(error) };
+                total += entry.size;
+                entries.push_back(std::move(entry));
+            }
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry& entry_1, const Entry& entry_2) -> bool {
+            return entry_1.lastUsed < entry_2.lastUsed;
+        });
+        for (const auto& entry : entries)
+        {
+            if (total <= m_maxBytes)
+            {
+                break;
+            }
+            if (std::filesystem::remove(entry.path, error))
+            {
+                total -= entry.size;
+            }
+        }
+        m_bytes = total;
+    }
+
+public:
+    ResponseCache(const std::string& directory, uintmax_t maxBytes) : m_directory(directory), m_maxBytes(maxBytes)
+    {
+        std::filesystem::create_directories(m_directory);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Evict();
+    }
+
+    // Return the cache key for a request. The key does not include the subscription key, so results
+    // are shared across keys for the same resource.
+    static std::string Key(const std::string& endpoint, const std::string& apiVersion, const std::string& body)
+    {
+        const uint64_t offsetBasis = 0xcbf29ce484222325ULL;
+        // Hash the lengths too, so that moving characters from one field to the next changes the key.
+        uint64_t hash = offsetBasis;
+        for (const std::string* field : { &endpoint, &apiVersion, &body })
+        {
+            hash = Fnv1a(hash, std::to_string(field->size()) + ":");
+            hash = Fnv1a(hash, *field);
+        }
+        std::ostringstream key;
+        key << std::hex << std::setw(16) << std::setfill('0') << hash;
+        return key.str();
+    }
+
+    std::optional<std::string> Get(const std::string& key)
+    {
+        std::filesystem::path path = PathFor(key);
+        std::ifstream input(path, std::ios::binary);
+        if (!input.good())
+        {
+            m_misses++;
+            return std::nullopt;
+        }
+        std::ostringstream content;
+        content << input.rdbuf();
+        input.close();
+        m_hits++;
+        // Mark the file as recently used, so eviction removes it last.
+        std::error_code error;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+        return content.str();
+    }
+
+    // Remove an entry that Get returned but the caller could not use, such as a truncated or corrupt file,
+    // and count the lookup as a miss instead of a hit.
+    void Discard(const std::string& key)
+    {
+        m_hits--;
+        m_misses++;
+        std::error_code error;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::filesystem::remove(PathFor(key), error);
+    }
+
+    void Put(const std::string& key, const std::string& value)
+    {
+        // Write to a temporary file and rename it, so a concurrent Get or a crash never sees a partial file.
+        std::filesystem::path path = PathFor(key);
+        std::filesystem::path tempPath = m_directory / (key + "." + std::to_string(m_tempFileCount++) + ".tmp");
+        {
+            std::ofstream output(tempPath, std::ios::binary | std::ios::trunc);
+            output << value;
+            if (!output.good())
+            {
+                throw std::exception(std::string("Unable to write response cache file: " + tempPath.string()).c_str());
+            }
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::filesystem::rename(tempPath, path);
+        m_bytes += value.size();
+        if (m_bytes > m_maxBytes)
+        {
+            Evict();
+        }
+    }
+
+    void Report(std::ostream& output) const
+    {
+        output << "Response cache: " << m_hits << " hits, " << m_misses << " misses." << std::endl;
+    }
+};
@@ -4,129 +4,835 @@
 //
 #pragma once
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <random>
 #include <set>
 #include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
 // You can download libcurl from:
 // https://curl.se/download.html
 #include <curl/curl.h>
+// You can download zlib from:
+// https://zlib.net/
+#include <zlib.h>
 // You can download json.hpp from:
 // https://github.com/nlohmann/json/releases
 #include "json.hpp"
-#include "string_helper.h"
+#include "../common/string_helper.h"
+#include "trace_helper.h"
 
-enum class RequestType { HTTP_GET, HTTP_POST, HTTP_DELETE };
+enum class RequestType { HTTP_GET, HTTP_POST, HTTP_PUT, HTTP_DELETE };
 
 enum HTTPStatusCode {
     HTTP_OK = 200,
     HTTP_CREATED = 201,
     HTTP_ACCEPTED = 202,
-    HTTP_NO_CONTENT = 204
+    HTTP_NO_CONTENT = 204,
+    HTTP_TOO_MANY_REQUESTS = 429,
+    HTTP_INTERNAL_SERVER_ERROR = 500,
+    HTTP_BAD_GATEWAY = 502,
+    HTTP_SERVICE_UNAVAILABLE = 503,
+    HTTP_GATEWAY_TIMEOUT = 504
+};
+
+// The headers of a response, stored one after another in a single buffer rather than as a string pair each.
+class ResponseHeaders
+{
+private:
+    struct Field
+    {
+        size_t nameStart;
+        size_t nameSize;
+        size_t valueStart;
+        size_t valueSize;
+    };
+
+    std::string m_buffer;
+    // Fields refer to m_buffer by offset, since adding a header can move it.
+    std::vector<Field> m_fields;
+
+public:
+    void Add(std::string_view name, std::string_view value)
+    {
+        m_fields.push_back(Field { m_buffer.size(), name.size(), m_buffer.size() + name.size(), value.size() });
+        m_buffer.append(name).append(value);
+    }
+
+    void Clear()
+    {
+        m_buffer.clear();
+        m_fields.clear();
+    }
+
+    // Return the value of header *name*, which is case-insensitive, or an empty view if there is no such header.
+    // If the header was sent more than once, return the last value. The view is valid until the next call to Add or Clear.
+    std::string_view Get(std::string_view name) const
+    {
+        for (auto field = m_fields.rbegin(); field != m_fields.rend(); field++)
+        {
+            if (StringHelper::CaseInsensitiveCompare(name, std::string_view(m_buffer).substr(field->nameStart, field->nameSize)))
+            {
+                return std::string_view(m_buffer).substr(field->valueStart, field->valueSize);
+            }
+        }
+        return std::string_view();
+    }
 };
 
 struct RestResult
 {
+    // The response body, if it was not parsed as JSON or the caller asked to keep it. Otherwise empty.
     std::string text;
     nlohmann::json json;
-    std::map<std::string, std::string> headers;
+    ResponseHeaders headers;
     
-    RestResult(std::string text, nlohmann::json json, std::map<std::string, std::string> headers) : text(text), json(json), headers(headers) {}
+    RestResult(std::string text, nlohmann::json json, ResponseHeaders headers) : text(std::move(text)), json(std::move(json)), headers(std::move(headers)) {}
+};
+
+// A stream buffer that curl writes a response body into as it arrives, and that another thread reads the body from,
+// so the body can be parsed while it downloads instead of after it is all in memory. Write blocks while *capacity*
+// bytes are unread, so at most about that much of the body is held at once.
+class ResponseBodyStream : public std::streambuf
+{
+private:
+    const size_t m_capacity;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<std::string> m_chunks;
+    size_t m_unreadBytes = 0;
+    bool m_closed = false;
+    bool m_abandoned = false;
+    // The chunk the reader is reading from. Only the reader thread touches it.
+    std::string m_current;
+
+protected:
+    int_type underflow() override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this]() { return !m_chunks.empty() || m_closed; });
+        if (m_chunks.empty())
+        {
+            return traits_type::eof();
+        }
+        m_current = std::move(m_chunks.front());
+        m_chunks.pop_front();
+        m_unreadBytes -= m_current.size();
+        m_changed.notify_all();
+        setg(m_current.data(), m_current.data(), m_current.data() + m_current.size());
+        return traits_type::to_int_type(*gptr());
+    }
+
+public:
+    ResponseBodyStream(size_t capacity) : m_capacity(capacity) {}
+
+    // Return false if the reader has stopped reading, so the transfer should be stopped.
+    bool Write(const char* data, size_t size)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this]() { return m_unreadBytes < m_capacity || m_abandoned; });
+        if (m_abandoned)
+        {
+            return false;
+        }
+        m_chunks.emplace_back(data, size);
+        m_unreadBytes += size;
+        m_changed.notify_all();
+        return true;
+    }
+
+    // The body is complete, or the transfer failed. The reader sees the end of the stream after the unread chunks.
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_changed.notify_all();
+    }
+
+    // The reader has stopped reading. Later writes fail rather than wait.
+    void Abandon()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_abandoned = true;
+        m_changed.notify_all();
+    }
+};
+
+// Client-side rate control settings for one endpoint. See RestHelper::SetRateControl.
+struct RateControlOptions
+{
+    // Requests per second the endpoint accepts, for example the quota of your pricing tier. 0 means no limit.
+    double requestsPerSecond = 0.0;
+    // How many requests can be sent back to back after the endpoint has been idle. At least 1.
+    int burst = 1;
+    // How many times to retry a request that was throttled or failed with a transient error.
+    int maxRetries = 5;
+    // Retry delays are drawn with decorrelated jitter between these bounds, unless the service asks for longer with Retry-After.
+    int baseRetryDelayMilliseconds = 500;
+    int maxRetryDelayMilliseconds = 30000;
+    // After this many throttled responses in a row, stop sending requests to the endpoint for breakerCooldownMilliseconds
+    // (or longer, if the service asks for it with Retry-After). Then let one request through, and resume if it succeeds.
+    int breakerThreshold = 5;
+    int breakerCooldownMilliseconds = 2000;
+};
+
+// Rate control state for one endpoint: a token bucket that paces requests, a circuit breaker that pauses them while
+// the service is shedding load, and counters for the report. Shared by every thread that sends to the endpoint.
+class EndpointRateControl
+{
+private:
+    using Clock = std::chrono::steady_clock;
+    enum class BreakerState { Closed, Open, HalfOpen };
+
+    const RateControlOptions m_options;
+    std::mutex m_mutex;
+    std::condition_variable m_breakerChanged;
+    double m_tokens;
+    Clock::time_point m_lastRefill;
+    BreakerState m_breakerState = BreakerState::Closed;
+    Clock::time_point m_openUntil;
+    // True while the single request allowed through a half-open breaker is in flight.
+    bool m_probeInFlight = false;
+    int m_consecutiveThrottles = 0;
+
+    uint64_t m_requests = 0;
+    uint64_t m_throttled = 0;
+    uint64_t m_retries = 0;
+    uint64_t m_breakerOpens = 0;
+    double m_waitSeconds = 0.0;
+
+public:
+    EndpointRateControl(const RateControlOptions& options) : m_options(options), m_tokens(std::max(1, options.burst)), m_lastRefill(Clock::now()) {}
+
+    const RateControlOptions& Options() const
+    {
+        return m_options;
+    }
+
+    // Block until a request can be sent: the breaker is not open, and the token bucket has a token for us.
+    // Return true if this request is the one probe allowed through a half-open breaker. Pass that to Release.
+    bool Acquire()
+    {
+        auto start = Clock::now();
+        bool isProbe = false;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            if (BreakerState::Open == m_breakerState)
+            {
+                if (Clock::now() < m_openUntil)
+                {
+                    m_breakerChanged.wait_until(lock, m_openUntil);
+                    continue;
+                }
+                m_breakerState = BreakerState::HalfOpen;
+            }
+            if (BreakerState::HalfOpen == m_breakerState)
+            {
+                // Only one request probes the service. The others wait to see how it goes.
+                if (m_probeInFlight)
+                {
+                    m_breakerChanged.wait(lock);
+                    continue;
+                }
+                m_probeInFlight = true;
+                isProbe = true;
+            }
+            break;
+        }
+        m_requests++;
+
+        Clock::duration wait = Clock::duration::zero();
+        if (m_options.requestsPerSecond > 0.0)
+        {
+            auto now = Clock::now();
+            double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+            m_tokens = std::min(static_cast<double>(std::max(1, m_options.burst)), m_tokens + elapsed * m_options.requestsPerSecond);
+            m_lastRefill = now;
+            // Take the token now even if the bucket is empty, and wait until it would have been refilled. Requests
+            // that arrive meanwhile queue up behind us, so they are sent in order at the configured rate.
+            m_tokens -= 1.0;
+            if (m_tokens < 0.0)
+            {
+                wait = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-m_tokens / m_options.requestsPerSecond));
+            }
+        }
+        lock.unlock();
+
+        if (wait > Clock::duration::zero())
+        {
+            std::this_thread::sleep_for(wait);
+        }
+        double waited = std::chrono::duration<double>(Clock::now() - start).count();
+        lock.lock();
+        m_waitSeconds += waited;
+        return isProbe;
+    }
+
+    // Record the outcome of a request sent after Acquire. *throttled* is true if the service answered 429 or 503.
+    void Release(bool isProbe, bool throttled, std::chrono::milliseconds retryAfter)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        bool wasProbe = isProbe && BreakerState::HalfOpen == m_breakerState;
+        if (isProbe)
+        {
+            m_probeInFlight = false;
+        }
+        if (throttled)
+        {
+            m_throttled++;
+            m_consecutiveThrottles++;
+            if (wasProbe || (BreakerState::Closed == m_breakerState && m_consecutiveThrottles >= m_options.breakerThreshold))
+            {
+                m_breakerState = BreakerState::Open;
+                m_openUntil = Clock::now() + std::max<Clock::duration>(std::chrono::milliseconds(m_options.breakerCooldownMilliseconds), retryAfter);
+                m_breakerOpens++;
+                m_consecutiveThrottles = 0;
+            }
+        }
+        else
+        {
+            m_consecutiveThrottles = 0;
+            if (wasProbe)
+            {
+                m_breakerState = BreakerState::Closed;
+            }
+        }
+        m_breakerChanged.notify_all();
+    }
+
+    void CountRetry()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_retries++;
+    }
+
+    void Report(const std::string& endpoint, std::ostream& output)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        output << endpoint << ": " << m_requests << " requests, " << m_throttled << " throttled, " << m_retries << " retries, "
+            << m_breakerOpens << " circuit breaker openings, " << m_waitSeconds << " seconds waiting to send." << std::endl;
+    }
 };
 
 class RestHelper
 {
 private:
+    // Guards s_defaultRateControlOptions, s_rateControlOptions, s_rateControls and s_compressRequestEndpoints.
+    inline static std::mutex s_rateControlMutex;
+    inline static RateControlOptions s_defaultRateControlOptions;
+    // Keyed by endpoint, for example "https://westus.api.cognitive.microsoft.com".
+    inline static std::map<std::string, RateControlOptions> s_rateControlOptions;
+    inline static std::map<std::string, std::shared_ptr<EndpointRateControl>> s_rateControls;
+    // Endpoints that accept gzip-compressed request bodies. See SetCompressRequests.
+    inline static std::set<std::string> s_compressRequestEndpoints;
+
+    // Request bodies smaller than this are sent uncompressed, since gzip would save little and costs a header.
+    static const size_t minimumCompressedRequestBytes = 1024;
+    // Reserve at most this much for a response up front, however large its Content-Length.
+    static const size_t maxPresizedResponseBytes = 256 * 1024 * 1024;
+    // How much of a streamed response body can wait for its reader before curl waits too.
+    static const size_t streamedBodyCapacityBytes = 4 * 1024 * 1024;
+
+    // A response body that is passed to a reader on its own thread as it arrives. See SendGet.
+    struct StreamedBody
+    {
+        ResponseBodyStream stream { streamedBodyCapacityBytes };
+        std::thread thread;
+        // What the reader threw, if anything.
+        std::exception_ptr error;
+    };
+
+    // The result of a single attempt to send a request.
+    struct Attempt
+    {
+        CURLcode curlCode = CURLE_OK;
+        long statusCode = 0;
+        std::string response;
+        ResponseHeaders headers;
+        // Decoded bytes of the response body, whether kept in *response* or streamed.
+        size_t responseBytes = 0;
+        // Set while the request is performed, so ContentCallback can check the status code.
+        CURL* curl = nullptr;
+        const std::set<int>* expectedStatusCodes = nullptr;
+        // If set, the body of a response with an expected status code is streamed to it rather than kept in *response*.
+        const std::function<void(std::istream&)>* readBody = nullptr;
+        std::unique_ptr<StreamedBody> streamedBody;
+    };
+
+    // Return *content* compressed with gzip.
+    static std::string Gzip(const std::string& content)
+    {
+        z_stream stream {};
+        // Add 16 to the window bits to write a gzip header and trailer instead of a zlib one. Favor speed over
+        // ratio: JSON compresses well even at the fastest level, and this runs on the request path.
+        if (Z_OK != deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY))
+        {
+            throw std::exception("deflateInit2() failed.");
+        }
+        std::string compressed(deflateBound(&stream, static_cast<uLong>(content.size())), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(content.data()));
+        stream.avail_in = static_cast<uInt>(content.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&compressed[0]);
+        stream.avail_out = static_cast<uInt>(compressed.size());
+        int result = deflate(&stream, Z_FINISH);
+        compressed.resize(stream.total_out);
+        deflateEnd(&stream);
+        if (Z_STREAM_END != result)
+        {
+            throw std::exception("deflate() failed.");
+        }
+        return compressed;
+    }
+
+    static bool CompressRequestsFor(const std::string& url)
+    {
+        std::string endpoint = EndpointOf(url);
+        std::lock_guard<std::mutex> lock(s_rateControlMutex);
+        return s_compressRequestEndpoints.count(endpoint) > 0;
+    }
+
+    // Start passing the response body to *attempt.readBody* on its own thread.
+    static void StartStreamedBody(Attempt& attempt)
+    {
+        attempt.streamedBody = std::make_unique<StreamedBody>();
+        StreamedBody* body = attempt.streamedBody.get();
+        const std::function<void(std::istream&)>* readBody = attempt.readBody;
+        body->thread = std::thread([body, readBody]() {
+            try
+            {
+                std::istream input(&body->stream);
+                (*readBody)(input);
+            }
+            catch (...)
+            {
+                body->error = std::current_exception();
+            }
+            body->stream.Abandon();
+        });
+    }
+
+    // Wait for the reader of a streamed body to see the end of it and return.
+    static void FinishStreamedBody(Attempt& attempt)
+    {
+        if (attempt.streamedBody)
+        {
+            attempt.streamedBody->stream.Close();
+            attempt.streamedBody->thread.join();
+        }
+    }
+
+    static bool IsExpectedStatus(const Attempt& attempt)
+    {
+        long statusCode = 0;
+        curl_easy_getinfo(attempt.curl, CURLINFO_RESPONSE_CODE, &statusCode);
+        return attempt.expectedStatusCodes->count(static_cast<int>(statusCode)) > 0;
+    }
 
     static size_t ContentCallback(char *data, size_t size, size_t nmemb, void *userdata)
     {
-        std::string *response = (std::string *)userdata;
-        response->append(data, nmemb * size);
+        Attempt *attempt = (Attempt *)userdata;
+        if (0 == attempt->responseBytes && nullptr != attempt->readBody && !attempt->streamedBody && IsExpectedStatus(*attempt))
+        {
+            StartStreamedBody(*attempt);
+        }
+        attempt->responseBytes += nmemb * size;
+        if (attempt->streamedBody)
+        {
+            // Returning less than we were given makes curl stop the transfer.
+            return attempt->streamedBody->stream.Write(data, nmemb * size) ? nmemb * size : 0;
+        }
+        if (attempt->response.empty())
+        {
+            // All headers have arrived by now. Reserve the whole body at once instead of growing the buffer as it
+            // arrives. If the response is compressed, Content-Length is the compressed size, so this is a lower bound.
+            std::string_view contentLength = attempt->headers.Get("content-length");
+            size_t expected = 0;
+            std::from_chars(contentLength.data(), contentLength.data() + contentLength.size(), expected);
+            attempt->response.reserve(std::min(expected, maxPresizedResponseBytes));
+        }
+        attempt->response.append(data, nmemb * size);
         return nmemb * size;
     }
 
     static size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userdata)
     {
-        std::map<std::string, std::string> *headers = (std::map<std::string, std::string> *) userdata;
-        std::string header(buffer);
-        int index = header.find(':', 0);
-        if(std::string::npos != index)
+        ResponseHeaders *headers = (ResponseHeaders *)userdata;
+        std::string_view header(buffer, size * nitems);
+        size_t index = header.find(':', 0);
+        if (StringHelper::StartsWith(header, "HTTP/"))
+        {
+            // The status line of a new response, for example after "100 Continue". Keep only the last response's headers.
+            headers->Clear();
+        }
+        else if (std::string::npos != index)
         {
             // Use Trim to remove spaces before and after ':'.
-            headers->insert(std::pair<std::string, std::string>(StringHelper::Trim(header.substr(0, index)), StringHelper::Trim(header.substr(index + 2))));
+            headers->Add(StringHelper::Trim(header.substr(0, index)), StringHelper::Trim(header.substr(index + 1)));
         }
         return nitems * size;
     }
-    
-    static std::shared_ptr<RestResult> Send(const RequestType requestType, const std::string& certificatePath, const std::string& url, std::optional<std::string> content, const std::string& key, const std::set<int>& expectedStatusCodes)
+
+    // Return the scheme, host and port of *url*, for example "https://westus.api.cognitive.microsoft.com".
+    static std::string EndpointOf(const std::string& url)
+    {
+        size_t schemeEnd = url.find("://");
+        size_t hostStart = std::string::npos == schemeEnd ? 0 : schemeEnd + 3;
+        size_t hostEnd = url.find_first_of("/?#", hostStart);
+        return StringHelper::ToLower(std::string_view(url).substr(0, hostEnd));
+    }
+
+    static std::shared_ptr<EndpointRateControl> RateControlFor(const std::string& url)
+    {
+        std::string endpoint = EndpointOf(url);
+        std::lock_guard<std::mutex> lock(s_rateControlMutex);
+        auto rateControl = s_rateControls.find(endpoint);
+        if (rateControl == s_rateControls.end())
+        {
+            auto options = s_rateControlOptions.find(endpoint);
+            rateControl = s_rateControls.emplace(endpoint, std::make_shared<EndpointRateControl>(
+                options == s_rateControlOptions.end() ? s_defaultRateControlOptions : options->second)).first;
+        }
+        return rateControl->second;
+    }
+
+    // Return how long the service asked us to wait before retrying, or 0 if it did not say.
+    static std::chrono::milliseconds RetryAfter(const ResponseHeaders& headers)
+    {
+        // Parse a whole number, or return false if *value* is not one.
+        auto parse = [](std::string_view value, long long& number)
+        {
+            return !value.empty() && std::errc() == std::from_chars(value.data(), value.data() + value.size(), number).ec;
+        };
+        long long number = 0;
+        for (const char* name : { "retry-after-ms", "x-ms-retry-after-ms" })
+        {
+            if (parse(headers.Get(name), number))
+            {
+                return std::chrono::milliseconds(number);
+            }
+        }
+        // Retry-After can also be an HTTP date. We only handle the number of seconds.
+        if (parse(headers.Get("retry-after"), number))
+        {
+            return std::chrono::seconds(number);
+        }
+        return std::chrono::milliseconds::zero();
+    }
+
+    static bool IsThrottled(const Attempt& attempt)
+    {
+        return CURLE_OK == attempt.curlCode && (HTTP_TOO_MANY_REQUESTS == attempt.statusCode || HTTP_SERVICE_UNAVAILABLE == attempt.statusCode);
+    }
+
+    // A request that is not idempotent, such as a POST that creates a transcription, a conversation analysis job or a
+    // webhook, might have been acted on when it fails with a 5xx or a dropped connection, and sending it again could
+    // create a duplicate. So it is only retried when the server rejected it before acting on it (429, 503) or it never
+    // reached the server.
+    static bool IsTransient(bool idempotent, const Attempt& attempt)
+    {
+        if (!idempotent)
+        {
+            return IsThrottled(attempt) || CURLE_COULDNT_CONNECT == attempt.curlCode;
+        }
+        switch (attempt.curlCode)
+        {
+        case CURLE_OK:
+            return HTTP_TOO_MANY_REQUESTS == attempt.statusCode || HTTP_INTERNAL_SERVER_ERROR == attempt.statusCode
+                || HTTP_BAD_GATEWAY == attempt.statusCode || HTTP_SERVICE_UNAVAILABLE == attempt.statusCode
+                || HTTP_GATEWAY_TIMEOUT == attempt.statusCode;
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Decorrelated jitter: draw the next delay uniformly between the base delay and three times the previous delay,
+    // capped at the maximum. Concurrent clients that were throttled together spread out instead of retrying in lockstep.
+    static int NextRetryDelay(const RateControlOptions& options, int previousDelayMilliseconds)
+    {
+        thread_local std::mt19937 generator { std::random_device{}() };
+        int upper = std::max(options.baseRetryDelayMilliseconds, std::min(options.maxRetryDelayMilliseconds, previousDelayMilliseconds * 3));
+        std::uniform_int_distribution<int> distribution(options.baseRetryDelayMilliseconds, upper);
+        return distribution(generator);
+    }
+
+    static const char* MethodName(const RequestType requestType)
+    {
+        switch (requestType)
+        {
+        case RequestType::HTTP_POST: return "POST";
+        case RequestType::HTTP_PUT: return "PUT";
+        case RequestType::HTTP_DELETE: return "DELETE";
+        default: return "GET";
+        }
+    }
+
+    // Return *url* with the signature of any shared access signature replaced, so it can be logged or traced.
+    static std::string RedactUrl(const std::string& url)
+    {
+        size_t signature = url.find("sig=", url.find('?'));
+        if (std::string::npos == url.find('?') || std::string::npos == signature)
+        {
+            return url;
+        }
+        size_t signatureEnd = url.find('&', signature);
+        return url.substr(0, signature + 4) + "REDACTED" + (std::string::npos == signatureEnd ? std::string() : url.substr(signatureEnd));
+    }
+
+    // Return the method and path of a request, for example "GET /speechtotext/v3.1/transcriptions/123". Leave out
+    // the query, so spans for the same resource have the same name.
+    static std::string TraceName(const RequestType requestType, const std::string& url)
     {
-        CURLcode result;
-        CURL *curl_handle = curl_easy_init();
+        size_t pathStart = EndpointOf(url).size();
+        size_t pathEnd = url.find('?', pathStart);
+        return std::string(MethodName(requestType)) + " " + url.substr(pathStart, std::string::npos == pathEnd ? std::string::npos : pathEnd - pathStart);
+    }
+
+    // Record a span for each phase of the attempt that curl timed: DNS lookup, TCP connect, TLS handshake,
+    // waiting for the first byte of the response, and receiving the rest. *start* is when curl_easy_perform was called.
+    static void TraceAttemptPhases(CURL* curl_handle, std::chrono::steady_clock::time_point start, TraceSpan& attemptSpan)
+    {
+        curl_off_t nameLookup = 0, connect = 0, appConnect = 0, preTransfer = 0, startTransfer = 0, total = 0;
+        curl_easy_getinfo(curl_handle, CURLINFO_NAMELOOKUP_TIME_T, &nameLookup);
+        curl_easy_getinfo(curl_handle, CURLINFO_CONNECT_TIME_T, &connect);
+        curl_easy_getinfo(curl_handle, CURLINFO_APPCONNECT_TIME_T, &appConnect);
+        curl_easy_getinfo(curl_handle, CURLINFO_PRETRANSFER_TIME_T, &preTransfer);
+        curl_easy_getinfo(curl_handle, CURLINFO_STARTTRANSFER_TIME_T, &startTransfer);
+        curl_easy_getinfo(curl_handle, CURLINFO_TOTAL_TIME_T, &total);
+        // Each time is in microseconds from the start of the attempt. A phase that did not happen, such as
+        // the TLS handshake over plain HTTP or on a reused connection, is 0.
+        attemptSpan.AddArg("dnsMicroseconds", static_cast<int64_t>(nameLookup));
+        attemptSpan.AddArg("connectMicroseconds", static_cast<int64_t>(connect));
+        attemptSpan.AddArg("tlsMicroseconds", static_cast<int64_t>(appConnect));
+        attemptSpan.AddArg("firstByteMicroseconds", static_cast<int64_t>(startTransfer));
+        attemptSpan.AddArg("totalMicroseconds", static_cast<int64_t>(total));
+
+        auto phase = [start](const char* name, curl_off_t from, curl_off_t to)
+        {
+            if (to > from)
+            {
+                TraceHelper::Record(name, "http", start + std::chrono::microseconds(from), static_cast<int64_t>(to - from));
+            }
+        };
+        phase("DNS", 0, nameLookup);
+        phase("Connect", nameLookup, connect);
+        if (appConnect > 0)
+        {
+            phase("TLS", connect, appConnect);
+        }
+        phase("Wait for first byte", preTransfer, startTransfer);
+        phase("Receive", startTransfer, total);
+    }
+
+    // If *compressed* is true, *content* is gzip-compressed. If *key* is empty, no subscription key is sent, for example
+    // because *url* carries a shared access signature. *headers* are added to the request, for example "x-ms-version: 2021-08-06".
+    // If *readBody* is set, the body of a response with one of *expectedStatusCodes* is passed to it as it arrives. See SendGet.
+    static Attempt Perform(const RequestType requestType, const std::string& certificatePath, const std::string& url, const std::optional<std::string>& content, bool compressed, const std::string& key, const std::vector<std::string>& headers, const std::set<int>& expectedStatusCodes, const std::function<void(std::istream&)>& readBody)
+    {
+        std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl_handle(curl_easy_init(), curl_easy_cleanup);
+        if (nullptr == curl_handle)
+        {
+            throw std::exception("curl_easy_init() returned NULL.");
+        }
+        Attempt attempt;
+        attempt.curl = curl_handle.get();
+        attempt.expectedStatusCodes = &expectedStatusCodes;
+        attempt.readBody = readBody ? &readBody : nullptr;
+
+        curl_easy_setopt(curl_handle.get(), CURLOPT_SSL_VERIFYSTATUS, 1);
+        curl_easy_setopt(curl_handle.get(), CURLOPT_CAINFO, certificatePath.c_str());
+        curl_easy_setopt(curl_handle.get(), CURLOPT_CAPATH, certificatePath.c_str());
+
+        // Default is GET
+        if (RequestType::HTTP_POST == requestType)
+        {
+            curl_easy_setopt(curl_handle.get(), CURLOPT_CUSTOMREQUEST, "POST");
+        }
+        else if (RequestType::HTTP_PUT == requestType)
+        {
+            curl_easy_setopt(curl_handle.get(), CURLOPT_CUSTOMREQUEST, "PUT");
+        }
+        else if (RequestType::HTTP_DELETE == requestType)
+        {
+            curl_easy_setopt(curl_handle.get(), CURLOPT_CUSTOMREQUEST, "DELETE");
+        }
+
+        curl_easy_setopt(curl_handle.get(), CURLOPT_DEFAULT_PROTOCOL, "https");
+        curl_easy_setopt(curl_handle.get(), CURLOPT_URL, url.c_str());
+        // Ask for every encoding curl supports (gzip and deflate, for example). curl decodes the response as it
+        // arrives, so ContentCallback receives the decoded bytes and we never hold the compressed response. A streamed
+        // body is passed on to its reader from there, so it is parsed as it downloads.
+        curl_easy_setopt(curl_handle.get(), CURLOPT_ACCEPT_ENCODING, "");
+
+        curl_easy_setopt(curl_handle.get(), CURLOPT_WRITEFUNCTION, ContentCallback);
+        curl_easy_setopt(curl_handle.get(), CURLOPT_WRITEDATA, (void *)&attempt);
+        curl_easy_setopt(curl_handle.get(), CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(curl_handle.get(), CURLOPT_HEADERDATA, (void *)&attempt.headers);
+
         struct curl_slist *request_headers = NULL;
-        std::string response;
-        std::map<std::string, std::string> response_headers;
-        
-        if (NULL != curl_handle) {
-            curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYSTATUS, 1);
-            curl_easy_setopt(curl_handle, CURLOPT_CAINFO, certificatePath.c_str());
-            curl_easy_setopt(curl_handle, CURLOPT_CAPATH, certificatePath.c_str());
-            
-            // Default is GET
-            if (RequestType::HTTP_POST == requestType)
-            {
-                curl_easy_setopt(curl_handle, CURLOPT_CUSTOMREQUEST, "POST");
-            }
-            else if (RequestType::HTTP_DELETE == requestType)
-            {
-                curl_easy_setopt(curl_handle, CURLOPT_CUSTOMREQUEST, "DELETE");
-            }
-            
-            curl_easy_setopt(curl_handle, CURLOPT_DEFAULT_PROTOCOL, "https");
-            curl_easy_setopt(curl_handle, CURLOPT_URL, url.c_str());
-            
-            curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, ContentCallback);
-            curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&response);
-            curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, HeaderCallback);
-            curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&response_headers);
-            
+        if (!key.empty())
+        {
             request_headers = curl_slist_append(request_headers, std::string("Ocp-Apim-Subscription-Key: " + key).c_str());
-            if (RequestType::HTTP_POST == requestType)
+        }
+        if (RequestType::HTTP_POST == requestType)
+        {
+            request_headers = curl_slist_append(request_headers, "Content-Type: application/json");
+        }
+        for (const auto& header : headers)
+        {
+            request_headers = curl_slist_append(request_headers, header.c_str());
+        }
+        if (content.has_value())
+        {
+            if (compressed)
             {
-                request_headers = curl_slist_append(request_headers, "Content-Type: application/json");
-                curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, content.value().c_str());
+                request_headers = curl_slist_append(request_headers, "Content-Encoding: gzip");
             }
-            curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, request_headers);
-            result = curl_easy_perform(curl_handle);
-            if (CURLE_OK != result)
+            // By default curl sends "Expect: 100-continue" with larger bodies and waits a round trip for the answer
+            // before sending the body. Our requests are expected to succeed, so send the body right away.
+            request_headers = curl_slist_append(request_headers, "Expect:");
+            // Compressed content and audio can contain null characters, so give the size rather than letting curl call strlen.
+            curl_easy_setopt(curl_handle.get(), CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(content.value().size()));
+            curl_easy_setopt(curl_handle.get(), CURLOPT_POSTFIELDS, content.value().data());
+        }
+        curl_easy_setopt(curl_handle.get(), CURLOPT_HTTPHEADER, request_headers);
+        TraceSpan attemptSpan("Attempt", "http");
+        auto start = std::chrono::steady_clock::now();
+        attempt.curlCode = curl_easy_perform(curl_handle.get());
+        curl_slist_free_all(request_headers);
+        if (CURLE_OK == attempt.curlCode)
+        {
+            curl_easy_getinfo(curl_handle.get(), CURLINFO_RESPONSE_CODE, &attempt.statusCode);
+            attemptSpan.AddArg("status", attempt.statusCode);
+            // An expected response with an empty body still goes to the reader, which decides whether that is valid.
+            if (nullptr != attempt.readBody && !attempt.streamedBody && IsExpectedStatus(attempt))
             {
-                std::ostringstream error;
-                error << "curl_easy_perform() failed: " << curl_easy_strerror(result);
-                throw std::exception(error.str().c_str());
+                StartStreamedBody(attempt);
             }
+        }
+        else
+        {
+            attemptSpan.AddArg("error", curl_easy_strerror(attempt.curlCode));
+        }
+        if (TraceHelper::Enabled())
+        {
+            // Bytes on the wire, so compressed when the request or response was compressed.
+            curl_off_t bytesSent = 0, bytesReceived = 0;
+            curl_easy_getinfo(curl_handle.get(), CURLINFO_SIZE_UPLOAD_T, &bytesSent);
+            curl_easy_getinfo(curl_handle.get(), CURLINFO_SIZE_DOWNLOAD_T, &bytesReceived);
+            attemptSpan.AddArg("bytesSent", static_cast<int64_t>(bytesSent));
+            attemptSpan.AddArg("bytesReceived", static_cast<int64_t>(bytesReceived));
+            attemptSpan.AddArg("responseBytes", attempt.responseBytes);
+            TraceAttemptPhases(curl_handle.get(), start, attemptSpan);
+        }
+        FinishStreamedBody(attempt);
+        attempt.curl = nullptr;
+        return attempt;
+    }
 
-            long responseCode = 0;
-            curl_easy_getinfo (curl_handle, CURLINFO_RESPONSE_CODE, &responseCode);
-            if (!std::any_of(expectedStatusCodes.begin(), expectedStatusCodes.end(), [responseCode](int statusCode){ return statusCode == responseCode; }))
+    // Send a request, pacing it and retrying it as configured for its endpoint. See RateControlOptions.
+    // If *parseJson* is true, the response is parsed, and its text is only returned as well if *keepText* is true.
+    // If *idempotent* is false, only failures that show the request was not acted on are retried. See IsTransient.
+    // If *readBody* is set, the response is streamed to it instead. See SendGet.
+    static std::shared_ptr<RestResult> Send(const RequestType requestType, const std::string& certificatePath, const std::string& url, std::optional<std::string> content, const std::string& key, const std::vector<std::string>& headers, const std::set<int>& expectedStatusCodes, bool idempotent, bool parseJson, bool keepText, const std::function<void(std::istream&)>& readBody)
+    {
+        TraceSpan requestSpan(TraceName(requestType, url), "http");
+        requestSpan.AddArg("url", RedactUrl(url));
+        // Compress once, rather than on every retry.
+        bool compressed = false;
+        if (content.has_value() && content.value().size() >= minimumCompressedRequestBytes && CompressRequestsFor(url))
+        {
+            content = Gzip(content.value());
+            compressed = true;
+        }
+        std::shared_ptr<EndpointRateControl> rateControl = RateControlFor(url);
+        const RateControlOptions& options = rateControl->Options();
+        int retryDelayMilliseconds = options.baseRetryDelayMilliseconds;
+        for (int retry = 0; ; retry++)
+        {
+            bool isProbe = false;
             {
-                std::ostringstream error;
-                error << "The response from " << url << " has an unexpected status code: " + responseCode << ". Response:\n" << response;
-                throw std::exception(error.str().c_str());
+                TraceSpan waitSpan("Rate control", "http");
+                isProbe = rateControl->Acquire();
+            }
+            requestSpan.AddArg("retries", retry);
+            Attempt attempt;
+            try
+            {
+                attempt = Perform(requestType, certificatePath, url, content, compressed, key, headers, expectedStatusCodes, readBody);
             }
+            catch (...)
+            {
+                rateControl->Release(isProbe, false, std::chrono::milliseconds::zero());
+                throw;
+            }
+            std::chrono::milliseconds retryAfter = RetryAfter(attempt.headers);
+            rateControl->Release(isProbe, IsThrottled(attempt), retryAfter);
 
-            curl_easy_cleanup(curl_handle);
-            curl_slist_free_all(request_headers);
-            if (!response.empty())
+            // If the reader failed on a complete body, or stopped the transfer by failing, the body itself is bad and a
+            // retry would not help. If the transfer failed first, the reader only saw a truncated body, so retry as usual.
+            if (attempt.streamedBody && attempt.streamedBody->error && (CURLE_OK == attempt.curlCode || CURLE_WRITE_ERROR == attempt.curlCode))
             {
-                return std::make_shared<RestResult>(response, nlohmann::json::parse(response), response_headers);
+                std::rethrow_exception(attempt.streamedBody->error);
             }
-            else
+            if (CURLE_OK == attempt.curlCode && expectedStatusCodes.count(static_cast<int>(attempt.statusCode)) > 0)
             {
-                return std::make_shared<RestResult>(response, nlohmann::json(), response_headers);
+                if (readBody)
+                {
+                    return std::make_shared<RestResult>(std::string(), nlohmann::json(), std::move(attempt.headers));
+                }
+                else if (parseJson && !attempt.response.empty())
+                {
+                    // Parse straight from the receive buffer, then drop it unless the caller wants the text too.
+                    nlohmann::json json = nlohmann::json::parse(attempt.response);
+                    return std::make_shared<RestResult>(keepText ? std::move(attempt.response) : std::string(), std::move(json), std::move(attempt.headers));
+                }
+                else
+                {
+                    return std::make_shared<RestResult>(std::move(attempt.response), nlohmann::json(), std::move(attempt.headers));
+                }
             }
-        }
-        else
-        {
-            throw std::exception("curl_easy_init() returned NULL.");
+
+            if (!IsTransient(idempotent, attempt) || retry >= options.maxRetries)
+            {
+                std::ostringstream error;
+                if (CURLE_OK != attempt.curlCode)
+                {
+                    error << "curl_easy_perform() failed: " << curl_easy_strerror(attempt.curlCode);
+                }
+                else
+                {
+                    error << "The response from " << RedactUrl(url) << " has an unexpected status code: " << attempt.statusCode << ". Response:\n" << attempt.response;
+                }
+                if (retry > 0)
+                {
+                    error << "\n(after " << retry << " retries)";
+                }
+                throw std::exception(error.str().c_str());
+            }
+
+            retryDelayMilliseconds = NextRetryDelay(options, retryDelayMilliseconds);
+            rateControl->CountRetry();
+            TraceSpan backoffSpan("Retry backoff", "http");
+            std::this_thread::sleep_for(std::max<std::chrono::milliseconds>(std::chrono::milliseconds(retryDelayMilliseconds), retryAfter));
         }
     }
     
@@ -141,19 +847,77 @@ public:
         curl_global_cleanup();
     }
 
-    static std::shared_ptr<RestResult> SendGet(const std::string& certificatePath, const std::string& url, const std::string& key, const std::set<int>& expectedStatusCodes)
+    // Set the rate control options for endpoints that have none of their own. Takes effect for endpoints that have not been used yet.
+    static void SetDefaultRateControl(const RateControlOptions& options)
     {
-        std::string content;
-        return Send(RequestType::HTTP_GET, certificatePath, url, std::nullopt, key, expectedStatusCodes);
+        std::lock_guard<std::mutex> lock(s_rateControlMutex);
+        s_defaultRateControlOptions = options;
+    }
+
+    // Set the rate control options for the endpoint of *url*. Takes effect if the endpoint has not been used yet.
+    static void SetRateControl(const std::string& url, const RateControlOptions& options)
+    {
+        std::string endpoint = EndpointOf(url);
+        std::lock_guard<std::mutex> lock(s_rateControlMutex);
+        s_rateControlOptions[endpoint] = options;
+    }
+
+    // Send POST bodies to the endpoint of *url* gzip-compressed, with Content-Encoding: gzip. Only enable this for
+    // endpoints that accept compressed requests. Responses are decompressed for every endpoint regardless.
+    static void SetCompressRequests(const std::string& url, bool compress)
+    {
+        std::string endpoint = EndpointOf(url);
+        std::lock_guard<std::mutex> lock(s_rateControlMutex);
+        if (compress)
+        {
+            s_compressRequestEndpoints.insert(endpoint);
+        }
+        else
+        {
+            s_compressRequestEndpoints.erase(endpoint);
+        }
+    }
+
+    // Write request, throttling and retry counts for each endpoint used so far.
+    static void ReportRateControl(std::ostream& output)
+    {
+        std::lock_guard<std::mutex> lock(s_rateControlMutex);
+        for (const auto& rateControl : s_rateControls)
+        {
+            rateControl.second->Report(rateControl.first, output);
+        }
+    }
+
+    // Set *keepText* to true to receive the text of the parsed response as well, for example to cache it.
+    static std::shared_ptr<RestResult> SendGet(const std::string& certificatePath, const std::string& url, const std::string& key, const std::set<int>& expectedStatusCodes, bool keepText = false)
+    {
+        return Send(RequestType::HTTP_GET, certificatePath, url, std::nullopt, key, {}, expectedStatusCodes, true, true, keepText, nullptr);
+    }
+
+    // Pass the response body to *readBody* as it downloads, for example to parse a large response with a SAX reader
+    // without holding it in memory. *readBody* runs on another thread, and runs again from the start if the request is
+    // retried, so it must replace rather than add to what an earlier run produced. If it throws, SendGet throws the
+    // same exception. The returned result has the headers but no text or JSON.
+    static std::shared_ptr<RestResult> SendGet(const std::string& certificatePath, const std::string& url, const std::string& key, const std::set<int>& expectedStatusCodes, const std::function<void(std::istream&)>& readBody)
+    {
+        return Send(RequestType::HTTP_GET, certificatePath, url, std::nullopt, key, {}, expectedStatusCodes, true, false, false, readBody);
     }
     
-    static std::shared_ptr<RestResult> SendPost(const std::string& certificatePath, const std::string& url, const std::string& content, const std::string& key, const std::set<int>& expectedStatusCodes)
+    // Set *idempotent* to true for a POST that only reads, such as an analysis request, so it is retried like a GET.
+    static std::shared_ptr<RestResult> SendPost(const std::string& certificatePath, const std::string& url, const std::string& content, const std::string& key, const std::set<int>& expectedStatusCodes, bool idempotent = false, bool keepText = false)
+    {
+        return Send(RequestType::HTTP_POST, certificatePath, url, std::optional<std::string> { content }, key, {}, expectedStatusCodes, idempotent, true, keepText, nullptr);
+    }
+
+    // Send *content* with no subscription key, for example to a storage URL with a shared access signature.
+    // The response is not parsed as JSON.
+    static std::shared_ptr<RestResult> SendPut(const std::string& certificatePath, const std::string& url, std::string content, const std::vector<std::string>& headers, const std::set<int>& expectedStatusCodes)
     {
-        return Send(RequestType::HTTP_POST, certificatePath, url, std::optional<std::string> { content }, key, expectedStatusCodes);
+        return Send(RequestType::HTTP_PUT, certificatePath, url, std::optional<std::string> { std::move(content) }, std::string(), headers, expectedStatusCodes, true, false, false, nullptr);
     }
     
     static std::shared_ptr<RestResult> SendDelete(const std::string& certificatePath, const std::string& url, const std::string& key, const std::set<int>& expectedStatusCodes)
     {
-        return Send(RequestType::HTTP_DELETE, certificatePath, url, std::nullopt, key, expectedStatusCodes);
+        return Send(RequestType::HTTP_DELETE, certificatePath, url, std::nullopt, key, {}, expectedStatusCodes, true, true, false, nullptr);
     }
 };
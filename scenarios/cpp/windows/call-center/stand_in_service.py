@@ -0,0 +1,507 @@
+#
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+#
+# Local stand-in for the Speech batch transcription and Cognitive Language REST APIs used by call_center.
+# Use it to load test and profile the call center pipeline without a network or service quota.
+#
+# Usage:
+#   python stand_in_service.py [--port 8080] [--latencyMs 50] [--jitterMs 20] [--errorRate 0.0]
+#                              [--throttleRate 0.0] [--retryAfterSeconds 1] [--quotaPerSecond 0]
+#                              [--jobSeconds 2] [--conversationItemMs 0] [--phrasesPerCall 50]
+#                              [--noCompression] [--bandwidthMbps 0] [--filesPageSize 100]
+#                              [--callbackDropRate 0.0]
+#
+# Then point call_center at it, for example:
+#   call_center --benchmark 20 --concurrency 4 --pollIntervalMs 250 --certificate cacert.pem
+#               --speechEndpoint http://localhost:8080 --speechKey any
+#               --languageEndpoint http://localhost:8080 --languageKey any
+#
+# Implemented routes:
+#   POST   /speechtotext/v3.0/transcriptions
+#   GET    /speechtotext/v3.0/transcriptions/{id}
+#   GET    /speechtotext/v3.0/transcriptions/{id}/files?skip={n}          (paged with @nextLink)
+#   DELETE /speechtotext/v3.0/transcriptions/{id}
+#   POST   /speechtotext/v3.0/webhooks
+#   DELETE /speechtotext/v3.0/webhooks/{id}
+#   GET    /content/{id}/{index}                         (transcription result file)
+#   POST   /language/:analyze-text
+#   POST   /language/analyze-conversations/jobs
+#   GET    /language/analyze-conversations/jobs/{id}
+#   PUT    /devstoreaccount1/{container}/{blob}?comp=block&blockid={id}   (Put Block, as Azurite serves it)
+#   PUT    /devstoreaccount1/{container}/{blob}?comp=blocklist            (Put Block List)
+#   GET    /devstoreaccount1/{container}/{blob}
+#
+# A web hook is sent a validation challenge when it is created. Once it answers, it is sent a
+# TranscriptionCompletion callback when each transcription completes, except for the fraction given by
+# --callbackDropRate, which lets you test that call_center falls back to polling.
+#
+# Transcriptions of a content URL that points at a blob on this server fail if the blob does not exist.
+#
+# Responses of 1 KB or more are gzip-compressed if the request has Accept-Encoding: gzip, unless --noCompression
+# is present. Requests with Content-Encoding: gzip are decompressed.
+#
+
+import argparse
+import gzip
+import json
+import random
+import threading
+import time
+import urllib.request
+import uuid
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+import xml.etree.ElementTree as ElementTree
+from urllib.parse import parse_qs, urlparse
+
+TRANSCRIPTIONS_PATH = "/speechtotext/v3.0/transcriptions"
+WEBHOOKS_PATH = "/speechtotext/v3.0/webhooks"
+SENTIMENT_PATH = "/language/:analyze-text"
+CONVERSATION_JOBS_PATH = "/language/analyze-conversations/jobs"
+# Azurite serves blobs of its default account under this path.
+BLOB_PATH = "/devstoreaccount1/"
+
+# Responses smaller than this are not compressed.
+MINIMUM_COMPRESSED_BYTES = 1024
+
+WORDS = ["account", "billing", "internet", "router", "payment", "refund", "service", "technician", "schedule", "password"]
+
+
+class State:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.transcriptions = {}
+        self.conversation_jobs = {}
+        # Web hook ID -> {"webUrl", "validated"}.
+        self.webhooks = {}
+        self.callbacks_sent = 0
+        self.requests = 0
+        self.throttled = 0
+        # Blob path -> {block ID: bytes} for uncommitted blocks, and blob path -> bytes for committed blobs.
+        self.blocks = {}
+        self.blobs = {}
+        # Body bytes on the wire, after compression.
+        self.bytes_received = 0
+        self.bytes_sent = 0
+        # Per-service token buckets for --quotaPerSecond: service -> (tokens, last refill time).
+        self.quota = {}
+
+    # Take a token from the bucket for *service*. Return False if the quota is used up.
+    def take_quota(self, service, rate):
+        now = time.time()
+        with self.lock:
+            tokens, last = self.quota.get(service, (rate, now))
+            tokens = min(rate, tokens + (now - last) * rate)
+            if tokens < 1.0:
+                self.quota[service] = (tokens, now)
+                self.throttled += 1
+                return False
+            self.quota[service] = (tokens - 1.0, now)
+            return True
+
+
+def post_callback(url, event, body=None):
+    request = urllib.request.Request(url, data=json.dumps(body or {}).encode("utf-8"), method="POST",
+                                     headers={"Content-Type": "application/json", "X-MicrosoftSpeechServices-Event": event})
+    with urllib.request.urlopen(request, timeout=10) as response:
+        return response.read().decode("utf-8", "replace")
+
+
+# Like the service, send a validation token to a new web hook, which must send it back.
+def validate_webhook(state, webhook_id):
+    with state.lock:
+        webhook = state.webhooks.get(webhook_id)
+    if webhook is None:
+        return
+    token = str(uuid.uuid4())
+    separator = "&" if "?" in webhook["webUrl"] else "?"
+    try:
+        validated = token in post_callback(webhook["webUrl"] + separator + "validationToken=" + token, "Challenge")
+    except OSError:
+        validated = False
+    with state.lock:
+        webhook["validated"] = validated
+
+
+def send_completion_callbacks(state, options, transcription_url, status):
+    with state.lock:
+        web_urls = [webhook["webUrl"] for webhook in state.webhooks.values() if webhook["validated"]]
+    for web_url in web_urls:
+        if random.random() < options.callbackDropRate:
+            continue
+        try:
+            post_callback(web_url, "TranscriptionCompletion", {"self": transcription_url, "status": status})
+            with state.lock:
+                state.callbacks_sent += 1
+        except OSError:
+            pass
+
+
+def synthetic_transcription(source, phrase_count, diarization):
+    phrases = []
+    for index in range(phrase_count):
+        channel = 0 if diarization else index % 2
+        offset_in_ticks = index * 30000000
+        words = " ".join(random.choice(WORDS) for _ in range(8))
+        display = "Phrase %d about my %s." % (index, words)
+        phrase = {
+            "recognitionStatus": "Success",
+            "channel": channel,
+            "offset": "PT%gS" % (offset_in_ticks / 1e7),
+            "duration": "PT2.5S",
+            "offsetInTicks": float(offset_in_ticks),
+            "durationInTicks": 25000000.0,
+            "nBest": [
+                {
+                    "confidence": 0.9,
+                    "lexical": display.lower().rstrip("."),
+                    "itn": display.lower().rstrip("."),
+                    "maskedITN": display.lower().rstrip("."),
+                    "display": display,
+                    "words": [
+                        {"word": word, "offset": "PT0S", "duration": "PT0.3S", "offsetInTicks": 0.0, "durationInTicks": 3000000.0, "confidence": 0.9}
+                        for word in display.split(" ")
+                    ],
+                }
+            ],
+        }
+        if diarization:
+            phrase["speaker"] = 1 + index % 2
+        phrases.append(phrase)
+    # Like the batch service, return stereo phrases sorted by channel.
+    phrases.sort(key=lambda phrase: phrase["channel"])
+    return {
+        "source": source,
+        "timestamp": "2023-01-01T00:00:00Z",
+        "durationInTicks": phrase_count * 30000000,
+        "duration": "PT%dS" % (phrase_count * 3),
+        "combinedRecognizedPhrases": [],
+        "recognizedPhrases": phrases,
+    }
+
+
+def sentiment_results(documents):
+    results = []
+    for document in documents:
+        scores = [random.random() for _ in range(3)]
+        total = sum(scores)
+        positive, neutral, negative = (round(score / total, 2) for score in scores)
+        sentiment = ["positive", "neutral", "negative"][scores.index(max(scores))]
+        results.append({
+            "id": str(document["id"]),
+            "sentiment": sentiment,
+            "confidenceScores": {"positive": positive, "neutral": neutral, "negative": negative},
+            "sentences": [],
+            "warnings": [],
+        })
+    return {"kind": "SentimentAnalysisResults", "results": {"documents": results, "errors": [], "modelVersion": "stand-in"}}
+
+
+def conversation_results(job):
+    conversations = job["analysisInput"]["conversations"]
+    summaries = []
+    pii = []
+    for conversation in conversations:
+        items = conversation["conversationItems"]
+        summaries.append({
+            "id": conversation["id"],
+            "summaries": [
+                {"aspect": "issue", "text": "Customer called about %d topics." % len(items)},
+                {"aspect": "resolution", "text": "Agent resolved the issue."},
+            ],
+            "warnings": [],
+        })
+        conversation_items = []
+        for item in items:
+            entities = []
+            if 0 == int(item["id"]) % 5:
+                entities.append({"text": "555-0100", "category": "PhoneNumber", "offset": 0, "length": 8, "confidenceScore": 0.8})
+            conversation_items.append({
+                "id": str(item["id"]),
+                "redactedContent": {"text": item["text"], "itn": item["itn"], "lexical": item["lexical"]},
+                "entities": entities,
+            })
+        pii.append({"id": conversation["id"], "conversationItems": conversation_items, "warnings": []})
+    return {
+        "jobId": job["id"],
+        "status": "succeeded",
+        "tasks": {
+            "completed": 2,
+            "failed": 0,
+            "inProgress": 0,
+            "total": 2,
+            "items": [
+                {"kind": "conversationalSummarizationResults", "taskName": "summary_1", "status": "succeeded",
+                 "results": {"conversations": summaries, "errors": [], "modelVersion": "stand-in"}},
+                {"kind": "conversationalPIIResults", "taskName": "PII_1", "status": "succeeded",
+                 "results": {"conversations": pii, "errors": [], "modelVersion": "stand-in"}},
+            ],
+        },
+    }
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *args):
+        if self.server.options.verbose:
+            super().log_message(format, *args)
+
+    def base_url(self):
+        return "http://%s" % self.headers.get("Host", "localhost:%d" % self.server.options.port)
+
+    def read_body(self):
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length) if length > 0 else b""
+        with self.server.state.lock:
+            self.server.state.bytes_received += len(body)
+        if "gzip" == self.headers.get("Content-Encoding", "").strip().lower():
+            body = gzip.decompress(body)
+        return body
+
+    def send(self, status, body=None, headers=None, content_type="application/json; charset=utf-8"):
+        data = b"" if body is None else body if isinstance(body, bytes) else json.dumps(body).encode("utf-8")
+        accept_encoding = [encoding.split(";")[0].strip().lower() for encoding in self.headers.get("Accept-Encoding", "").split(",")]
+        # Like Blob Storage, serve blobs as they are stored.
+        compress = (not self.server.options.noCompression and len(data) >= MINIMUM_COMPRESSED_BYTES and "gzip" in accept_encoding
+                    and content_type.startswith("application/json"))
+        if compress:
+            data = gzip.compress(data, compresslevel=6)
+        with self.server.state.lock:
+            self.server.state.bytes_sent += len(data)
+        self.send_response(status)
+        for name, value in (headers or {}).items():
+            self.send_header(name, value)
+        if data:
+            self.send_header("Content-Type", content_type)
+        if compress:
+            self.send_header("Content-Encoding", "gzip")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        bandwidth = self.server.options.bandwidthMbps * 1000000 / 8
+        if bandwidth <= 0:
+            self.wfile.write(data)
+            return
+        # Simulate a network link: send in chunks, each taking as long as it would at the configured bandwidth.
+        chunk_size = 64 * 1024
+        for start in range(0, len(data), chunk_size):
+            chunk = data[start:start + chunk_size]
+            self.wfile.write(chunk)
+            time.sleep(len(chunk) / bandwidth)
+
+    # Apply the configured latency, errors and throttling. Return True if the request was already answered.
+    def simulate(self):
+        options = self.server.options
+        with self.server.state.lock:
+            self.server.state.requests += 1
+        time.sleep(max(0.0, options.latencyMs + random.uniform(-options.jitterMs, options.jitterMs)) / 1000.0)
+        service = "language" if self.path.startswith("/language") else "speech"
+        if options.quotaPerSecond > 0 and not self.server.state.take_quota(service, options.quotaPerSecond):
+            self.send(429, {"error": {"code": "429", "message": "Quota exceeded."}}, {"Retry-After": str(options.retryAfterSeconds)})
+            return True
+        if random.random() < options.throttleRate:
+            with self.server.state.lock:
+                self.server.state.throttled += 1
+            self.send(429, {"error": {"code": "429", "message": "Rate limit exceeded."}}, {"Retry-After": str(options.retryAfterSeconds)})
+            return True
+        if random.random() < options.errorRate:
+            self.send(500, {"error": {"code": "InternalServerError", "message": "Simulated failure."}})
+            return True
+        return False
+
+    def blob_exists(self, url):
+        parsed = urlparse(url)
+        if not parsed.path.startswith(BLOB_PATH) or parsed.netloc != self.headers.get("Host", ""):
+            return True
+        with self.server.state.lock:
+            return parsed.path in self.server.state.blobs
+
+    def do_PUT(self):
+        body = self.read_body()
+        if self.simulate():
+            return
+        parsed = urlparse(self.path)
+        query = parse_qs(parsed.query)
+        state = self.server.state
+        if not parsed.path.startswith(BLOB_PATH) or len(parsed.path[len(BLOB_PATH):].split("/")) < 2:
+            self.send(404, {"error": {"code": "NotFound", "message": parsed.path}})
+        elif ["block"] == query.get("comp") and "blockid" in query:
+            with state.lock:
+                state.blocks.setdefault(parsed.path, {})[query["blockid"][0]] = body
+            self.send(201)
+        elif ["blocklist"] == query.get("comp"):
+            block_ids = [element.text for element in ElementTree.fromstring(body)]
+            with state.lock:
+                blocks = state.blocks.get(parsed.path, {})
+                missing = [block_id for block_id in block_ids if block_id not in blocks]
+                if not missing:
+                    state.blobs[parsed.path] = b"".join(blocks[block_id] for block_id in block_ids)
+                    state.blocks.pop(parsed.path, None)
+            if missing:
+                self.send(400, b"<Error><Code>InvalidBlockList</Code></Error>", None, "application/xml")
+            else:
+                self.send(201)
+        else:
+            self.send(400, b"<Error><Code>InvalidQueryParameterValue</Code></Error>", None, "application/xml")
+
+    def job_done(self, created, extra_seconds=0.0):
+        return time.time() - created >= self.server.options.jobSeconds + extra_seconds
+
+    @staticmethod
+    def conversation_item_count(job):
+        return sum(len(conversation["conversationItems"]) for conversation in job["request"]["analysisInput"]["conversations"])
+
+    def do_POST(self):
+        body = self.read_body()
+        if self.simulate():
+            return
+        path = urlparse(self.path).path
+        state = self.server.state
+        if path == TRANSCRIPTIONS_PATH:
+            request = json.loads(body)
+            transcription_id = str(uuid.uuid4())
+            with state.lock:
+                state.transcriptions[transcription_id] = {
+                    "created": time.time(),
+                    "contentUrls": request.get("contentUrls", []),
+                    "diarization": request.get("properties", {}).get("diarizationEnabled", False),
+                }
+            transcription_url = self.base_url() + TRANSCRIPTIONS_PATH + "/" + transcription_id
+            status = "Succeeded" if all(self.blob_exists(url) for url in request.get("contentUrls", [])) else "Failed"
+            timer = threading.Timer(self.server.options.jobSeconds, send_completion_callbacks, (state, self.server.options, transcription_url, status))
+            timer.daemon = True
+            timer.start()
+            self.send(201, {"self": transcription_url, "status": "NotStarted"})
+        elif path == WEBHOOKS_PATH:
+            request = json.loads(body)
+            webhook_id = str(uuid.uuid4())
+            with state.lock:
+                state.webhooks[webhook_id] = {"webUrl": request["webUrl"], "validated": False}
+            threading.Thread(target=validate_webhook, args=(state, webhook_id), daemon=True).start()
+            self.send(201, {"self": self.base_url() + WEBHOOKS_PATH + "/" + webhook_id, "webUrl": request["webUrl"]})
+        elif path == SENTIMENT_PATH:
+            request = json.loads(body)
+            self.send(200, sentiment_results(request["analysisInput"]["documents"]))
+        elif path == CONVERSATION_JOBS_PATH:
+            request = json.loads(body)
+            job_id = str(uuid.uuid4())
+            request["id"] = job_id
+            with state.lock:
+                state.conversation_jobs[job_id] = {"created": time.time(), "request": request}
+            location = self.base_url() + CONVERSATION_JOBS_PATH + "/" + job_id + "?api-version=2022-05-15-preview"
+            self.send(202, None, {"operation-location": location})
+        else:
+            self.send(404, {"error": {"code": "NotFound", "message": path}})
+
+    def do_GET(self):
+        if self.simulate():
+            return
+        path = urlparse(self.path).path
+        state = self.server.state
+        parts = path.strip("/").split("/")
+        if path.startswith(TRANSCRIPTIONS_PATH + "/"):
+            transcription_id = parts[3]
+            with state.lock:
+                transcription = state.transcriptions.get(transcription_id)
+            if transcription is None:
+                self.send(404, {"error": {"code": "NotFound", "message": transcription_id}})
+            elif 5 == len(parts) and "files" == parts[4]:
+                values = [
+                    {"kind": "Transcription", "name": "contenturl_%d.json" % index,
+                     "links": {"contentUrl": "%s/content/%s/%d" % (self.base_url(), transcription_id, index)}}
+                    for index in range(len(transcription["contentUrls"]))
+                ]
+                values.append({"kind": "TranscriptionReport", "name": "report.json", "links": {"contentUrl": self.base_url() + "/content/report"}})
+                # Like the service, return at most a page of files, with a link to the next page.
+                skip = int(parse_qs(urlparse(self.path).query).get("skip", ["0"])[0])
+                page_size = max(1, self.server.options.filesPageSize)
+                response = {"values": values[skip:skip + page_size]}
+                if skip + page_size < len(values):
+                    response["@nextLink"] = "%s%s?skip=%d" % (self.base_url(), path, skip + page_size)
+                self.send(200, response)
+            elif not all(self.blob_exists(url) for url in transcription["contentUrls"]):
+                self.send(200, {"self": self.base_url() + path, "status": "Failed", "properties": {"error": {"code": "InvalidData", "message": "The blob does not exist."}}})
+            else:
+                status = "Succeeded" if self.job_done(transcription["created"]) else "Running"
+                self.send(200, {"self": self.base_url() + path, "status": status})
+        elif path.startswith("/content/") and 3 == len(parts):
+            with state.lock:
+                transcription = state.transcriptions.get(parts[1])
+            if transcription is None:
+                self.send(404, {"error": {"code": "NotFound", "message": parts[1]}})
+            else:
+                source = transcription["contentUrls"][int(parts[2])]
+                self.send(200, synthetic_transcription(source, self.server.options.phrasesPerCall, transcription["diarization"]))
+        elif path.startswith(BLOB_PATH):
+            with state.lock:
+                blob = state.blobs.get(path)
+            if blob is None:
+                self.send(404, b"<Error><Code>BlobNotFound</Code></Error>", None, "application/xml")
+            else:
+                self.send(200, blob, None, "application/octet-stream")
+        elif path.startswith(CONVERSATION_JOBS_PATH + "/"):
+            with state.lock:
+                job = state.conversation_jobs.get(parts[3])
+            if job is None:
+                self.send(404, {"error": {"code": "NotFound", "message": parts[3]}})
+            elif self.job_done(job["created"], self.conversation_item_count(job) * self.server.options.conversationItemMs / 1000.0):
+                self.send(200, conversation_results(job["request"]))
+            else:
+                self.send(200, {"jobId": parts[3], "status": "running", "tasks": {"items": []}})
+        else:
+            self.send(404, {"error": {"code": "NotFound", "message": path}})
+
+    def do_DELETE(self):
+        if self.simulate():
+            return
+        path = urlparse(self.path).path
+        if path.startswith(TRANSCRIPTIONS_PATH + "/"):
+            with self.server.state.lock:
+                self.server.state.transcriptions.pop(path.strip("/").split("/")[3], None)
+            self.send(204)
+        elif path.startswith(WEBHOOKS_PATH + "/"):
+            with self.server.state.lock:
+                self.server.state.webhooks.pop(path.strip("/").split("/")[3], None)
+            self.send(204)
+        else:
+            self.send(404, {"error": {"code": "NotFound", "message": path}})
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Local stand-in for the Speech and Language REST APIs used by call_center.")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--latencyMs", type=float, default=50.0, help="Mean latency added to each request.")
+    parser.add_argument("--jitterMs", type=float, default=20.0, help="Latency varies uniformly by up to this much.")
+    parser.add_argument("--errorRate", type=float, default=0.0, help="Fraction of requests answered with 500.")
+    parser.add_argument("--throttleRate", type=float, default=0.0, help="Fraction of requests answered with 429.")
+    parser.add_argument("--retryAfterSeconds", type=int, default=1, help="Retry-After value sent with 429 responses.")
+    parser.add_argument("--quotaPerSecond", type=float, default=0.0,
+                        help="Requests per second each service (speech, language) accepts before answering with 429. 0 means no quota.")
+    parser.add_argument("--jobSeconds", type=float, default=2.0, help="How long transcription and conversation analysis jobs run.")
+    parser.add_argument("--conversationItemMs", type=float, default=0.0,
+                        help="Extra time each conversation analysis job runs per conversation item, so longer conversations take longer.")
+    parser.add_argument("--phrasesPerCall", type=int, default=50, help="Number of phrases in each synthetic transcription.")
+    parser.add_argument("--bandwidthMbps", type=float, default=0.0,
+                        help="Send response bodies at this many megabits per second, to simulate a network link. 0 means no limit.")
+    parser.add_argument("--filesPageSize", type=int, default=100, help="Number of files in each page of a transcription's file list.")
+    parser.add_argument("--callbackDropRate", type=float, default=0.0, help="Fraction of web hook callbacks that are not sent.")
+    parser.add_argument("--noCompression", action="store_true", help="Never compress responses, even if the client accepts gzip.")
+    parser.add_argument("--verbose", action="store_true", help="Log each request.")
+    options = parser.parse_args()
+
+    server = ThreadingHTTPServer(("", options.port), Handler)
+    server.daemon_threads = True
+    server.options = options
+    server.state = State()
+    print("Stand-in service listening on http://localhost:%d" % options.port)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    print("Requests served: %d (%d throttled)" % (server.state.requests, server.state.throttled))
+    print("Web hook callbacks sent: %d" % server.state.callbacks_sent)
+    print("Body bytes received: %d, sent: %d" % (server.state.bytes_received, server.state.bytes_sent))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,47 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CALL_CENTER_SSE2
+#endif
+
+// Splits interleaved 16-bit stereo PCM into one buffer of samples per channel, for example to push each channel of
+// a call recording to its own recognizer. On x86 and x64, SSE2 splits 8 frames at a time. Elsewhere, and for the
+// frames left over, a scalar loop splits one frame at a time.
+class StereoSplitter
+{
+public:
+    // Split *frameCount* frames of *frames* (left, right, left, right, ...) into *left* and *right*, which must each
+    // have room for *frameCount* samples. None of the buffers need to be aligned.
+    static void Split(const int16_t* frames, size_t frameCount, int16_t* left, int16_t* right)
+    {
+        size_t frame = 0;
+#ifdef CALL_CENTER_SSE2
+        for (; frame + 8 <= frameCount; frame += 8)
+        {
+            // Each 32-bit lane holds one frame: the left sample in the low half and the right sample in the high half.
+            __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frames + 2 * frame));
+            __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frames + 2 * frame + 8));
+            // Sign-extend each half to 32 bits, then pack the lanes back to 16 bits. The values fit, so packing
+            // never saturates.
+            __m128i leftSamples = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(first, 16), 16), _mm_srai_epi32(_mm_slli_epi32(second, 16), 16));
+            __m128i rightSamples = _mm_packs_epi32(_mm_srai_epi32(first, 16), _mm_srai_epi32(second, 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(left + frame), leftSamples);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(right + frame), rightSamples);
+        }
+#endif
+        for (; frame < frameCount; frame++)
+        {
+            left[frame] = frames[2 * frame];
+            right[frame] = frames[2 * frame + 1];
+        }
+    }
+};
+
+#undef CALL_CENTER_SSE2
@@ -0,0 +1,154 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+// You can download json.hpp from:
+// https://github.com/nlohmann/json/releases
+#include "json.hpp"
+#include "output_writer.h"
+
+// Records spans (named intervals of time on a thread) and writes them as a Chrome trace event file, which you can
+// open in chrome://tracing or https://ui.perfetto.dev to see where the wall-clock time of a run goes.
+// Recording is off until Enable is called, and costs one atomic load per span while off.
+class TraceHelper
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Event
+    {
+        std::string name;
+        std::string category;
+        int64_t startMicroseconds;
+        int64_t durationMicroseconds;
+        int threadId;
+        nlohmann::json args;
+    };
+
+    inline static std::atomic<bool> s_enabled = false;
+    inline static const Clock::time_point s_start = Clock::now();
+    inline static std::mutex s_mutex;
+    inline static std::vector<Event> s_events;
+    inline static std::atomic<int> s_nextThreadId = 1;
+
+    // Small, stable thread numbers read better in a trace viewer than hashed std::thread::id values.
+    static int ThreadId()
+    {
+        thread_local int threadId = s_nextThreadId++;
+        return threadId;
+    }
+
+public:
+    static void Enable()
+    {
+        s_enabled = true;
+    }
+
+    static bool Enabled()
+    {
+        return s_enabled;
+    }
+
+    static int64_t Microseconds(Clock::time_point time)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time - s_start).count();
+    }
+
+    // Record a span that started at *start* and lasted *durationMicroseconds*, on the calling thread.
+    static void Record(std::string name, std::string category, Clock::time_point start, int64_t durationMicroseconds, nlohmann::json args = nlohmann::json())
+    {
+        if (!s_enabled)
+        {
+            return;
+        }
+        Event event { std::move(name), std::move(category), Microseconds(start), durationMicroseconds, ThreadId(), std::move(args) };
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_events.push_back(std::move(event));
+    }
+
+    static void WriteFile(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        std::ofstream outputStream(path, std::ios::binary | std::ios::trunc);
+        if (!outputStream.good())
+        {
+            throw std::exception(std::string("Unable to open trace file: " + path).c_str());
+        }
+        OutputWriter output(outputStream);
+        JsonWriter writer(output);
+        writer.BeginObject();
+        writer.Field("displayTimeUnit", "ms");
+        writer.Key("traceEvents").BeginArray();
+        for (const auto& event : s_events)
+        {
+            // "X" is a complete event: a span with a start time and a duration.
+            writer.BeginObject();
+            if (!event.args.is_null())
+            {
+                writer.Field("args", event.args);
+            }
+            writer.Field("cat", event.category)
+                .Field("dur", event.durationMicroseconds)
+                .Field("name", event.name)
+                .Field("ph", "X")
+                .Field("pid", 1)
+                .Field("tid", event.threadId)
+                .Field("ts", event.startMicroseconds)
+                .EndObject();
+        }
+        writer.EndArray();
+        writer.EndObject();
+    }
+};
+
+// Records a span from construction to destruction. Does nothing if tracing is not enabled.
+class TraceSpan
+{
+private:
+    std::string m_name;
+    std::string m_category;
+    std::chrono::steady_clock::time_point m_start;
+    nlohmann::json m_args;
+    bool m_enabled;
+
+public:
+    TraceSpan(std::string name, std::string category) : m_enabled(TraceHelper::Enabled())
+    {
+        if (m_enabled)
+        {
+            m_name = std::move(name);
+            m_category = std::move(category);
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan()
+    {
+        if (m_enabled)
+        {
+            int64_t duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+            TraceHelper::Record(std::move(m_name), std::move(m_category), m_start, duration, std::move(m_args));
+        }
+    }
+
+    // Add a value to show with the span in the trace viewer.
+    template<typename T>
+    void AddArg(const std::string& key, T&& value)
+    {
+        if (m_enabled)
+        {
+            m_args[key] = std::forward<T>(value);
+        }
+    }
+};
@@ -0,0 +1,337 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A [offset, offset + length) range of characters in a TranscriptionPhrases string arena.
+struct TextSpan
+{
+    size_t offset = 0;
+    size_t length = 0;
+};
+
+// The fields of one item in the recognizedPhrases array of a batch transcription result, with nBest reduced
+// to its first (best) item. See samples/batch/transcriptionresult_v3.schema.json.
+// *json* is the whole item, including every nBest item and word timing, if the reader was asked to keep it.
+struct PhraseRecord
+{
+    std::string recognitionStatus;
+    std::optional<int> channel;
+    std::optional<int> speaker;
+    std::string offset;
+    std::string duration;
+    int64_t offsetInTicks = 0;
+    int64_t durationInTicks = 0;
+    double confidence = 0.0;
+    std::string lexical;
+    std::string itn;
+    std::string maskedItn;
+    std::string display;
+    std::string json;
+
+    // Clear the fields but keep the string capacity, so one record can be reused for every phrase.
+    void Clear()
+    {
+        recognitionStatus.clear();
+        channel = std::nullopt;
+        speaker = std::nullopt;
+        offset.clear();
+        duration.clear();
+        offsetInTicks = 0;
+        durationInTicks = 0;
+        confidence = 0.0;
+        lexical.clear();
+        itn.clear();
+        maskedItn.clear();
+        display.clear();
+        json.clear();
+    }
+};
+
+// One item in the combinedRecognizedPhrases array of a batch transcription result.
+struct CombinedRecognizedPhrase
+{
+    int channel = 0;
+    std::string lexical;
+    std::string itn;
+    std::string maskedItn;
+    std::string display;
+};
+
+// Transcription phrases stored as a struct of arrays. Element i of each column belongs to phrase i.
+// All strings share one arena, so adding a phrase does not allocate a string per field, and sorting
+// or looking up a phrase never touches JSON.
+class TranscriptionPhrases
+{
+private:
+    std::string m_arena;
+
+    TextSpan Append(std::string_view value)
+    {
+        TextSpan span { m_arena.size(), value.size() };
+        m_arena.append(value);
+        return span;
+    }
+
+    template<typename T>
+    static void Permute(std::vector<T>& column, const std::vector<size_t>& order)
+    {
+        std::vector<T> permuted;
+        permuted.reserve(column.size());
+        for (size_t index : order)
+        {
+            permuted.push_back(std::move(column[index]));
+        }
+        column.swap(permuted);
+    }
+
+public:
+    // Transcription-level fields.
+    std::string source;
+    std::string timestamp;
+    std::string duration;
+    int64_t durationInTicks = 0;
+    std::vector<CombinedRecognizedPhrase> combinedRecognizedPhrases;
+
+    // Phrase columns.
+    std::vector<int> ids;
+    // Channels are numbered from 0. Speakers are numbered from 1. To treat both alike, speaker numbers here are zero-based.
+    std::vector<int> speakerNumbers;
+    std::vector<int> channels;
+    // 0 if the phrase has no speaker, which is the case when diarization is disabled.
+    std::vector<int> speakers;
+    std::vector<int64_t> offsetsInTicks;
+    std::vector<int64_t> durationsInTicks;
+    std::vector<double> confidences;
+    std::vector<TextSpan> recognitionStatuses;
+    // ISO 8601 encoded offset and duration, for example "PT1.2S".
+    std::vector<TextSpan> offsets;
+    std::vector<TextSpan> durations;
+    // The display form of the recognized text.
+    std::vector<TextSpan> texts;
+    std::vector<TextSpan> itns;
+    std::vector<TextSpan> lexicals;
+    std::vector<TextSpan> maskedItns;
+    // The whole recognizedPhrases item as compact JSON, for the full output. Empty unless the reader kept it.
+    std::vector<TextSpan> jsons;
+
+    size_t Size() const
+    {
+        return ids.size();
+    }
+
+    void Reserve(size_t phraseCount, size_t arenaSize)
+    {
+        ids.reserve(phraseCount);
+        speakerNumbers.reserve(phraseCount);
+        channels.reserve(phraseCount);
+        speakers.reserve(phraseCount);
+        offsetsInTicks.reserve(phraseCount);
+        durationsInTicks.reserve(phraseCount);
+        confidences.reserve(phraseCount);
+        recognitionStatuses.reserve(phraseCount);
+        offsets.reserve(phraseCount);
+        durations.reserve(phraseCount);
+        texts.reserve(phraseCount);
+        itns.reserve(phraseCount);
+        lexicals.reserve(phraseCount);
+        maskedItns.reserve(phraseCount);
+        jsons.reserve(phraseCount);
+        m_arena.reserve(arenaSize);
+    }
+
+    void Add(const PhraseRecord& record)
+    {
+        // If the user specified stereo audio, and therefore we turned off diarization,
+        // only the channel property is present.
+        // Note: Channels are numbered from 0. Speakers are numbered from 1.
+        int speakerNumber;
+        if (record.speaker.has_value())
+        {
+            speakerNumber = record.speaker.value() - 1;
+        }
+        else if (record.channel.has_value())
+        {
+            speakerNumber = record.channel.value();
+        }
+        else
+        {
+            throw std::exception("nBest item contains neither channel nor speaker attribute.");
+        }
+
+        ids.push_back(static_cast<int>(ids.size()));
+        speakerNumbers.push_back(speakerNumber);
+        channels.push_back(record.channel.value_or(0));
+        speakers.push_back(record.speaker.value_or(0));
+        offsetsInTicks.push_back(record.offsetInTicks);
+        durationsInTicks.push_back(record.durationInTicks);
+        confidences.push_back(record.confidence);
+        recognitionStatuses.push_back(Append(record.recognitionStatus));
+        offsets.push_back(Append(record.offset));
+        durations.push_back(Append(record.duration));
+        texts.push_back(Append(record.display));
+        itns.push_back(Append(record.itn));
+        lexicals.push_back(Append(record.lexical));
+        maskedItns.push_back(Append(record.maskedItn));
+        jsons.push_back(Append(record.json));
+    }
+
+    // The characters of every string field, which TextSpans index into. For saving and restoring phrases.
+    const std::string& Arena() const
+    {
+        return m_arena;
+    }
+
+    void SetArena(std::string arena)
+    {
+        m_arena = std::move(arena);
+    }
+
+    // Return true if every column has one element per phrase and every TextSpan is inside the arena,
+    // for example after restoring phrases that were saved earlier.
+    bool IsValid() const
+    {
+        const size_t size = Size();
+        for (const std::vector<TextSpan>* column : { &recognitionStatuses, &offsets, &durations, &texts, &itns, &lexicals, &maskedItns, &jsons })
+        {
+            if (column->size() != size)
+            {
+                return false;
+            }
+            for (const TextSpan& span : *column)
+            {
+                if (span.offset > m_arena.size() || span.length > m_arena.size() - span.offset)
+                {
+                    return false;
+                }
+            }
+        }
+        return speakerNumbers.size() == size && channels.size() == size && speakers.size() == size
+            && offsetsInTicks.size() == size && durationsInTicks.size() == size && confidences.size() == size;
+    }
+
+    std::string_view View(TextSpan span) const
+    {
+        return std::string_view(m_arena.data() + span.offset, span.length);
+    }
+
+    std::string_view RecognitionStatus(size_t index) const { return View(recognitionStatuses[index]); }
+    std::string_view Offset(size_t index) const { return View(offsets[index]); }
+    std::string_view Duration(size_t index) const { return View(durations[index]); }
+    std::string_view Text(size_t index) const { return View(texts[index]); }
+    std::string_view Itn(size_t index) const { return View(itns[index]); }
+    std::string_view Lexical(size_t index) const { return View(lexicals[index]); }
+    std::string_view MaskedItn(size_t index) const { return View(maskedItns[index]); }
+    std::string_view Json(size_t index) const { return View(jsons[index]); }
+
+    // Sort phrases by offset. For stereo audio, batch transcription returns the phrases sorted by channel number.
+    // Phrase IDs are reassigned afterward so that they match each phrase's position.
+    // Return the old index of each phrase, in its new order, to reorder other per-phrase columns the same way.
+    std::vector<size_t> SortByOffset()
+    {
+        std::vector<size_t> order(Size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [this](size_t index_1, size_t index_2) -> bool {
+            return offsetsInTicks[index_1] < offsetsInTicks[index_2];
+        });
+        Permute(speakerNumbers, order);
+        Permute(channels, order);
+        Permute(speakers, order);
+        Permute(offsetsInTicks, order);
+        Permute(durationsInTicks, order);
+        Permute(confidences, order);
+        Permute(recognitionStatuses, order);
+        Permute(offsets, order);
+        Permute(durations, order);
+        Permute(texts, order);
+        Permute(itns, order);
+        Permute(lexicals, order);
+        Permute(maskedItns, order);
+        Permute(jsons, order);
+        std::iota(ids.begin(), ids.end(), 0);
+        return order;
+    }
+};
+
+enum class Sentiment { Positive, Neutral, Negative, Mixed };
+
+// Sentiment analysis results stored as a struct of arrays. Element i of each column belongs to phrase i
+// of the TranscriptionPhrases the analysis was run on.
+struct PhraseSentiments
+{
+    std::vector<Sentiment> sentiments;
+    std::vector<double> positiveScores;
+    std::vector<double> neutralScores;
+    std::vector<double> negativeScores;
+
+    void Resize(size_t phraseCount)
+    {
+        sentiments.resize(phraseCount, Sentiment::Neutral);
+        positiveScores.resize(phraseCount, 0.0);
+        neutralScores.resize(phraseCount, 0.0);
+        negativeScores.resize(phraseCount, 0.0);
+    }
+
+    size_t Size() const
+    {
+        return sentiments.size();
+    }
+
+    // Reorder the sentiments to match phrases reordered by TranscriptionPhrases::SortByOffset.
+    void Reorder(const std::vector<size_t>& order)
+    {
+        PhraseSentiments reordered;
+        for (size_t index : order)
+        {
+            reordered.sentiments.push_back(sentiments[index]);
+            reordered.positiveScores.push_back(positiveScores[index]);
+            reordered.neutralScores.push_back(neutralScores[index]);
+            reordered.negativeScores.push_back(negativeScores[index]);
+        }
+        *this = std::move(reordered);
+    }
+
+    static Sentiment SentimentFromString(std::string_view value)
+    {
+        if ("positive" == value)
+        {
+            return Sentiment::Positive;
+        }
+        else if ("negative" == value)
+        {
+            return Sentiment::Negative;
+        }
+        else if ("mixed" == value)
+        {
+            return Sentiment::Mixed;
+        }
+        else
+        {
+            return Sentiment::Neutral;
+        }
+    }
+
+    static const char* SentimentToString(Sentiment value)
+    {
+        switch (value)
+        {
+        case Sentiment::Positive:
+            return "positive";
+        case Sentiment::Negative:
+            return "negative";
+        case Sentiment::Mixed:
+            return "mixed";
+        default:
+            return "neutral";
+        }
+    }
+};
@@ -0,0 +1,333 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+// You can download json.hpp from:
+// https://github.com/nlohmann/json/releases
+#include "json.hpp"
+#include "transcription_phrases.h"
+
+// Reads a batch transcription result (see samples/batch/transcriptionresult_v3.schema.json) with the nlohmann
+// SAX interface, so no DOM is built. Only the fields the call center pipeline uses are kept, and nBest is
+// reduced to its first item. Everything else, such as the remaining nBest items and word timings, is skipped
+// as it is read, so memory use grows with the number of phrases rather than with the size of the document.
+// The full output needs every field, so if *keepPhraseJson* is true, each recognized phrase is also kept
+// whole, as compact JSON text in the phrase arena.
+class TranscriptionReader : public nlohmann::json_sax<nlohmann::json>
+{
+private:
+    // The object or array we are currently inside of.
+    enum class Scope { Root, CombinedPhrases, CombinedPhrase, Phrases, Phrase, NBest, BestItem, Skipped };
+
+    struct Frame
+    {
+        Scope scope;
+        // For arrays, the number of elements started so far.
+        size_t count;
+        bool isArray;
+    };
+
+    TranscriptionPhrases& m_phrases;
+    std::vector<Frame> m_stack;
+    std::string m_key;
+    PhraseRecord m_phrase;
+    CombinedRecognizedPhrase m_combinedPhrase;
+    const bool m_keepPhraseJson;
+    // How many objects and arrays deep we are inside the current recognized phrase, counting the phrase itself.
+    // 0 if we are not inside one.
+    size_t m_phraseDepth = 0;
+
+    TranscriptionReader(TranscriptionPhrases& phrases, bool keepPhraseJson) : m_phrases(phrases), m_keepPhraseJson(keepPhraseJson) {}
+
+    bool KeepingPhraseJson() const
+    {
+        return m_keepPhraseJson && m_phraseDepth > 0;
+    }
+
+    // Append a key, a value or the start of an object or array to the JSON of the current phrase, after a comma if needed.
+    void AppendPhraseJson(std::string_view json)
+    {
+        std::string& phraseJson = m_phrase.json;
+        if (!phraseJson.empty() && '{' != phraseJson.back() && '[' != phraseJson.back() && ':' != phraseJson.back())
+        {
+            phraseJson.push_back(',');
+        }
+        phraseJson.append(json);
+    }
+
+    // Return the scope of a new object or array, given the scope of its parent and the key or position it has there.
+    Scope ChildScope(bool isArray)
+    {
+        if (m_stack.empty())
+        {
+            return isArray ? Scope::Skipped : Scope::Root;
+        }
+        Frame& parent = m_stack.back();
+        switch (parent.scope)
+        {
+        case Scope::Root:
+            if (isArray && "recognizedPhrases" == m_key)
+            {
+                return Scope::Phrases;
+            }
+            else if (isArray && "combinedRecognizedPhrases" == m_key)
+            {
+                return Scope::CombinedPhrases;
+            }
+            return Scope::Skipped;
+        case Scope::CombinedPhrases:
+            return isArray ? Scope::Skipped : Scope::CombinedPhrase;
+        case Scope::Phrases:
+            return isArray ? Scope::Skipped : Scope::Phrase;
+        case Scope::Phrase:
+            return (isArray && "nBest" == m_key) ? Scope::NBest : Scope::Skipped;
+        case Scope::NBest:
+            // Only the first nBest item is kept.
+            return (!isArray && 0 == parent.count++) ? Scope::BestItem : Scope::Skipped;
+        default:
+            return Scope::Skipped;
+        }
+    }
+
+    Scope CurrentScope() const
+    {
+        return m_stack.empty() ? Scope::Skipped : m_stack.back().scope;
+    }
+
+    bool Push(bool isArray)
+    {
+        Scope scope = ChildScope(isArray);
+        if (Scope::Phrase == scope)
+        {
+            m_phrase.Clear();
+        }
+        if (Scope::Phrase == scope || m_phraseDepth > 0)
+        {
+            m_phraseDepth++;
+            if (m_keepPhraseJson)
+            {
+                AppendPhraseJson(isArray ? "[" : "{");
+            }
+        }
+        else if (Scope::CombinedPhrase == scope)
+        {
+            m_combinedPhrase = CombinedRecognizedPhrase();
+        }
+        m_stack.push_back(Frame { scope, 0, isArray });
+        return true;
+    }
+
+    bool Pop()
+    {
+        Scope scope = CurrentScope();
+        bool isArray = m_stack.back().isArray;
+        m_stack.pop_back();
+        if (m_phraseDepth > 0)
+        {
+            if (m_keepPhraseJson)
+            {
+                m_phrase.json.push_back(isArray ? ']' : '}');
+            }
+            m_phraseDepth--;
+        }
+        if (Scope::Phrase == scope)
+        {
+            m_phrases.Add(m_phrase);
+        }
+        else if (Scope::CombinedPhrase == scope)
+        {
+            m_phrases.combinedRecognizedPhrases.push_back(std::move(m_combinedPhrase));
+        }
+        return true;
+    }
+
+    bool Number(double value)
+    {
+        switch (CurrentScope())
+        {
+        case Scope::Root:
+            if ("durationInTicks" == m_key)
+            {
+                m_phrases.durationInTicks = static_cast<int64_t>(value);
+            }
+            break;
+        case Scope::CombinedPhrase:
+            if ("channel" == m_key)
+            {
+                m_combinedPhrase.channel = static_cast<int>(value);
+            }
+            break;
+        case Scope::Phrase:
+            if ("channel" == m_key)
+            {
+                m_phrase.channel = static_cast<int>(value);
+            }
+            else if ("speaker" == m_key)
+            {
+                m_phrase.speaker = static_cast<int>(value);
+            }
+            else if ("offsetInTicks" == m_key)
+            {
+                m_phrase.offsetInTicks = static_cast<int64_t>(value);
+            }
+            else if ("durationInTicks" == m_key)
+            {
+                m_phrase.durationInTicks = static_cast<int64_t>(value);
+            }
+            break;
+        case Scope::BestItem:
+            if ("confidence" == m_key)
+            {
+                m_phrase.confidence = value;
+            }
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    // Return the field of the current object that the current key names, or nullptr if we do not keep it.
+    std::string* StringField()
+    {
+        switch (CurrentScope())
+        {
+        case Scope::Root:
+            if ("source" == m_key) { return &m_phrases.source; }
+            if ("timestamp" == m_key) { return &m_phrases.timestamp; }
+            if ("duration" == m_key) { return &m_phrases.duration; }
+            return nullptr;
+        case Scope::CombinedPhrase:
+            if ("lexical" == m_key) { return &m_combinedPhrase.lexical; }
+            if ("itn" == m_key) { return &m_combinedPhrase.itn; }
+            if ("maskedITN" == m_key) { return &m_combinedPhrase.maskedItn; }
+            if ("display" == m_key) { return &m_combinedPhrase.display; }
+            return nullptr;
+        case Scope::Phrase:
+            if ("recognitionStatus" == m_key) { return &m_phrase.recognitionStatus; }
+            if ("offset" == m_key) { return &m_phrase.offset; }
+            if ("duration" == m_key) { return &m_phrase.duration; }
+            return nullptr;
+        case Scope::BestItem:
+            if ("lexical" == m_key) { return &m_phrase.lexical; }
+            if ("itn" == m_key) { return &m_phrase.itn; }
+            if ("maskedITN" == m_key) { return &m_phrase.maskedItn; }
+            if ("display" == m_key) { return &m_phrase.display; }
+            return nullptr;
+        default:
+            return nullptr;
+        }
+    }
+
+public:
+    bool null() override
+    {
+        if (KeepingPhraseJson())
+        {
+            AppendPhraseJson("null");
+        }
+        return true;
+    }
+
+    bool boolean(bool value) override
+    {
+        if (KeepingPhraseJson())
+        {
+            AppendPhraseJson(value ? "true" : "false");
+        }
+        return true;
+    }
+
+    bool number_integer(number_integer_t value) override
+    {
+        if (KeepingPhraseJson())
+        {
+            AppendPhraseJson(std::to_string(value));
+        }
+        return Number(static_cast<double>(value));
+    }
+
+    bool number_unsigned(number_unsigned_t value) override
+    {
+        if (KeepingPhraseJson())
+        {
+            AppendPhraseJson(std::to_string(value));
+        }
+        return Number(static_cast<double>(value));
+    }
+
+    bool number_float(number_float_t value, const string_t& text) override
+    {
+        if (KeepingPhraseJson())
+        {
+            // Keep the number as it was written, so it does not lose precision.
+            AppendPhraseJson(text);
+        }
+        return Number(value);
+    }
+
+    bool binary(binary_t&) override { return true; }
+
+    bool string(string_t& value) override
+    {
+        if (KeepingPhraseJson())
+        {
+            AppendPhraseJson(nlohmann::json(value).dump());
+        }
+        std::string* field = StringField();
+        if (nullptr != field)
+        {
+            field->swap(value);
+        }
+        return true;
+    }
+
+    bool key(string_t& value) override
+    {
+        if (KeepingPhraseJson())
+        {
+            AppendPhraseJson(nlohmann::json(value).dump() + ":");
+        }
+        m_key.swap(value);
+        return true;
+    }
+
+    bool start_object(std::size_t) override { return Push(false); }
+    bool end_object() override { return Pop(); }
+    bool start_array(std::size_t) override { return Push(true); }
+    bool end_array() override { return Pop(); }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override
+    {
+        throw std::exception(std::string("Unable to parse transcription. Error:\n" + std::string(ex.what())).c_str());
+    }
+
+    // Preconditions:
+    // *input* is anything nlohmann::json::sax_parse accepts, such as a std::istream or a std::string.
+    template<typename InputType>
+    static TranscriptionPhrases Read(InputType&& input, bool keepPhraseJson = false)
+    {
+        TranscriptionPhrases phrases;
+        TranscriptionReader reader(phrases, keepPhraseJson);
+        nlohmann::json::sax_parse(std::forward<InputType>(input), &reader);
+        // For stereo audio, the phrases are sorted by channel number, so resort them by offset.
+        phrases.SortByOffset();
+        return phrases;
+    }
+
+    static TranscriptionPhrases ReadFile(const std::string& path, bool keepPhraseJson = false)
+    {
+        std::ifstream input(path);
+        if (!input.good())
+        {
+            throw std::exception(std::string("Unable to open transcription file: " + path).c_str());
+        }
+        return Read(input, keepPhraseJson);
+    }
+};
@@ -5,7 +5,7 @@
 
 #include <algorithm>
 #include <optional>
-#include "string_helper.h"
+#include "../common/string_helper.h"
 #include "user_config.h"
 
 // The value parameter to std::find must be std::string. Otherwise std::find will compare the pointer values rather than the string contents.
@@ -42,11 +42,71 @@ std::shared_ptr<UserConfig> UserConfigFromArgs(int argc, char* argv[], std::stri
     // This should not change unless the Speech REST API changes.
     const std::string partialSpeechEndpoint = ".api.cognitive.microsoft.com";
     
+    std::optional<std::string> strBenchmarkCalls = GetCommandLineOption(argv, argv + argc, "--benchmark");
+    std::optional<int> benchmarkCalls = std::nullopt;
+    if (strBenchmarkCalls.has_value())
+    {
+        benchmarkCalls = std::max(1, std::stoi(strBenchmarkCalls.value()));
+    }
+
+    std::optional<std::string> strBenchmarkConcurrency = GetCommandLineOption(argv, argv + argc, "--concurrency");
+    int benchmarkConcurrency = 1;
+    if (strBenchmarkConcurrency.has_value())
+    {
+        benchmarkConcurrency = std::stoi(strBenchmarkConcurrency.value());
+        if (benchmarkConcurrency < 1)
+        {
+            benchmarkConcurrency = 1;
+        }
+    }
+
     std::optional<std::string> inputAudioURL = GetCommandLineOption(argv, argv + argc, "--input");
     std::optional<std::string> inputFilePath = GetCommandLineOption(argv, argv + argc, "--jsonInput");
-    if (!inputAudioURL.has_value() && !inputFilePath.has_value())
+    std::optional<std::string> uploadFilePath = GetCommandLineOption(argv, argv + argc, "--inputFile");
+    std::optional<std::string> inputListPath = GetCommandLineOption(argv, argv + argc, "--inputList");
+    // In benchmark mode, synthetic input URLs are used if no input option is present.
+    if (!inputAudioURL.has_value() && !inputFilePath.has_value() && !uploadFilePath.has_value() && !inputListPath.has_value() && !benchmarkCalls.has_value())
+    {
+        throw std::invalid_argument("Please specify --input, --inputList, --inputFile or --jsonInput.\n" + usage);
+    }
+
+    std::optional<std::string> strCallsPerJob = GetCommandLineOption(argv, argv + argc, "--callsPerJob");
+    int callsPerJob = 1;
+    if (strCallsPerJob.has_value())
+    {
+        callsPerJob = std::stoi(strCallsPerJob.value());
+        if (callsPerJob < 1)
+        {
+            callsPerJob = 1;
+        }
+    }
+    std::optional<std::string> blobContainerUrl = GetCommandLineOption(argv, argv + argc, "--blobContainer");
+    if (uploadFilePath.has_value() && !blobContainerUrl.has_value())
     {
-        throw std::invalid_argument("Please specify either --input or --jsonInput.\n" + usage);
+        throw std::invalid_argument("--inputFile requires --blobContainer.\n" + usage);
+    }
+
+    std::optional<std::string> strUploadBlockMegabytes = GetCommandLineOption(argv, argv + argc, "--uploadBlockMegabytes");
+    int uploadBlockMegabytes = 4;
+    if (strUploadBlockMegabytes.has_value())
+    {
+        uploadBlockMegabytes = std::stoi(strUploadBlockMegabytes.value());
+        // Put Block accepts blocks of up to 4000 MiB.
+        if (uploadBlockMegabytes < 1 || uploadBlockMegabytes > 4000)
+        {
+            uploadBlockMegabytes = 4;
+        }
+    }
+
+    std::optional<std::string> strUploadConcurrency = GetCommandLineOption(argv, argv + argc, "--uploadConcurrency");
+    int uploadConcurrency = 4;
+    if (strUploadConcurrency.has_value())
+    {
+        uploadConcurrency = std::stoi(strUploadConcurrency.value());
+        if (uploadConcurrency < 1)
+        {
+            uploadConcurrency = 4;
+        }
     }
     
     std::optional<std::string> speechSubscriptionKey = GetCommandLineOption(argv, argv + argc, "--speechKey");
@@ -54,9 +114,17 @@ std::shared_ptr<UserConfig> UserConfigFromArgs(int argc, char* argv[], std::stri
     {
         throw std::invalid_argument("Missing Speech subscription key. Speech subscription key is required unless --jsonInput is present.\n" + usage);
     }
-    std::optional<std::string> speechEndpoint = std::nullopt;
+    // --speechEndpoint overrides --speechRegion, for example to use a local stand-in service.
+    std::optional<std::string> speechEndpoint = GetCommandLineOption(argv, argv + argc, "--speechEndpoint");
     std::optional<std::string> speechRegion = GetCommandLineOption(argv, argv + argc, "--speechRegion");
-    if (speechRegion.has_value())
+    if (speechEndpoint.has_value())
+    {
+        if (!StringHelper::StartsWith(speechEndpoint.value(), "https://") && !StringHelper::StartsWith(speechEndpoint.value(), "http://"))
+        {
+            speechEndpoint = "https://" + speechEndpoint.value();
+        }
+    }
+    else if (speechRegion.has_value())
     {
         speechEndpoint = "https://" + speechRegion.value() + partialSpeechEndpoint;
     }
@@ -65,6 +133,17 @@ std::shared_ptr<UserConfig> UserConfigFromArgs(int argc, char* argv[], std::stri
         throw std::invalid_argument("Missing Speech region. Speech region is required unless --jsonInput is present.\n" + usage);
     }
 
+    // In real-time mode, --input is a local WAV file, and the Speech SDK connects to the service by region.
+    bool realTime = CommandLineOptionExists(argv, argv + argc, "--realTime");
+    if (realTime && !inputAudioURL.has_value())
+    {
+        throw std::invalid_argument("--realTime requires --input with the path to a WAV file.\n" + usage);
+    }
+    if (realTime && !speechRegion.has_value())
+    {
+        throw std::invalid_argument("--realTime requires --speechRegion.\n" + usage);
+    }
+
     std::optional<std::string> languageSubscriptionKey = GetCommandLineOption(argv, argv + argc, "--languageKey");
     if (!languageSubscriptionKey.has_value())
     {
@@ -75,7 +154,8 @@ std::shared_ptr<UserConfig> UserConfigFromArgs(int argc, char* argv[], std::stri
     {
         throw std::invalid_argument("Missing Language endpoint.\n" + usage);
     }
-    else if (!StringHelper::StartsWith(languageEndpoint.value(), "https://"))
+    // Plain http:// is allowed so you can use a local stand-in service.
+    else if (!StringHelper::StartsWith(languageEndpoint.value(), "https://") && !StringHelper::StartsWith(languageEndpoint.value(), "http://"))
     {
         languageEndpoint = "https://" + languageEndpoint.value();
     }
@@ -96,17 +176,141 @@ std::shared_ptr<UserConfig> UserConfigFromArgs(int argc, char* argv[], std::stri
         locale = std::optional{ "en-US" };
     }
 
+    std::optional<std::string> strPollInterval = GetCommandLineOption(argv, argv + argc, "--pollIntervalMs");
+    int pollIntervalMilliseconds = 10000;
+    if (strPollInterval.has_value())
+    {
+        pollIntervalMilliseconds = std::stoi(strPollInterval.value());
+        if (pollIntervalMilliseconds < 0)
+        {
+            pollIntervalMilliseconds = 10000;
+        }
+    }
+
+    std::optional<std::string> strCacheMaxMegabytes = GetCommandLineOption(argv, argv + argc, "--cacheMaxMegabytes");
+    int cacheMaxMegabytes = 256;
+    if (strCacheMaxMegabytes.has_value())
+    {
+        cacheMaxMegabytes = std::stoi(strCacheMaxMegabytes.value());
+        if (cacheMaxMegabytes < 1)
+        {
+            cacheMaxMegabytes = 256;
+        }
+    }
+
+    std::optional<std::string> strSpeechRequestsPerSecond = GetCommandLineOption(argv, argv + argc, "--speechRequestsPerSecond");
+    double speechRequestsPerSecond = 0.0;
+    if (strSpeechRequestsPerSecond.has_value())
+    {
+        speechRequestsPerSecond = std::max(0.0, std::stod(strSpeechRequestsPerSecond.value()));
+    }
+
+    std::optional<std::string> strLanguageRequestsPerSecond = GetCommandLineOption(argv, argv + argc, "--languageRequestsPerSecond");
+    double languageRequestsPerSecond = 0.0;
+    if (strLanguageRequestsPerSecond.has_value())
+    {
+        languageRequestsPerSecond = std::max(0.0, std::stod(strLanguageRequestsPerSecond.value()));
+    }
+
+    std::optional<std::string> strMaxRetries = GetCommandLineOption(argv, argv + argc, "--maxRetries");
+    int maxRetries = 5;
+    if (strMaxRetries.has_value())
+    {
+        maxRetries = std::stoi(strMaxRetries.value());
+        if (maxRetries < 0)
+        {
+            maxRetries = 5;
+        }
+    }
+
+    std::optional<std::string> checkpointDirectory = GetCommandLineOption(argv, argv + argc, "--checkpointDirectory");
+    bool resume = CommandLineOptionExists(argv, argv + argc, "--resume");
+    if (resume && !checkpointDirectory.has_value())
+    {
+        throw std::invalid_argument("--resume requires --checkpointDirectory.\n" + usage);
+    }
+    // Checkpoints are named for each call's input. With an input option, every benchmark call has the same input,
+    // so the calls would overwrite each other's checkpoints. Synthetic benchmark calls each have their own.
+    if (checkpointDirectory.has_value() && benchmarkCalls.has_value() && (inputAudioURL.has_value() || inputFilePath.has_value() || uploadFilePath.has_value()))
+    {
+        throw std::invalid_argument("--checkpointDirectory cannot be used with --benchmark and --input, --inputFile or --jsonInput.\n" + usage);
+    }
+
+    std::optional<std::string> strWebhookPort = GetCommandLineOption(argv, argv + argc, "--webhookPort");
+    std::optional<int> webhookPort = std::nullopt;
+    if (strWebhookPort.has_value())
+    {
+        webhookPort = std::stoi(strWebhookPort.value());
+        if (webhookPort.value() < 1 || webhookPort.value() > 65535)
+        {
+            throw std::invalid_argument("--webhookPort must be from 1 to 65535.\n" + usage);
+        }
+    }
+    std::optional<std::string> webhookUrl = GetCommandLineOption(argv, argv + argc, "--webhookUrl");
+    if (webhookUrl.has_value() && !webhookPort.has_value())
+    {
+        throw std::invalid_argument("--webhookUrl requires --webhookPort.\n" + usage);
+    }
+
+    std::optional<std::string> strWebhookTimeout = GetCommandLineOption(argv, argv + argc, "--webhookTimeoutMs");
+    // By default, a lost callback costs no more than one poll interval.
+    int webhookTimeoutMilliseconds = pollIntervalMilliseconds;
+    if (strWebhookTimeout.has_value())
+    {
+        webhookTimeoutMilliseconds = std::stoi(strWebhookTimeout.value());
+        if (webhookTimeoutMilliseconds < 0)
+        {
+            webhookTimeoutMilliseconds = pollIntervalMilliseconds;
+        }
+    }
+
+    std::optional<std::string> strConversationShardCharacters = GetCommandLineOption(argv, argv + argc, "--conversationShardCharacters");
+    int conversationShardCharacters = 100000;
+    if (strConversationShardCharacters.has_value())
+    {
+        conversationShardCharacters = std::stoi(strConversationShardCharacters.value());
+        if (conversationShardCharacters < 1)
+        {
+            conversationShardCharacters = 100000;
+        }
+    }
+
     return std::make_shared<UserConfig>(
         CommandLineOptionExists(argv, argv + argc, "--stereo"),
         certificatePath.value(),
         inputAudioURL,
         inputFilePath,
+        inputListPath,
+        callsPerJob,
+        uploadFilePath,
+        blobContainerUrl,
+        static_cast<size_t>(uploadBlockMegabytes) * 1024 * 1024,
+        uploadConcurrency,
         GetCommandLineOption(argv, argv + argc, "--output"),
         language.value(),
         locale.value(),
         speechSubscriptionKey,
         speechEndpoint,
+        speechRegion,
+        realTime,
         languageSubscriptionKey.value(),
-        languageEndpoint.value()
+        languageEndpoint.value(),
+        pollIntervalMilliseconds,
+        benchmarkCalls,
+        benchmarkConcurrency,
+        GetCommandLineOption(argv, argv + argc, "--cacheDirectory"),
+        cacheMaxMegabytes,
+        speechRequestsPerSecond,
+        languageRequestsPerSecond,
+        maxRetries,
+        conversationShardCharacters,
+        GetCommandLineOption(argv, argv + argc, "--trace"),
+        CommandLineOptionExists(argv, argv + argc, "--compressRequests"),
+        checkpointDirectory,
+        resume,
+        webhookPort,
+        webhookUrl,
+        webhookTimeoutMilliseconds,
+        GetCommandLineOption(argv, argv + argc, "--parquetOutput")
     );
 }
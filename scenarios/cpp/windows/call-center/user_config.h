@@ -12,38 +12,125 @@ struct UserConfig
     const std::string certificatePath;
     const std::optional<std::string> inputAudioURL;
     const std::optional<std::string> inputFilePath;
+    // A file with one audio URL per line, to transcribe callsPerJob at a time.
+    const std::optional<std::string> inputListPath;
+    const int callsPerJob;
+    // A local audio file to upload to blobContainerUrl and transcribe.
+    const std::optional<std::string> uploadFilePath;
+    const std::optional<std::string> blobContainerUrl;
+    const size_t uploadBlockBytes;
+    const int uploadConcurrency;
     const std::optional<std::string> outputFilePath;
     const std::string language;
     const std::string locale;
     const std::optional<std::string> speechSubscriptionKey;
     const std::optional<std::string> speechEndpoint;
+    const std::optional<std::string> speechRegion;
+    // If true, inputAudioURL is the path to a local WAV file, which is transcribed with streaming transcription.
+    const bool realTime = false;
     const std::string languageSubscriptionKey;
     const std::string languageEndpoint;
+    const int pollIntervalMilliseconds;
+    const std::optional<int> benchmarkCalls;
+    const int benchmarkConcurrency;
+    const std::optional<std::string> cacheDirectory;
+    const int cacheMaxMegabytes;
+    // 0 means no limit.
+    const double speechRequestsPerSecond;
+    const double languageRequestsPerSecond;
+    const int maxRetries;
+    const size_t conversationShardCharacters;
+    // If present, write a Chrome trace event file of the run to this path.
+    const std::optional<std::string> traceFilePath;
+    // If true, send large request bodies gzip-compressed.
+    const bool compressRequests = false;
+    // If present, save the result of each pipeline stage of each call here.
+    const std::optional<std::string> checkpointDirectory;
+    // If true, skip pipeline stages that have a checkpoint.
+    const bool resume = false;
+    // If present, listen on this port for transcription completion web hook callbacks.
+    const std::optional<int> webhookPort;
+    // The URL the Speech service sends callbacks to, which must reach webhookPort.
+    const std::optional<std::string> webhookUrl;
+    // How long to wait for a callback before checking the transcription status anyway.
+    const int webhookTimeoutMilliseconds;
+    // If present, also write the results of each call to Parquet files in this directory.
+    const std::optional<std::string> parquetDirectory;
     
     UserConfig(
         bool useStereoAudio,
         std::string certificatePath,
         std::optional<std::string> inputAudioURL,
         std::optional<std::string> inputFilePath,
+        std::optional<std::string> inputListPath,
+        int callsPerJob,
+        std::optional<std::string> uploadFilePath,
+        std::optional<std::string> blobContainerUrl,
+        size_t uploadBlockBytes,
+        int uploadConcurrency,
         std::optional<std::string> outputFilePath,
         std::string language,
         std::string locale,
         std::optional<std::string> speechSubscriptionKey,
         std::optional<std::string> speechEndpoint,
+        std::optional<std::string> speechRegion,
+        bool realTime,
         std::string languageSubscriptionKey,
-        std::string languageEndpoint
+        std::string languageEndpoint,
+        int pollIntervalMilliseconds,
+        std::optional<int> benchmarkCalls,
+        int benchmarkConcurrency,
+        std::optional<std::string> cacheDirectory,
+        int cacheMaxMegabytes,
+        double speechRequestsPerSecond,
+        double languageRequestsPerSecond,
+        int maxRetries,
+        size_t conversationShardCharacters,
+        std::optional<std::string> traceFilePath,
+        bool compressRequests,
+        std::optional<std::string> checkpointDirectory,
+        bool resume,
+        std::optional<int> webhookPort,
+        std::optional<std::string> webhookUrl,
+        int webhookTimeoutMilliseconds,
+        std::optional<std::string> parquetDirectory
         ) :
         useStereoAudio(useStereoAudio),
         certificatePath(certificatePath),
         inputAudioURL(inputAudioURL),
         inputFilePath(inputFilePath),
+        inputListPath(inputListPath),
+        callsPerJob(callsPerJob),
+        uploadFilePath(uploadFilePath),
+        blobContainerUrl(blobContainerUrl),
+        uploadBlockBytes(uploadBlockBytes),
+        uploadConcurrency(uploadConcurrency),
         outputFilePath(outputFilePath),
         language(language),
         locale(locale),
         speechSubscriptionKey(speechSubscriptionKey),
         speechEndpoint(speechEndpoint),
+        speechRegion(speechRegion),
+        realTime(realTime),
         languageSubscriptionKey(languageSubscriptionKey),
-        languageEndpoint(languageEndpoint)
+        languageEndpoint(languageEndpoint),
+        pollIntervalMilliseconds(pollIntervalMilliseconds),
+        benchmarkCalls(benchmarkCalls),
+        benchmarkConcurrency(benchmarkConcurrency),
+        cacheDirectory(cacheDirectory),
+        cacheMaxMegabytes(cacheMaxMegabytes),
+        speechRequestsPerSecond(speechRequestsPerSecond),
+        languageRequestsPerSecond(languageRequestsPerSecond),
+        maxRetries(maxRetries),
+        conversationShardCharacters(conversationShardCharacters),
+        traceFilePath(traceFilePath),
+        compressRequests(compressRequests),
+        checkpointDirectory(checkpointDirectory),
+        resume(resume),
+        webhookPort(webhookPort),
+        webhookUrl(webhookUrl),
+        webhookTimeoutMilliseconds(webhookTimeoutMilliseconds),
+        parquetDirectory(parquetDirectory)
         {}
 };
 
@@ -0,0 +1,285 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+// You can download json.hpp from:
+// https://github.com/nlohmann/json/releases
+#include "json.hpp"
+#include "../common/string_helper.h"
+
+// A minimal HTTP server that receives Speech service web hook callbacks, so a pipeline stage waiting for a
+// transcription can wake up as soon as the transcription completes instead of at the next poll.
+// It answers the validation challenge the service sends when the web hook is registered, and records the ID of each
+// transcription named in a completion event. See:
+// https://learn.microsoft.com/azure/cognitive-services/speech-service/webhooks
+// A callback only wakes the waiting stage, which then checks the status with an authenticated request. So the
+// callback signature is not verified: a forged callback can cause at most one extra status request.
+class WebhookListener
+{
+private:
+#ifdef _WIN32
+    using Socket = SOCKET;
+    static constexpr Socket invalidSocket = INVALID_SOCKET;
+    static void CloseSocket(Socket socket) { closesocket(socket); }
+#else
+    using Socket = int;
+    static constexpr Socket invalidSocket = -1;
+    static void CloseSocket(Socket socket) { close(socket); }
+#endif
+
+    // Callbacks are small. Drop connections that send more than this, or that stall.
+    static constexpr size_t maxRequestBytes = 1024 * 1024;
+    static constexpr int receiveTimeoutMilliseconds = 5000;
+    // How often the accept loop checks whether the listener is stopping.
+    static constexpr int acceptTimeoutMilliseconds = 200;
+    // The web hook receives events for every transcription of the Speech resource, not only ours. Remember only
+    // this many completed IDs that nobody has waited for yet.
+    static constexpr size_t maxCompletedIds = 1024;
+
+    Socket m_socket = invalidSocket;
+    std::thread m_thread;
+    std::atomic<bool> m_stopping = false;
+    std::atomic<size_t> m_callbacks = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_completedChanged;
+    std::set<std::string> m_completedIds;
+    std::deque<std::string> m_completedOrder;
+
+    // Wait until *socket* has data to read. Return false on timeout or error.
+    static bool WaitReadable(Socket socket, int timeoutMilliseconds)
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(socket, &readable);
+        timeval timeout { timeoutMilliseconds / 1000, (timeoutMilliseconds % 1000) * 1000 };
+        return select(static_cast<int>(socket) + 1, &readable, nullptr, nullptr, &timeout) > 0;
+    }
+
+    static void SendResponse(Socket socket, const std::string& status, const std::string& body)
+    {
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(body.size())
+            + "\r\nConnection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size())
+        {
+            int result = send(socket, response.data() + sent, static_cast<int>(response.size() - sent), 0);
+            if (result <= 0)
+            {
+                return;
+            }
+            sent += static_cast<size_t>(result);
+        }
+    }
+
+    // Return the value of *name* in the query of *target*, for example "/?validationToken=abc".
+    static std::string QueryValue(const std::string& target, const std::string& name)
+    {
+        size_t queryStart = target.find('?');
+        if (std::string::npos == queryStart)
+        {
+            return std::string();
+        }
+        for (std::string_view parameter : StringHelper::SplitView(std::string_view(target).substr(queryStart + 1), '&'))
+        {
+            if (StringHelper::StartsWith(parameter, name + "="))
+            {
+                return std::string(parameter.substr(name.size() + 1));
+            }
+        }
+        return std::string();
+    }
+
+    void Complete(const std::string& id)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_completedIds.insert(id).second)
+            {
+                m_completedOrder.push_back(id);
+            }
+            while (m_completedOrder.size() > maxCompletedIds)
+            {
+                m_completedIds.erase(m_completedOrder.front());
+                m_completedOrder.pop_front();
+            }
+        }
+        m_completedChanged.notify_all();
+    }
+
+    // Read one request from *socket* and answer it.
+    void HandleConnection(Socket socket)
+    {
+        std::string request;
+        size_t headerEnd = std::string::npos;
+        size_t contentLength = 0;
+        char buffer[4096];
+        while (true)
+        {
+            if (std::string::npos == headerEnd)
+            {
+                headerEnd = request.find("\r\n\r\n");
+                if (std::string::npos != headerEnd)
+                {
+                    for (std::string_view line : StringHelper::SplitView(std::string_view(request).substr(0, headerEnd), '\n'))
+                    {
+                        size_t colon = line.find(':');
+                        if (std::string::npos != colon && StringHelper::CaseInsensitiveCompare("content-length", StringHelper::Trim(line.substr(0, colon))))
+                        {
+                            contentLength = std::stoul(std::string(StringHelper::Trim(line.substr(colon + 1))));
+                        }
+                    }
+                }
+            }
+            if (std::string::npos != headerEnd && request.size() >= headerEnd + 4 + contentLength)
+            {
+                break;
+            }
+            if (request.size() > maxRequestBytes || contentLength > maxRequestBytes || !WaitReadable(socket, receiveTimeoutMilliseconds))
+            {
+                return;
+            }
+            int received = recv(socket, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+            {
+                return;
+            }
+            request.append(buffer, static_cast<size_t>(received));
+        }
+
+        // The request line is, for example, "POST /?validationToken=abc HTTP/1.1".
+        std::vector<std::string> requestLine = StringHelper::Split(request.substr(0, request.find("\r\n")), ' ');
+        if (requestLine.size() < 2 || "POST" != requestLine[0])
+        {
+            SendResponse(socket, "405 Method Not Allowed", std::string());
+            return;
+        }
+        // When the web hook is registered, the service sends a validation token, which we must send back.
+        std::string validationToken = QueryValue(requestLine[1], "validationToken");
+        if (!validationToken.empty())
+        {
+            SendResponse(socket, "200 OK", validationToken);
+            return;
+        }
+        m_callbacks++;
+        // The body of a completion event is the transcription, and its "self" URI ends with the transcription ID.
+        nlohmann::json event = nlohmann::json::parse(request.substr(headerEnd + 4, contentLength), nullptr, false);
+        if (event.is_object() && event.contains("self") && event["self"].is_string())
+        {
+            Complete(StringHelper::Split(event["self"].get<std::string>(), '/').back());
+        }
+        SendResponse(socket, "200 OK", std::string());
+    }
+
+    void Run()
+    {
+        while (!m_stopping)
+        {
+            if (!WaitReadable(m_socket, acceptTimeoutMilliseconds))
+            {
+                continue;
+            }
+            Socket connection = accept(m_socket, nullptr, nullptr);
+            if (invalidSocket == connection)
+            {
+                continue;
+            }
+            // Callbacks are rare, so handle each one on this thread.
+            try
+            {
+                HandleConnection(connection);
+            }
+            catch (const std::exception&)
+            {
+                // A malformed request must not stop the listener.
+            }
+            CloseSocket(connection);
+        }
+    }
+
+public:
+    // Listen on *port* on all interfaces. Throws std::exception if the port is not available.
+    WebhookListener(int port)
+    {
+#ifdef _WIN32
+        WSADATA wsaData;
+        if (0 != WSAStartup(MAKEWORD(2, 2), &wsaData))
+        {
+            throw std::exception("Unable to initialize Windows Sockets.");
+        }
+#endif
+        m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (invalidSocket == m_socket)
+        {
+            throw std::exception("Unable to create web hook listener socket.");
+        }
+        int reuse = 1;
+        setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(static_cast<unsigned short>(port));
+        if (0 != bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) || 0 != listen(m_socket, SOMAXCONN))
+        {
+            CloseSocket(m_socket);
+            throw std::exception(std::string("Unable to listen for web hook callbacks on port " + std::to_string(port) + ".").c_str());
+        }
+        m_thread = std::thread(&WebhookListener::Run, this);
+    }
+
+    WebhookListener(const WebhookListener&) = delete;
+    WebhookListener& operator=(const WebhookListener&) = delete;
+
+    ~WebhookListener()
+    {
+        m_stopping = true;
+        m_thread.join();
+        CloseSocket(m_socket);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    // Wait until a completion callback for *id* arrives, or until *timeout* passes. Return true if it arrived.
+    bool WaitForCompletion(const std::string& id, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        bool completed = m_completedChanged.wait_for(lock, timeout, [&]() { return m_completedIds.count(id) > 0; });
+        if (completed)
+        {
+            m_completedIds.erase(id);
+            m_completedOrder.erase(std::find(m_completedOrder.begin(), m_completedOrder.end(), id));
+        }
+        return completed;
+    }
+
+    // The number of event callbacks received, not counting validation challenges.
+    size_t CallbackCount() const
+    {
+        return m_callbacks;
+    }
+};
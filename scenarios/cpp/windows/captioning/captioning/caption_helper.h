@@ -9,6 +9,7 @@
 #include <optional>
 #include <speechapi_cxx.h>
 #include <string>
+#include <string_view>
 #include <vector>
 #include "string_helper.h"
 #include "user_config.h"
@@ -121,7 +122,7 @@ public:
             index = SkipSkippable(text, index);
 
             int lineLength = GetBestWidth(text, index);
-            retval.push_back(StringHelper::Trim(text.substr(index, lineLength)));
+            retval.emplace_back(StringHelper::Trim(std::string_view(text).substr(index, lineLength)));
             index = index + lineLength;
         }
         
@@ -180,7 +181,7 @@ public:
             index = SkipSkippable(text, index);
 
             int lineLength = GetBestWidth(text, index);
-            captionLines.push_back(StringHelper::Trim(text.substr(index, lineLength)));
+            captionLines.emplace_back(StringHelper::Trim(std::string_view(text).substr(index, lineLength)));
             index = index + lineLength;
 
             auto isLastCaption = index >= text.length();
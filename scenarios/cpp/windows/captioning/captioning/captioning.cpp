@@ -296,8 +296,8 @@ public:
         if (m_userConfig->phraseList.has_value())
         {
             auto grammar = PhraseListGrammar::FromRecognizer(speechRecognizer);
-            for (auto phrase : StringHelper::Split(m_userConfig->phraseList.value(), ';')) {
-                grammar->AddPhrase(phrase);
+            for (std::string_view phrase : StringHelper::SplitView(m_userConfig->phraseList.value(), ';')) {
+                grammar->AddPhrase(std::string(phrase));
             }
         }
         
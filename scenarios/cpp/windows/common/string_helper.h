@@ -0,0 +1,270 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define STRING_HELPER_SSE2
+#endif
+
+// String functions shared by the C++ scenarios. They take std::string_view, so callers can pass a std::string,
+// a string literal or part of a larger buffer without copying it. Functions that return std::string_view, such as
+// Trim, return part of their argument, so the argument must outlive the result.
+// Case conversion and case-insensitive comparison only handle ASCII letters, which is what HTTP header names,
+// URL schemes and hosts, and the option values and language codes the scenarios compare use.
+class StringHelper
+{
+private:
+    static constexpr char ToLowerAscii(char c)
+    {
+        return ('A' <= c && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+
+    static constexpr bool IsSpace(char c)
+    {
+        return ' ' == c || '\t' == c || '\n' == c || '\v' == c || '\f' == c || '\r' == c;
+    }
+
+    static constexpr bool IsHexDigit(char c)
+    {
+        return ('0' <= c && c <= '9') || ('a' <= c && c <= 'f') || ('A' <= c && c <= 'F');
+    }
+
+#ifdef STRING_HELPER_SSE2
+    // Return the 16 bytes of *bytes* with ASCII upper-case letters changed to lower case.
+    static __m128i ToLowerAscii(__m128i bytes)
+    {
+        // Bytes of 0x80 and above compare as negative, so they are never in the range 'A' to 'Z'.
+        __m128i isUpper = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8('Z' + 1)));
+        return _mm_or_si128(bytes, _mm_and_si128(isUpper, _mm_set1_epi8('a' - 'A')));
+    }
+#endif
+
+public:
+    // The tokens of a string separated by a delimiter, found one at a time as the range is iterated, without
+    // allocating. Like splitting with std::getline, a delimiter at the end does not start another token, and an
+    // empty string has no tokens.
+    class SplitRange
+    {
+    private:
+        std::string_view m_text;
+        char m_delimiter;
+
+    public:
+        class Iterator
+        {
+        private:
+            std::string_view m_rest;
+            std::string_view m_token;
+            char m_delimiter = 0;
+            bool m_end = true;
+
+            void Next()
+            {
+                if (m_rest.empty())
+                {
+                    m_end = true;
+                    return;
+                }
+                size_t delimiter = m_rest.find(m_delimiter);
+                m_token = m_rest.substr(0, delimiter);
+                m_rest = std::string_view::npos == delimiter ? std::string_view() : m_rest.substr(delimiter + 1);
+            }
+
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = std::string_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const std::string_view*;
+            using reference = const std::string_view&;
+
+            Iterator() = default;
+
+            Iterator(std::string_view text, char delimiter) : m_rest(text), m_delimiter(delimiter), m_end(false)
+            {
+                Next();
+            }
+
+            reference operator*() const { return m_token; }
+            pointer operator->() const { return &m_token; }
+
+            Iterator& operator++()
+            {
+                Next();
+                return *this;
+            }
+
+            Iterator operator++(int)
+            {
+                Iterator previous = *this;
+                Next();
+                return previous;
+            }
+
+            // Iterators are only compared with the end iterator.
+            bool operator==(const Iterator& other) const { return m_end == other.m_end && (m_end || m_rest.data() == other.m_rest.data()); }
+            bool operator!=(const Iterator& other) const { return !(*this == other); }
+        };
+
+        SplitRange(std::string_view text, char delimiter) : m_text(text), m_delimiter(delimiter) {}
+
+        Iterator begin() const { return Iterator(m_text, m_delimiter); }
+        Iterator end() const { return Iterator(); }
+    };
+
+    static bool CaseInsensitiveCompare(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        size_t index = 0;
+#ifdef STRING_HELPER_SSE2
+        for (; index + 16 <= a.size(); index += 16)
+        {
+            __m128i aBytes = ToLowerAscii(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a.data() + index)));
+            __m128i bBytes = ToLowerAscii(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b.data() + index)));
+            if (0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi8(aBytes, bBytes)))
+            {
+                return false;
+            }
+        }
+#endif
+        for (; index < a.size(); index++)
+        {
+            if (ToLowerAscii(a[index]) != ToLowerAscii(b[index]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool EndsWith(std::string_view str, std::string_view suffix)
+    {
+        return (str.size() >= suffix.size()) && (0 == str.compare(str.size() - suffix.size(), suffix.size(), suffix));
+    }
+
+    static bool IsUUID(std::string_view str)
+    {
+        if (str.length() != 36)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < str.length(); i++)
+        {
+            if (i == 8 || i == 13 || i == 18 || i == 23)
+            {
+                if ('-' != str[i])
+                {
+                    return false;
+                }
+            }
+            else if (!IsHexDigit(str[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Join the strings in *xs*, which can hold std::string or std::string_view, with *delimiter* between them.
+    // The result is allocated once, at its final size.
+    template<typename Strings>
+    static std::string Join(const Strings& xs, std::string_view delimiter)
+    {
+        size_t size = 0;
+        for (const auto& x : xs)
+        {
+            size += std::string_view(x).size() + delimiter.size();
+        }
+        std::string retval;
+        retval.reserve(size);
+        bool first = true;
+        for (const auto& x : xs)
+        {
+            if (!first)
+            {
+                retval.append(delimiter);
+            }
+            retval.append(std::string_view(x));
+            first = false;
+        }
+        return retval;
+    }
+
+    static std::string_view LeftTrim(std::string_view str)
+    {
+        size_t start = 0;
+        while (start < str.size() && IsSpace(str[start]))
+        {
+            start++;
+        }
+        return str.substr(start);
+    }
+
+    static std::string_view RightTrim(std::string_view str)
+    {
+        size_t end = str.size();
+        while (end > 0 && IsSpace(str[end - 1]))
+        {
+            end--;
+        }
+        return str.substr(0, end);
+    }
+
+    // Return the tokens of *s* separated by *delimiter*, as strings. To visit the tokens without copying them, use
+    // SplitView instead.
+    static std::vector<std::string> Split(std::string_view s, char delimiter)
+    {
+        std::vector<std::string> tokens;
+        for (std::string_view token : SplitView(s, delimiter))
+        {
+            tokens.emplace_back(token);
+        }
+        return tokens;
+    }
+
+    // Return a range of the tokens of *s* separated by *delimiter*, each a view into *s*. For example:
+    // for (std::string_view part : StringHelper::SplitView(url, '/')) { ... }
+    static SplitRange SplitView(std::string_view s, char delimiter)
+    {
+        return SplitRange(s, delimiter);
+    }
+
+    static bool StartsWith(std::string_view str, std::string_view prefix)
+    {
+        return (str.size() >= prefix.size()) && (0 == str.compare(0, prefix.size(), prefix));
+    }
+
+    static std::string ToLower(std::string_view str)
+    {
+        std::string retval(str.size(), '\0');
+        size_t index = 0;
+#ifdef STRING_HELPER_SSE2
+        for (; index + 16 <= str.size(); index += 16)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&retval[index]), ToLowerAscii(_mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + index))));
+        }
+#endif
+        for (; index < str.size(); index++)
+        {
+            retval[index] = ToLowerAscii(str[index]);
+        }
+        return retval;
+    }
+
+    static std::string_view Trim(std::string_view str)
+    {
+        return LeftTrim(RightTrim(str));
+    }
+};
+
+#undef STRING_HELPER_SSE2
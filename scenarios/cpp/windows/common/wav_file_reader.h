@@ -4,10 +4,15 @@
 //
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <stdexcept>
 
 // Adapted from code in:
 // https://github.com/Azure-Samples/cognitive-services-speech-sdk/blob/master/samples/cpp/windows/console/samples/wav_file_reader.h
+// Shared by the C++ scenarios.
 // The format structure expected in wav files.
 struct WAVEFORMAT
 {
@@ -32,6 +37,8 @@ private:
     static constexpr uint16_t chunkSizeBufferSize = 4;
 
     std::fstream m_fs;
+    // Bytes of audio data left to read in the data chunk.
+    uint32_t m_dataRemaining = 0;
 
     void ReadChunkTypeAndSize(char* chunkType, uint32_t* chunkSize)
     {
@@ -97,6 +104,7 @@ private:
                 else if (memcmp(chunkType, "data", chunkTypeBufferSize) == 0)
                 {
                     foundDataChunk = true;
+                    m_dataRemaining = chunkSize;
                     break;
                 }
                 else
@@ -114,7 +122,7 @@ private:
                 throw std::runtime_error("Unexpected end of file, before any audio data can be read.");
             }
         }
-        catch (std::ifstream::failure e)
+        catch (const std::ifstream::failure&)
         {
             throw std::runtime_error("Unexpected end of file or error when reading audio file.");
         }
@@ -148,6 +156,20 @@ public:
         return m_formatHeader;
     }
 
+    // Read up to *size* bytes of audio data into *dataBuffer*. Return the number of bytes read, or 0 at the end of the data.
+    uint32_t Read(uint8_t* dataBuffer, uint32_t size)
+    {
+        uint32_t toRead = std::min(size, m_dataRemaining);
+        if (0 == toRead || !m_fs.good())
+        {
+            return 0;
+        }
+        m_fs.read((char*)dataBuffer, toRead);
+        uint32_t bytesRead = (uint32_t)m_fs.gcount();
+        m_dataRemaining -= bytesRead;
+        return bytesRead;
+    }
+
     void Close()
     {
         m_fs.close();